@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <map>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+#include "Model.hpp"
+#include "Shader.hpp"
+#include "TexturePacker.hpp"
+
+// One place that loads the models, shaders and textures, keyed by their canonical path, so asking
+// twice for the same file gives the same resource. The handles are shared_ptrs, the registry
+// itself only keeps weak_ptrs: a model or shader is freed when the last handle goes.
+//
+// Textures are layers of the shared texture arrays and stay until TexturePacker::CleanUp(),
+// here they are only deduplicated. Freed meshes keep their mesh arena space, the arena never
+// gives anything back.
+//
+// Prefetch() the models first: assimp, the mesh optimizer or the mesh cache run on the workers,
+// side by side, and GetModel() only waits for its own import and uploads on the GL thread.
+class AssetManager
+{
+public:
+    // Start importing a model on the workers, GetModel() picks it up
+    void Prefetch( const std::string& path);
+    // The model uploaded in this vertex format, imported only the first time
+    std::shared_ptr<Model> GetModel( const std::string& path, VertexFormat format = VERTEX_FORMAT_FULL);
+    // One mesh of a model, the handle keeps the whole model alive. Null if there is no such mesh.
+    std::shared_ptr<Mesh> GetMesh( const std::string& path, size_t index, VertexFormat format = VERTEX_FORMAT_FULL);
+    // The program is deleted with the last handle
+    std::shared_ptr<Shader> GetShader( const std::string& vertexPath, const std::string& fragmentPath, VertexFormat format = VERTEX_FORMAT_FULL);
+    // The texture array layer of an interned image, see MaterialTable
+    TextureSlot GetTexture( TextureId id);
+
+    // Free the CPU geometry of every loaded model, the GPU has it. Returns the bytes freed.
+    size_t ReleaseGeometry();
+
+    // Alive resources and how many requests found one already loaded
+    size_t GetModelCount();
+    size_t GetShaderCount();
+    int GetHits() { return hits; }
+    // Import, wait and upload time of every model loaded so far
+    void PrintTimings();
+
+private:
+    // Forget the ones nobody holds anymore
+    template <class T> static size_t Prune( std::map<std::string, std::weak_ptr<T>>& registry);
+
+    // A model import on its way, GetModel() waits for it
+    struct Import {
+        std::mutex mutex;
+        std::condition_variable finished;
+        bool done{false};
+        CookedModel cooked;
+        double milliseconds{0.0};
+    };
+
+    struct Timing {
+        std::string path;
+        double importMilliseconds;      // on a worker, or here if it wasn't prefetched
+        double waitMilliseconds;        // for the worker
+        double uploadMilliseconds;
+        bool prefetched;
+    };
+
+    std::map<std::string, std::weak_ptr<Model>> models;
+    std::map<std::string, std::shared_ptr<Import>> imports;     // by canonical path
+    std::vector<Timing> timings;
+    std::map<std::string, std::weak_ptr<Shader>> shaders;
+    int hits{0};
+};
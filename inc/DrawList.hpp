@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "Shader.hpp"
+#include "Model.hpp"
+
+// Everything needed to draw one object, built without touching OpenGL
+struct DrawPacket
+{
+    uint64_t key;               // sort key, see MakeKey()
+    Shader* shader;
+    Model* model;
+    glm::mat4 modelMatrix;
+    glm::vec3 wireframeColor;
+    float lineWidth;
+    bool wireframe;
+};
+
+// Two stage rendering:
+//   1. the worker threads fill one bucket each with packets (no GL calls, no locks)
+//   2. the GL thread merges the buckets, sorts them and submits
+// Sorting by shader, then fill mode, then model, then front to back keeps the state changes
+// down and lets the depth test reject what is hidden.
+class DrawList
+{
+public:
+    // Drop last frame's packets and make sure there is a bucket per job
+    void Begin( unsigned int bucketCount);
+
+    // Only one thread may add to a bucket
+    void Add( unsigned int bucket, const DrawPacket& packet) { buckets[bucket].push_back( packet); }
+    unsigned int GetBucketCount() { return static_cast<unsigned int>( buckets.size()); }
+
+    // Merge, sort and draw, on the GL thread
+    void Submit( const glm::mat4& view, const glm::mat4& projection);
+
+    size_t GetPacketCount() { return merged.size(); }
+
+    static uint64_t MakeKey( const Shader* shader, const Model* model, bool wireframe, float viewDepth);
+
+private:
+    std::vector<std::vector<DrawPacket>> buckets;
+    std::vector<DrawPacket> merged;
+};
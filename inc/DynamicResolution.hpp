@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "FrameBuffer.hpp"
+
+// Renders the scene at a fraction of the window size when the GPU can't keep up. The fraction
+// comes from the GPU time of the last frames (timer queries, read a few frames late so nothing
+// waits for them): over the budget it drops right away, well under it creeps back up in 5% steps.
+// A planet filling the screen then costs sharpness instead of frames.
+//
+// BeginScene() .. EndScene() go into a buffer of the window size, only the scaled corner of it
+// is used (no reallocation when the scale changes). EndScene() stretches it over the target, so
+// whatever is drawn after it, the HUD, is at the full resolution.
+class DynamicResolution
+{
+public:
+    bool Init( int Width, int Height);
+    void Resize( int Width, int Height);
+    void CleanUp();
+
+    // Bind the scene buffer (or the target itself at full scale) and start the GPU timer
+    void BeginScene( GLuint TargetFBO);
+    // Stop the timer, stretch the scene over the target and bind it with a clear depth buffer
+    void EndScene();
+
+    // 0 = automatic, else always this scale
+    void SetFixedScale( float Scale);
+    float GetScale() { return scale; }
+    // Scene GPU time in ms, smoothed
+    float GetGPUTime() { return gpuTime; }
+
+    float budget{14.0f};        // GPU ms the scene may take, a bit under the 60 Hz frame
+    float minScale{0.5f};
+
+private:
+    static const int QUERY_COUNT = 4;
+    static const int SETTLE_FRAMES = 10;
+
+    void Adapt( float milliseconds);
+    int ScaledWidth() { return std::max( 1, (int)( width * scale)); }
+    int ScaledHeight() { return std::max( 1, (int)( height * scale)); }
+
+    FrameBuffer scene;
+    int width{0};
+    int height{0};
+    GLuint targetFBO{0};
+    bool scaled{false};     // this frame went into the scene buffer
+
+    GLuint queries[QUERY_COUNT]{};
+    bool inFlight[QUERY_COUNT]{};
+    int nextQuery{0};
+    bool measuring{false};
+
+    float scale{1.0f};
+    float fixedScale{0.0f};
+    float gpuTime{0.0f};
+    int framesSinceChange{0};
+};
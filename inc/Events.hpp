@@ -65,6 +65,9 @@ struct Keys
 struct SDLEvents
 {
     bool ScreenResize{false};
+    // window state, these stay until it changes again
+    bool Focused{true};
+    bool Minimized{false};
 };
 
 struct Mouse {
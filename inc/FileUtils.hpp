@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Small file helpers shared by the caches under cache/
+
+// FNV-1a, 64 bit. Pass the previous result as hash to chain several pieces.
+uint64_t HashBytes( const void* data, size_t size, uint64_t hash = 14695981039346656037ull);
+
+// The same file always gets the same name: forward slashes, no "." or "dir/.." in it.
+// Only the string is looked at, symbolic links are not followed.
+std::string CanonicalPath( const std::string& path);
+
+// mkdir -p
+void MakeDirectories( const std::string& path);
+
+// Every file below the directory, recursively, as directory/sub/name. Sorted, so the order
+// doesn't depend on the file system.
+void ListFiles( const std::string& directory, std::vector<std::string>& files);
+
+// Size and modification time (seconds) of a file, false if there is none
+bool GetFileStamp( const std::string& path, uint64_t& size, uint64_t& time);
+
+// The whole file, false if it can't be opened
+bool ReadFile( const std::string& path, std::vector<unsigned char>& data);
+
+// Written next to the final name and renamed, so nobody ever reads half a file.
+// The temporary name is per thread, two workers may write the same file at once.
+bool WriteFileAtomic( const std::string& path, const void* data, size_t size);
+
+// A whole file mapped read only, unmapped again with Close() or when it goes out of scope
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile() { Close(); }
+    MappedFile( const MappedFile&) = delete;
+    MappedFile& operator=( const MappedFile&) = delete;
+
+    // False if it can't be opened or is empty
+    bool Open( const std::string& path);
+    void Close();
+
+    const unsigned char* GetData() const { return data; }
+    size_t GetSize() const { return size; }
+
+private:
+    const unsigned char* data{nullptr};
+    size_t size{0};
+#ifdef _WIN32
+    void* file{nullptr};
+    void* mapping{nullptr};
+#else
+    int file{-1};
+#endif
+};
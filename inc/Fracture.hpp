@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "Shader.hpp"
+#include "Model.hpp"
+
+// A vertex of a shard, layer < 0 is the freshly broken inside
+struct ShardVertex
+{
+    glm::vec3 Position;     // relative to the shard's centroid
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+    float Layer;            // texture array layer of the outside
+};
+
+// Voronoi fracture: a model is cut up in cells around random seed points, every cell clipped
+// out of the model's triangles (the outside) plus the cell walls clipped to the model's hull
+// (the inside). That only holds for convex models, which the planets are.
+//
+// Request() the models at load time, the workers cut them and Update() uploads all the shards
+// of a model into one vertex buffer. Shatter() then only spawns rigid bodies for them, no
+// geometry is made on the frame something breaks.
+class FractureCache
+{
+public:
+    // Copies the model's CPU geometry, so before AssetManager::ReleaseGeometry()
+    void Request( Model* model, int shardCount, unsigned int seed);
+    // Upload the models the workers are done with, once per frame
+    void Update();
+    // Wait for all of them
+    void Finish();
+    bool IsReady( Model* model);
+    // The terrain colours of a PlanetTerrain planet on the model's shards, the heights are
+    // worked out on the workers once the model is cut
+    void RequestTerrain( Model* model, unsigned int terrainSeed);
+    void CleanUp();
+
+    // Replace the model at modelMatrix (uniform scale) with its flying shards. With a
+    // terrainSeed from RequestTerrain() the outside gets the colours of that planet instead of
+    // the model's texture, if its heights are in. False if the model isn't ready, then nothing
+    // happens.
+    bool Shatter( Model* model, const glm::mat4& modelMatrix, const glm::vec3& velocity, int terrainSeed = -1);
+    void Simulate( float dt);
+    void Draw( Shader& shader, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& sunDirection);
+
+    size_t GetBodyCount() { return bodies.size(); }
+
+    float lifetime{30.0f};      // seconds a shard flies before it is gone
+    float speed{2.0f};          // outwards, in model radii per second
+
+private:
+    struct Shard {
+        GLuint firstIndex;
+        GLsizei indexCount;
+        glm::vec3 centroid;     // in model space
+    };
+
+    struct Cut {
+        std::vector<ShardVertex> vertices;
+        std::vector<GLuint> indices;
+        std::vector<Shard> shards;
+        std::vector<glm::vec3> directions;  // per vertex in model space, 0 on the inside
+    };
+
+    struct TerrainHeights {
+        Model* model;
+        unsigned int seed;
+        std::vector<float> heights;         // per vertex
+    };
+
+    // The shards with the terrain heights of one planet seed on top
+    struct Variant {
+        unsigned int seed;
+        GLuint vao{0};
+        GLuint vbo{0};          // a height per vertex
+    };
+
+    struct Fractured {
+        Model* model{nullptr};
+        int textureGroup{-1};
+        std::vector<Shard> shards;
+        std::shared_ptr<const std::vector<glm::vec3>> directions;  // for the workers, see Cut
+        std::vector<unsigned int> terrainSeeds;     // requested, with a variant or not yet
+        std::vector<Variant> variants;
+        GLuint vao{0};
+        GLuint vbo{0};
+        GLuint ebo{0};
+        bool ready{false};
+    };
+
+    // The workers hand the cuts back through this
+    struct Done {
+        std::mutex mutex;
+        std::vector<std::pair<Model*, Cut>> ready;
+        std::vector<TerrainHeights> heights;
+        bool stopping{false};
+    };
+
+    struct Body {
+        int fractured;
+        int shard;
+        int variant;            // -1 is the model's own texture
+        glm::vec3 position;
+        glm::vec3 velocity;
+        glm::quat orientation;
+        glm::vec3 spin;         // axis * radians per second
+        float scale;
+        float age;
+    };
+
+    // Model geometry copied for the workers
+    struct Source {
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+    };
+
+    static void CutModel( const Source& source, int shardCount, unsigned int seed, Cut& cut);
+    void Upload( Model* model, const Cut& cut);
+    void QueueTerrain( const Fractured& f, unsigned int seed);
+    void UploadVariant( const TerrainHeights& heights);
+
+    std::vector<Fractured> fractured;
+    std::shared_ptr<Done> done;
+    int pending{0};
+    std::vector<Body> bodies;
+    unsigned int shatterCount{0};
+};
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Offscreen render target, RGBA8 color texture and a 24 bit depth buffer
+class FrameBuffer
+{
+public:
+    bool Create( int Width, int Height);
+    void Resize( int Width, int Height);
+    void Destroy();
+
+    // Render into it, the viewport is set to the full size
+    void Bind();
+
+    // Read back the color buffer, RGBA, bottom row first (the OpenGL way)
+    void ReadPixels( std::vector<unsigned char>& pixels);
+
+    // Read back and write an uncompressed PNG, top row first like any image viewer expects
+    bool SavePNG( const std::string& path);
+
+    GLuint GetFBO() { return fbo; }
+    GLuint GetColorTexture() { return colorTexture; }
+    int GetWidth() { return width; }
+    int GetHeight() { return height; }
+
+private:
+    GLuint fbo{0};
+    GLuint colorTexture{0};
+    GLuint depthBuffer{0};
+    int width{0};
+    int height{0};
+};
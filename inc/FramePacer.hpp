@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+
+// Frame interval statistics, what the pacer actually delivered
+struct PacingStats
+{
+    int frames{0};
+    int missed{0};              // released more than a millisecond after their time slot
+    double intervalSum{0.0};    // seconds
+    double intervalSquares{0.0};
+    double lateMax{0.0};        // seconds
+
+    void Add( double interval, double late);
+    float AverageMs() const;
+    // standard deviation of the frame intervals
+    float JitterMs() const;
+    float LateMaxMs() const { return (float)( lateMax * 1000.0); }
+};
+
+// Keeps the main loop from running flat out. Wait() sleeps until the frame's time slot, most
+// of it with the OS sleep and the last bit spinning on steady_clock (the OS sleep wakes up late,
+// the spin is exact). Without a window to look at (unfocused or minimized) the idle rate is used.
+class FramePacer
+{
+public:
+    void Init();
+    void CleanUp();
+
+    // frames per second, 0 = no limit (vsync, if on, still limits)
+    void SetTargetRate( float Hz) { targetRate = Hz; }
+    void SetIdleRate( float Hz) { idleRate = Hz; }
+    void SetIdle( bool Idle) { idle = Idle; }
+    bool IsIdle() { return idle; }
+
+    // Sleep until it is time for the next frame, call it right before the swap
+    void Wait();
+
+    // Swap interval 0 = off, 1 = vsync, -1 = adaptive (a late frame tears instead of waiting for
+    // the next refresh). Adaptive falls back to vsync where the driver can't. Returns what was set.
+    static int SetVSync( int interval);
+
+    // Since the start, and since the last call of TakeRecentStats()
+    const PacingStats& GetStats() { return total; }
+    PacingStats TakeRecentStats();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // the OS sleep ends this much before the slot, the rest is spinning
+    const Clock::duration spinMargin{ std::chrono::microseconds( 1500)};
+
+    float targetRate{0.0f};
+    float idleRate{15.0f};
+    bool idle{false};
+
+    Clock::time_point deadline;
+    Clock::time_point lastFrame;
+    bool started{false};
+
+    PacingStats total;
+    PacingStats recent;
+};
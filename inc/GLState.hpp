@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+
+// Shadow copy of the OpenGL state we change while rendering. Every setter compares with what is
+// already set and only calls the driver when it really changes.
+// Everything binding a program, VAO or texture, or changing the states below, must go through
+// here or the shadow copy goes stale. Call Invalidate() after code that doesn't.
+class GLStateCache
+{
+public:
+    static const int MAX_TEXTURE_UNITS = 16;
+
+    void UseProgram( GLuint program);
+    void BindVertexArray( GLuint vao);
+    // Activates the unit (if needed) and binds, GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP and GL_TEXTURE_2D_ARRAY
+    void BindTexture( GLuint unit, GLenum target, GLuint texture);
+    void PolygonMode( GLenum mode);     // GL_FRONT_AND_BACK only, core profile has nothing else
+    void DepthFunc( GLenum func);
+    void DepthMask( GLboolean enable);
+    void LineWidth( GLfloat width);
+    void BlendFunc( GLenum sfactor, GLenum dfactor);
+    // GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND and GL_PROGRAM_POINT_SIZE are tracked, anything else goes straight through
+    void Enable( GLenum cap);
+    void Disable( GLenum cap);
+
+    // Forget everything, the next call of every setter goes to the driver
+    void Invalidate();
+    // Call with the name right after glDeleteProgram/VertexArrays/Textures. GL drops its
+    // bindings, so must the cache, or a new object given the same name skips its first bind.
+    void ForgetProgram( GLuint Program);
+    void ForgetVertexArray( GLuint VAO);
+    void ForgetTexture( GLuint texture);
+
+    // Call once per frame, keeps the last frame's numbers
+    void BeginFrame();
+    int GetCallsIssued() { return lastIssued; }
+    int GetCallsSaved() { return lastSaved; }
+
+private:
+    enum { TARGET_2D, TARGET_CUBE_MAP, TARGET_2D_ARRAY, TARGET_COUNT };
+    enum { CAP_DEPTH_TEST, CAP_CULL_FACE, CAP_BLEND, CAP_PROGRAM_POINT_SIZE, CAP_COUNT };
+    static const GLuint UNKNOWN = 0xffffffffu;
+
+    bool Changed( GLuint& shadow, GLuint value);
+    void SetCap( GLenum cap, bool enable);
+
+    GLuint program{0};
+    GLuint vao{0};
+    GLuint activeUnit{0};
+    GLuint textures[MAX_TEXTURE_UNITS][TARGET_COUNT]{};
+    GLuint polygonMode{GL_FILL};
+    GLuint depthFunc{GL_LESS};
+    GLuint depthMask{GL_TRUE};
+    GLfloat lineWidth{1.0f};
+    GLuint blendSrc{GL_ONE};
+    GLuint blendDst{GL_ZERO};
+    GLuint caps[CAP_COUNT]{0, 0, 0, 0};
+
+    int issued{0};
+    int saved{0};
+    int lastIssued{0};
+    int lastSaved{0};
+};
@@ -37,10 +37,27 @@
 #include "Controller.hpp"
 
 #include "Shader.hpp"
+#include "ShaderCache.hpp"
 #include "Model.hpp"
 #include "Object.hpp"
 #include "Skybox.hpp"
 #include "Collision.hpp"
+#include "Occlusion.hpp"
+#include "Hud.hpp"
+#include "DrawList.hpp"
+#include "ThreadPool.hpp"
+#include "GLState.hpp"
+#include "Headless.hpp"
+#include "FrameBuffer.hpp"
+#include "DynamicResolution.hpp"
+#include "FramePacer.hpp"
+#include "TexturePacker.hpp"
+#include "TextureStreamer.hpp"
+#include "PlanetTerrain.hpp"
+#include "Impostor.hpp"
+#include "Particles.hpp"
+#include "Fracture.hpp"
+#include "AssetManager.hpp"
 
 
 #define SDL_WINDOW_FLAG SDL_WINDOW_SHOWN | SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE
@@ -78,10 +95,13 @@ public:
     void Clear( glm::vec4 col);
     void Render();
     void RenderModels();
+    void BuildOcclusionBuffer();
 
     void Update();
     int  Run();
     void CleanUp();
+    // Drop the models and shaders, before the GL context goes
+    void ReleaseAssets();
     void InitObject();
     void HandleEvents();
     void Timing();
@@ -120,21 +140,44 @@ private:
     glm::vec3 spawnPoint{0.0f};
     bool drawLineMode_enable{false};
 
-    std::unordered_map<std::string, Shader> shaders;
-    std::unordered_map<std::string, Model> systemModels;
-    std::unordered_map<std::string, Model> gameModels;
-    std::unordered_map<std::string, Model> hudModels;
+    // Views onto the asset manager, a model in several of them is still loaded once
+    std::unordered_map<std::string, std::shared_ptr<Shader>> shaders;
+    std::unordered_map<std::string, std::shared_ptr<Model>> systemModels;
+    std::unordered_map<std::string, std::shared_ptr<Model>> gameModels;
+    std::unordered_map<std::string, std::shared_ptr<Model>> hudModels;
 
-    GameObject obj; // just a temperary placeholder to cache object data.
-    std::unordered_map<std::string, Shader>::iterator shaderItr;
-    std::unordered_map<std::string, Model>::iterator modelItr;
+    std::unordered_map<std::string, std::shared_ptr<Shader>>::iterator shaderItr;
+
+    // Radar and compass, the resources are resolved once in InitHUDObjects()
+    HudRenderer hud;
+    float hudBlipRadius{1.0f};      // radius of the sphere model the blips used to be drawn with
 
     SkyBox skybox;
 
+    // Built on the worker threads, submitted on the GL thread, see RenderModels()
+    DrawList drawList;
+
     Collision collision;
 
     bool renderCollisionBoxes{false};
 
+    // Occlusion culling, the nearest planets are rasterized on the CPU and hide what is behind them
+    OcclusionBuffer occlusionBuffer{256, 128};
+    std::vector<glm::vec3> occluderVertices;
+    std::vector<unsigned int> occluderIndices;
+    bool occlusionCulling_enable{true};
+    unsigned int maxOccluders{8};
+
+    // The planets are drawn as terrain, the sphere model is left for the collisions and the occluders
+    bool planetTerrain_enable{true};
+    // The atlas layer of every planet's impostor (-1 = none), indexed like gameObjects. Below
+    // impostorPixels of radius on the screen a planet is only its impostor, up to twice that both fade.
+    std::vector<int> planetImpostors;
+    float impostorPixels{24.0f};
+    // Different planets baked at most, 2 MB each. The n-th planet borrows the impostor of planet
+    // n % impostorPalette, at a few pixels nobody tells their terrains apart.
+    int impostorPalette{16};
+
     // Timeing stuff
 //    std::chrono::time_point<std::chrono::_V2::system_clock, std::chrono::nanoseconds> tp1;
 //    std::chrono::time_point<std::chrono::_V2::system_clock, std::chrono::nanoseconds> tp2;
@@ -144,14 +187,21 @@ private:
 	float fFrameTimer = 1.0f;
     float dt{0.f};
 
+    // Headless runs, see globals.headless. The frame times are wall clock including glFinish()
+    HeadlessContext headlessContext;
+    FrameBuffer offscreen;
+    std::vector<float> frameTimes;
+    int frameNumber{0};
+    void EndHeadlessFrame();
+
     float m_WMVelY{100.0f};
 
     std::string titleHeader;
 
-    SDL_Window* sdlWindow;
+    SDL_Window* sdlWindow{nullptr};
     SDL_GLContext sdlGLContext{nullptr};
 
-    SDL_Renderer* displayRenderer;
+    SDL_Renderer* displayRenderer{nullptr};
     SDL_RendererInfo displayRendererInfo;
 
 
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <string>
 #include <glm/matrix.hpp>
 
 struct Globals{
@@ -23,6 +24,17 @@ struct Globals{
     int screenheight;
     bool m_gameRunning{true};
 
+    // Command line, see main()
+    bool headless{false};           // no window, render into an offscreen framebuffer
+    int benchmarkFrames{0};         // stop after this many frames, 0 runs until Esc
+    std::string dumpFramesDir;      // write every frame as a PNG in here, empty is off
+    unsigned int randomSeed{0};     // 0 seeds from the clock
+    float renderScale{0.0f};        // scene resolution, 0 adapts it to the GPU time
+    float targetFps{0.0f};          // frame limit, 0 is none (vsync still limits)
+    float idleFps{15.0f};           // frame limit while the window is unfocused or minimized
+    int vsync{-1};                  // swap interval, 0 off, 1 on, -1 adaptive
+    std::string archivePath{"res.pak"};     // made by make cook, the loose res/ files without it
+
     glm::mat4 worldMatrix{1.f};
     glm::mat4 viewMatrix{1.f};
     glm::mat4 projectionMatrix{1.f};
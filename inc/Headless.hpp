@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#ifdef _WIN32
+    #include <SDL2/include/SDL.h>
+#else
+    #include <SDL2/SDL.h>
+    #include <EGL/egl.h>
+#endif
+
+// OpenGL 3.3 core context without a window, for benchmarks and CI machines without a display.
+// On Linux it is an EGL surfaceless context (or a pbuffer when surfaceless is missing), that also
+// runs on Mesa's llvmpipe without any GPU. On Windows it falls back to a hidden SDL window.
+// Nothing is presented, the game renders into a FrameBuffer instead.
+class HeadlessContext
+{
+public:
+    bool Create( int width, int height);
+    void Destroy();
+
+private:
+#ifdef _WIN32
+    SDL_Window* window{nullptr};
+    SDL_GLContext context{nullptr};
+#else
+    EGLDisplay display{EGL_NO_DISPLAY};
+    EGLContext context{EGL_NO_CONTEXT};
+    EGLSurface surface{EGL_NO_SURFACE};
+#endif
+};
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Shader.hpp"
+#include "Model.hpp"
+#include "Object.hpp"
+
+// Radar/compass renderer.
+// The shaders and models are looked up once in Init(), the radar blips are collected every frame
+// into one streaming buffer and drawn as point sprites with a single draw call.
+class HudRenderer
+{
+public:
+    void Init( Shader* CompassShader, Model* CompassModel, Shader* BlipShader);
+
+    // Collect the blips for this frame, position is in the HUD's ortho space
+    void BeginBlips();
+    void AddBlip( const glm::vec3& position, const glm::vec3& color = glm::vec3( 0.2f, 0.6f, 1.0f));
+    // Draw all the collected blips, pointSize in pixels
+    void DrawBlips( const glm::mat4& projection, float pointSize);
+
+    // Draw the compass model with the given projection*model matrix
+    void DrawCompass( const glm::mat4& projectionModel, const glm::vec3& scale, bool wireframe);
+
+    size_t GetBlipCount() { return blips.size(); }
+
+    void CleanUp();
+
+private:
+    struct Blip {
+        glm::vec3 position;
+        glm::vec3 color;
+    };
+
+    Shader* blipShader{nullptr};
+    GameObject compass;
+    bool initialized{false};
+
+    std::vector<Blip> blips;
+    GLuint blipVAO{0};
+    GLuint blipVBO{0};
+    GLsizeiptr blipCapacity{0};     // in blips
+};
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <vector>
+#include <functional>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Shader.hpp"
+
+// Octahedral impostors: a round object is rendered once from FRAMES x FRAMES directions spread
+// over the octahedron, each view a tile of one layer of the atlas (albedo and model space normal).
+// A far away copy is then a camera facing quad. The fragment shader hits the sphere with the view
+// ray, blends the four tiles nearest to the view direction at that point and lights it with the
+// real sun direction, so it turns and shades like the mesh. The depth is the sphere's too.
+//
+// All the quads of a frame are one instanced draw, however many there are.
+class ImpostorAtlas
+{
+public:
+    static const int FRAMES = 8;
+    static const int FRAME_SIZE = 64;   // pixels
+
+    // Room for Count different objects, fewer if the driver has less array layers (see GetCount())
+    bool Init( int Count);
+    void CleanUp();
+
+    // Render one object into the next layer. draw() gets called for every frame with the view and
+    // projection to use, the object is centered on the origin and within extent of it.
+    // Returns the layer, -1 when full.
+    int Bake( float extent, const std::function<void( const glm::mat4& view, const glm::mat4& projection)>& draw);
+
+    void Begin();
+    // model = the object's model matrix (uniform scale, radius 1 in model space),
+    // fade = the part the real mesh draws, the impostor dithers out what the mesh dithers in
+    void Add( const glm::mat4& model, int layer, float fade = 0.0f);
+    void Draw( Shader& shader, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& sunDirection);
+
+    size_t GetInstanceCount() { return instances.size(); }
+    // Layers there are room for
+    int GetCount() { return count; }
+
+private:
+    struct Instance {
+        glm::vec4 centerRadius;
+        glm::vec4 rotation;         // quaternion, model to world
+        glm::vec2 layerFade;
+        float extent;               // of the baked views, in radii
+    };
+
+    GLuint colorArray{0};
+    GLuint normalArray{0};
+    GLuint fbo{0};
+    GLuint depthBuffer{0};
+    GLuint vao{0};
+    GLuint quadVBO{0};
+    GLuint instanceVBO{0};
+    int count{0};
+    int baked{0};
+    std::vector<float> extents;     // per layer
+    std::vector<Instance> instances;
+};
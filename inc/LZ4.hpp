@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+// The LZ4 block format (no frame header), so lz4 -d and friends understand the pieces.
+// Greedy matching with one hash table, fast enough to run at cook time on anything.
+
+// Appends the compressed block to out
+void LZ4Compress( const unsigned char* source, size_t size, std::vector<unsigned char>& out);
+// destination must be exactly the uncompressed size, false on broken or foreign data
+bool LZ4Decompress( const unsigned char* source, size_t size, unsigned char* destination, size_t destinationSize);
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <array>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+#include "TexturePacker.hpp"
+
+// What a texture is for in its material, the order is the order the importers list them in
+enum TextureType
+{
+    TEXTURE_DIFFUSE = 0,
+    TEXTURE_SPECULAR,
+    TEXTURE_NORMAL,
+    TEXTURE_HEIGHT,
+    TEXTURE_TYPE_COUNT
+};
+
+// Index into the materials, 0 is the one without any textures
+typedef uint16_t MaterialId;
+
+struct Material
+{
+    TextureId textures[TEXTURE_TYPE_COUNT];     // the first of each type, NO_TEXTURE if none
+    int textureGroup{-1};                       // texture array of the diffuse texture, -1 without one
+    GLuint layer{0};                            // and its layer
+};
+
+// Every texture path is stored once, every distinct combination of textures is one material, so a
+// mesh only carries a small MaterialId and two meshes have the same material when the ids match.
+// Two models naming the same image (however the path is spelled) share the texture id too.
+//
+// Filled on the GL thread while the models are uploaded, every new texture id goes to the texture
+// arrays through AssetManager::GetTexture(), which look its path up here.
+class MaterialTable
+{
+public:
+    MaterialTable();
+
+    // The material of these textures (paths relative to directory), added if it is new
+    MaterialId Add( const std::string& directory, const std::vector<std::pair<TextureType, std::string>>& textures);
+    // Once per path, NO_TEXTURE for an empty one
+    TextureId InternTexture( const std::string& path);
+
+    const Material& Get( MaterialId id) const { return materials[id < materials.size() ? id : 0]; }
+    const std::string& GetTexturePath( TextureId id) const { return paths[id]; }
+    TextureSlot GetTextureSlot( TextureId id) const { return id < slots.size() ? slots[id] : TextureSlot(); }
+
+    size_t GetMaterialCount() const { return materials.size(); }
+    size_t GetTextureCount() const { return paths.size(); }
+
+    // Forget everything, with the texture arrays
+    void CleanUp();
+
+private:
+    std::vector<Material> materials;
+    std::map<std::array<TextureId, TEXTURE_TYPE_COUNT>, MaterialId> materialIds;
+    std::vector<std::string> paths;         // canonical
+    std::vector<TextureSlot> slots;         // per path
+    std::map<std::string, TextureId> textureIds;
+};
@@ -28,6 +28,8 @@
 #include <assimp/Importer.hpp>
 
 #include "Shader.hpp"
+#include "MeshArena.hpp"
+#include "Material.hpp"
 
 using namespace std;
 
@@ -43,36 +45,54 @@ struct Vertex
     glm::vec3 Tangent;
     // bitangent
     glm::vec3 Bitangent;
-
+    // texture array layer of the material, set by the Mesh
+    GLuint Material;
 };
 
-struct Texture
+// Compact vertex, 20 bytes instead of the 56 of Vertex
+struct PackedVertex
 {
-    GLuint id;
-    string type;
-    aiString path;
+    // Position quantized to the mesh bounds, see Mesh::dequantOffset/dequantScale.
+    // w: bit 15 is the tangent handedness (set = +1), bits 0-14 the texture array layer of the material
+    GLushort Position[4];
+    // Octahedral encoded normal
+    GLshort Normal[2];
+    // TexCoords as half floats
+    GLushort TexCoords[2];
+    // Octahedral encoded tangent
+    GLshort Tangent[2];
 };
 
 class Mesh
 {
 public:
     /*  Mesh Data  */
+    // CPU copy of the geometry, empty after ReleaseGeometry()
     vector<Vertex> vertices;
     vector<GLuint> indices;
-    vector<Texture> textures;
-    GLuint VAO;
+    // Its textures, see MaterialTable. Same id, same textures.
+    MaterialId material{0};
+    // Where the vertices and indices live in the shared mesh arena
+    MeshAllocation allocation;
+    // The texture array of the diffuse texture of the material, -1 if there is none. Its layer is in the vertices.
+    int textureGroup{-1};
+    // Position = quantized position * dequantScale + dequantOffset  (VERTEX_FORMAT_PACKED only)
+    glm::vec3 dequantOffset{0.0f};
+    glm::vec3 dequantScale{1.0f};
 
-    // Constructor
-    Mesh( vector<Vertex> vert, vector<GLuint> indi, vector<Texture> text );
+    // Constructor, the vertices are uploaded in the given format. Move the vectors in, they are kept.
+    Mesh( vector<Vertex> vert, vector<GLuint> indi, MaterialId materialId, VertexFormat format = VERTEX_FORMAT_FULL );
 
     // Render the mesh
     void Draw( Shader& shader );
+    // Free the CPU copy, the arena has its own. Returns the bytes freed.
+    size_t ReleaseGeometry( );
 
 private:
-    GLuint VBO, EBO;
-
-    // Initializes all the buffer objects/arrays
-    void setupMesh( );
+    // Copies the vertices and indices into the mesh arena
+    void setupMesh( VertexFormat format );
+    // Converts the vertices to the packed format and sets the dequantization transform
+    vector<PackedVertex> packVertices( );
 };
 
 
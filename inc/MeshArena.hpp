@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+
+// The vertex layouts the arena knows about, there is one VAO and one set of buffers per layout
+enum VertexFormat
+{
+    VERTEX_FORMAT_FULL,     // struct Vertex, position, normal, uv, tangent, bitangent as floats
+    VERTEX_FORMAT_PACKED,   // struct PackedVertex, quantized position, octahedral normal/tangent, half float uv
+    VERTEX_FORMAT_COUNT
+};
+
+// Size in bytes of one vertex in the given format
+GLsizei VertexFormatStride( VertexFormat format);
+
+// Where a mesh ended up inside the arena
+struct MeshAllocation
+{
+    VertexFormat format{VERTEX_FORMAT_FULL};
+    GLint baseVertex{0};
+    GLuint firstIndex{0};
+    GLsizei indexCount{0};
+};
+
+// All the static meshes share a few large vertex and index buffers.
+// Every draw of the same vertex format uses the same VAO, the meshes are picked out with
+// glDrawElementsBaseVertex offsets so we don't rebind anything between the draws.
+class MeshArena
+{
+public:
+    // Copy the vertices and indices into the arena, the buffers grow if needed
+    MeshAllocation Allocate( VertexFormat format, const void* vertices, GLsizei vertexCount, const GLuint* indices, GLsizei indexCount);
+
+    // Bind the shared VAO of the format (skipped if it is already bound)
+    void Bind( VertexFormat format);
+    // Draw an allocation, binds the VAO of its format if needed
+    void Draw( const MeshAllocation& allocation);
+
+    // Memory used in bytes
+    GLsizeiptr GetVertexBytes( VertexFormat format);
+    GLsizeiptr GetIndexBytes( VertexFormat format);
+
+    void CleanUp();
+
+private:
+    struct Pool {
+        GLuint VAO{0};
+        GLuint VBO{0};
+        GLuint EBO{0};
+        GLsizei vertexCapacity{0};
+        GLsizei vertexUsed{0};
+        GLsizei indexCapacity{0};
+        GLsizei indexUsed{0};
+    };
+
+    void Grow( VertexFormat format, GLsizei minVertices, GLsizei minIndices);
+    void SetupAttributes( VertexFormat format);
+
+    Pool pools[VERTEX_FORMAT_COUNT];
+};
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "Mesh.hpp"
+
+// A mesh as the importer left it: triangulated, tangents made and the triangles already reordered
+// for the vertex cache, ready to be uploaded
+struct CookedMesh
+{
+    vector<Vertex> vertices;
+    vector<GLuint> indices;
+    // the material's texture references, the textures themselves go their own way
+    vector<std::pair<TextureType, string>> textures;    // path relative to the model
+};
+
+struct CookedModel
+{
+    glm::vec3 minValue{10000.0f};
+    glm::vec3 maxValue{-10000.0f};
+    vector<CookedMesh> meshes;
+    string log;     // what the import had to say, printed where the model is uploaded
+};
+
+// Mesh cooking: what assimp and the mesh optimizer make of a model is stored in cache/meshes,
+// named after the hash of the source file (and the material libraries it names) and the import
+// flags. The next launches map that file and hand the blobs to the meshes, assimp isn't touched.
+//
+// The file: a header, then per mesh its counts, texture references, vertices and indices.
+class MeshCache
+{
+public:
+    MeshCache( const std::string& Directory = "cache/meshes");
+
+    // The cache file of the source imported with these flags, empty if the source can't be read
+    std::string GetCachePath( const std::string& sourcePath, unsigned int importFlags);
+
+    // False if there is no such file (yet) or it isn't one of ours
+    bool Load( const std::string& cachePath, CookedModel& model);
+    // Store it for the next launch, false if it couldn't be written
+    bool Store( const std::string& cachePath, const CookedModel& model);
+
+    // The file in memory, the resource archive keeps its meshes the same way
+    static bool Decode( const unsigned char* data, size_t size, CookedModel& model);
+    static void Encode( const CookedModel& model, std::vector<unsigned char>& file);
+
+private:
+    std::string directory;
+};
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "Mesh.hpp"
+
+// Import time index/vertex buffer optimizations, CPU only.
+//
+// Run them in this order:
+//   OptimizeVertexCache()   reorder the triangles so the post transform cache is reused (Tom Forsyth)
+//   OptimizeOverdraw()      reorder whole clusters of triangles so the outer ones are drawn first
+//   OptimizeVertexFetch()   renumber the vertices in the order they are first used
+
+// Average Cache Miss Ratio (misses per triangle, 0.5 - 3.0) and
+// Average Transformed Vertex Ratio (misses per vertex, 1.0 is perfect)
+struct VertexCacheStats
+{
+    float acmr{0.0f};
+    float atvr{0.0f};
+};
+
+// Simulate a FIFO post transform cache of the given size
+VertexCacheStats AnalyzeVertexCache( const std::vector<GLuint>& indices, size_t vertexCount, unsigned int cacheSize = 16);
+
+void OptimizeVertexCache( std::vector<GLuint>& indices, size_t vertexCount);
+// threshold: how much worse the ACMR of a cluster may get (1.05 = 5%) to get more clusters to sort
+void OptimizeOverdraw( std::vector<GLuint>& indices, const std::vector<Vertex>& vertices, float threshold = 1.05f);
+void OptimizeVertexFetch( std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
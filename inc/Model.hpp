@@ -35,24 +35,37 @@
 
 #include "Shader.hpp"
 #include "Mesh.hpp"
+#include "MeshCache.hpp"
 
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
-
 class Model
 {
 public:
     vector<Mesh> meshes;
     string directory;
-    vector<Texture> textures_loaded;
     bool gammaCorrection;
+    // The layout the meshes are uploaded in, must match the vertex shader they are drawn with
+    VertexFormat vertexFormat;
 
-   Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+   Model(string const &path, VertexFormat format = VERTEX_FORMAT_FULL, bool gamma = false) : gammaCorrection(gamma), vertexFormat(format)
+    {
+        CookedModel cooked;
+        Import( path, cooked);
+        upload( path, cooked);
+    }
+    // Upload what Import() made of the model, the meshes take the vertices out of cooked
+    Model(string const &path, CookedModel &cooked, VertexFormat format = VERTEX_FORMAT_FULL, bool gamma = false) : gammaCorrection(gamma), vertexFormat(format)
     {
-        this->loadModel( path);
+        upload( path, cooked);
     }
 
+    // Read the model into memory, from the mesh cache or with assimp and the mesh optimizer.
+    // No GL and no shared state, so it runs on the worker threads. False if it can't be read.
+    static bool Import( string const &path, CookedModel &cooked);
+
     void Draw( Shader &shader);
+    // Free the CPU copies of the meshes once nothing reads them anymore, returns the bytes freed
+    size_t ReleaseGeometry( );
 
     glm::vec3 GetMinValue() { return minValue; }
     glm::vec3 GetMaxValue() { return maxValue; }
@@ -62,10 +75,12 @@ private:
     glm::vec3 maxValue{-10000.0f};
 
 
-    void loadModel( string const &path);
-    void processNode( aiNode *node, const aiScene *scene);
-    Mesh processMesh( aiMesh *mesh, const aiScene *scene);
-    vector<Texture> loadMaterialTextures( aiMaterial *mat, aiTextureType type, string typeName );
+    void upload( string const &path, CookedModel &cooked);
+    static void processNode( aiNode *node, const aiScene *scene, CookedModel &cooked);
+    static CookedMesh processMesh( aiMesh *mesh, const aiScene *scene, CookedModel &cooked);
+    // bounds, vertex cache and overdraw order, whichever importer made the mesh
+    static void optimizeMesh( const string &name, CookedMesh &mesh, CookedModel &cooked);
+    static void materialTextures( aiMaterial *mat, aiTextureType type, TextureType textureType, CookedMesh &mesh);
 
 };
 
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "MeshCache.hpp"
+
+// Our own Wavefront OBJ reader, assimp stays for everything else.
+//
+// The file is mapped and cut into chunks at line ends, the chunks are counted and then parsed in
+// parallel straight into the shared position/uv/normal arrays. Every corner of a face becomes a
+// vertex once: identical v/vt/vn triples are merged with a hash table. Knows v, vt, vn, f (any
+// polygon, as a fan), o, usemtl and mtllib with map_Kd, map_Ks, map_Bump and map_Ka.
+//
+// The result matches the assimp import with Triangulate | FlipUVs | CalcTangentSpace: one mesh
+// per object and material, v flipped, tangents only with uvs. Returns false, and leaves the rest
+// to assimp, if the file can't be read or refers to vertices it doesn't have.
+bool LoadOBJ( const std::string& path, CookedModel& model, std::vector<std::string>& meshNames);
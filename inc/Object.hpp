@@ -23,6 +23,7 @@
 #include "Shader.hpp"
 #include "Model.hpp"
 #include "Camera.hpp"
+#include "DrawList.hpp"
 
 
 // Have to add this everytime I export from blender in "compass.mtl"
@@ -84,6 +85,10 @@ public:
     void Update( float deltaTime);
     // Draw the object
     void Draw( bool globalWireframe_enabled = false);
+    // Fill in what Draw() would do instead of doing it, no OpenGL so it can run on the worker threads
+    void BuildDrawPacket( DrawPacket& packet, bool globalWireframe_enabled, const glm::vec3& cameraPosition);
+    // translate, scale, rotate z,y,x
+    glm::mat4 ComputeModelMatrix();
     // Draw collision bounding box for visualisation
     void DrawCollisionBox();
     // Set the wireframe mode and/or color
@@ -114,6 +119,7 @@ public:
     void SetShader( Shader *mShader);
     // Set the model
     void SetModel( Model *mModel);
+    Model* GetModel() { return model; }
     // Set the name of the object
     void SetName( std::string Name);
     // Get the name of the object
@@ -127,6 +133,12 @@ public:
         return colliderBoxWireframeThickness;
     }
 
+    // Is this object big and solid enough to hide other objects behind it
+    void SetOccluder( bool Occluder) { occluder = Occluder; }
+    bool GetOccluder() { return occluder; }
+    // World space bounding box (the collider box)
+    void GetBounds( glm::vec3& BoundsMin, glm::vec3& BoundsMax);
+
     void SetStatus( bool PlayerStatus) { playerStatus = PlayerStatus; }
     bool GetStatus( ) { return playerStatus; }
 
@@ -142,6 +154,7 @@ private:
     Camera *camera;
 
     bool renderAble{true};
+    bool occluder{false};
     bool playerStatus{ ALIVE};
 
     glm::vec3 boundsMin{-1000.0f, -1000.0f, -1000.0f};                   // the boundaries it is allowed to move in
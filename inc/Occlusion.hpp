@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <vector>
+#include <atomic>
+
+#include <glm/glm.hpp>
+
+// Low resolution software depth buffer for occlusion culling.
+// No OpenGL in here, everything is done on the CPU so it runs without any GPU at all.
+//
+// Usage each frame:
+//   Clear(), AddOccluder() for the nearest big objects, Rasterize(), then IsVisible() for the candidates.
+class OcclusionBuffer
+{
+public:
+    // Width is rounded up to a multiple of 4 (SIMD lanes)
+    OcclusionBuffer( int Width = 256, int Height = 128);
+
+    void Resize( int Width, int Height);
+    // Reset the depth buffer to the far plane, drop the occluders and the statistics
+    void Clear();
+
+    // Queue the triangles of a simplified occluder mesh, the mesh must lie inside the real object.
+    void AddOccluder( const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices, const glm::mat4& modelViewProjection);
+    // Rasterize the queued occluders, the buffer is split in bands of rows that are done on the worker threads
+    void Rasterize();
+
+    // Test a world space bounding box against the buffer, returns false if it is hidden behind the occluders.
+    // Only reads the buffer, so it can be called from the worker threads once Rasterize() is done.
+    bool IsVisible( const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& viewProjection);
+
+    int GetWidth() { return width; }
+    int GetHeight() { return height; }
+    const std::vector<float>& GetDepth() { return depth; }
+    // Number of boxes tested / found hidden since the last Clear()
+    int GetTestedCount() { return tested; }
+    int GetCulledCount() { return culled; }
+
+    // Build a sphere occluder with all the vertices on the given radius, so the triangles are inside the sphere
+    static void BuildSphereOccluder( float radius, int rings, int segments, std::vector<glm::vec3>& vertices, std::vector<unsigned int>& indices);
+
+private:
+    // Screen space triangle, x,y in pixels, z in 0..1 depth
+    struct ScreenTriangle {
+        glm::vec3 v0, v1, v2;
+    };
+
+    void RasterizeBand( const ScreenTriangle& tri, int rowMin, int rowMax);
+
+    int width;
+    int height;
+    std::vector<float> depth;
+    std::vector<ScreenTriangle> triangles;
+
+    std::atomic<int> tested{0};
+    std::atomic<int> culled{0};
+};
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <vector>
+#include <random>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Shader.hpp"
+
+// How one kind of particle looks and moves
+struct ParticleType
+{
+    glm::vec3 startColor{1.0f};
+    glm::vec3 endColor{0.0f};
+    float size{0.1f};           // world units
+    float lifetime{1.0f};       // seconds, the longest one lives
+    float drag{1.0f};           // part of the velocity kept per second
+    bool additive{false};       // glows, else blended over
+};
+
+// Debris and fire for the planets that get destroyed. The particles of a type are kept as
+// structure of arrays (x, y, z, velocities, life), integrated four at a time with SSE2 on the
+// worker threads, and the dead ones are swapped out with the last live ones so the arrays stay
+// packed. The position and life arrays go to the GPU as they are, one point sprite draw per type.
+//
+// Emitters come from a fixed pool, a burst spreads its particles over a few frames.
+class ParticleSystem
+{
+public:
+    // All the types together
+    static const size_t MAX_PARTICLES = 1 << 20;
+    static const int MAX_EMITTERS = 256;
+
+    bool Init();
+    void CleanUp();
+
+    // The type index, -1 when the particle budget is used up
+    int AddType( const ParticleType& type, size_t capacity);
+
+    // count particles over duration seconds, from a sphere's surface outwards at up to speed,
+    // on top of velocity. False when all the emitters are busy.
+    bool Emit( int type, const glm::vec3& position, float radius, const glm::vec3& velocity, float speed, size_t count, float duration);
+    // A planet going up
+    void Explode( const glm::vec3& position, float radius);
+
+    void Update( float dt);
+    void Draw( Shader& shader, const glm::mat4& view, const glm::mat4& projection, float viewportHeight);
+
+    size_t GetLiveCount();
+
+private:
+    struct Pool {
+        ParticleType type;
+        size_t capacity{0};
+        size_t count{0};
+        std::vector<float> x, y, z;
+        std::vector<float> vx, vy, vz;
+        std::vector<float> life;        // seconds left
+        GLuint vao{0};
+        GLuint vbo{0};                  // x, y, z and life, capacity floats each
+    };
+
+    struct Emitter {
+        bool active{false};
+        int type{0};
+        glm::vec3 position{0.0f};
+        float radius{0.0f};
+        glm::vec3 velocity{0.0f};
+        float speed{0.0f};
+        size_t remaining{0};
+        float rate{0.0f};               // per second
+        float carry{0.0f};              // the fraction of a particle left from the last frame
+    };
+
+    void Spawn( Pool& pool, const Emitter& emitter, size_t count);
+    static void Integrate( Pool& pool, size_t first, size_t last, float dt, float drag);
+    static void Compact( Pool& pool);
+
+    std::vector<Pool> pools;
+    size_t budget{MAX_PARTICLES};
+    Emitter emitters[MAX_EMITTERS];
+    std::vector<int> freeEmitters;
+    std::minstd_rand random;
+
+    int debris{-1};
+    int fire{-1};
+};
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Shader.hpp"
+
+// Planet surfaces as six cube face quadtrees of terrain patches (CDLOD style), every patch drawn
+// with the same grid mesh. The vertex shader puts the grid on its cube face, pushes it out onto
+// the sphere and displaces it with the patch heights. Those are fBm noise, generated on the worker
+// threads and kept in one float texture (the atlas) with room for ATLAS_TILES patches, the least
+// recently used ones are dropped when it is full. The roots are made right away and never dropped.
+//
+// A patch splits in its four children when its grid spacing would cover more than maxPixelError
+// pixels on the screen, as long as the children's heights are in, so nothing ever waits for them.
+// Near the end of its distance range a patch morphs its odd vertices onto the coarser grid of its
+// parent, the two meet without popping or cracks. Skirts hide the rest (the cube face seams).
+//
+// Begin() a frame, Add() the planets, Draw() them. Everything is in the planet's model space,
+// a unit sphere with the mountains on top.
+class PlanetTerrain
+{
+public:
+    bool Init();
+    void CleanUp();
+
+    // The root patches of a planet, made on the spot while loading. Add() has the workers make
+    // them otherwise and leaves the planet out until they are in. False if the atlas has no
+    // room for them, the seed is then left alone until Remove() frees a slot.
+    bool Prepare( unsigned int seed);
+    // A planet that is gone, its roots are unpinned and their slots free again
+    void Remove( unsigned int seed);
+    // Generate the heights on the calling thread (all workers helping), for repeatable runs
+    void SetSynchronous( bool Synchronous) { synchronous = Synchronous; }
+    // The raw height Add() draws at a direction for that seed, below 0 is sea
+    static float GetHeight( const glm::vec3& direction, unsigned int seed);
+
+    // Upload the heights the workers are done with, once per frame before the drawing
+    void Update();
+
+    // maxLevel caps the detail, the impostor bake only wants the roots
+    void Begin( const glm::mat4& View, const glm::mat4& Projection, float ViewportHeight, int maxLevel = MAX_LEVEL);
+    // Pick the patches of one planet, model is its model matrix (uniform scale). Below 1 fade
+    // dithers the planet out, the rest is left to its impostor.
+    void Add( const glm::mat4& model, unsigned int seed, float fade = 1.0f);
+    void Draw( Shader& shader, bool wireframe);
+
+    size_t GetPatchCount() { return patches.size(); }
+    size_t GetResidentCount() { return tiles.size(); }
+
+    float maxPixelError{2.0f};
+    float amplitude{0.05f};         // the highest mountain, in planet radii
+    glm::vec3 sunDirection{ 0.57f, 0.57f, 0.57f};
+
+private:
+    static const int GRID_SIZE = 33;                    // vertices per patch side, 2^n + 1 for the morph
+    static const int TILE_SIZE = GRID_SIZE + 2;         // one more height all around for the normals
+    static const int ATLAS_COLUMNS = 32;
+    static const int ATLAS_TILES = ATLAS_COLUMNS * ATLAS_COLUMNS;
+    static const int MAX_LEVEL = 12;
+    static const int MAX_IN_FLIGHT = 64;                // generation jobs queued at a time
+    static const int UPLOADS_PER_FRAME = 32;
+
+    struct Tile {
+        int slot{-1};               // in the atlas, -1 while the workers are on it
+        unsigned int lastUsed{0};   // frame
+        bool pinned{false};         // a root
+    };
+
+    struct Heights {
+        uint64_t key;
+        std::vector<float> texels;  // TILE_SIZE^2 of displacement, raw noise
+    };
+
+    // What the workers hand back, shared so the jobs survive CleanUp()
+    struct Generated {
+        std::mutex mutex;
+        std::vector<Heights> ready;
+        bool stopping{false};
+    };
+
+    struct Patch {
+        glm::vec3 origin;           // cube face point of the grid's corner
+        glm::vec3 stepU;            // per grid step
+        glm::vec3 stepV;
+        glm::ivec2 tileOrigin;      // texel of the corner height in the atlas
+        glm::vec2 morphRange;       // distance the morph starts at, 1 / the distance it takes
+        float skirtDepth;
+        int planet;
+    };
+
+    struct Planet {
+        glm::mat4 model;
+        glm::vec3 cameraLocal;
+        glm::vec4 planes[6];        // frustum in model space, normalized
+        unsigned int seed;
+        float fade;
+    };
+
+    static uint64_t MakeKey( unsigned int seed, int face, int level, int x, int y);
+    static void Generate( uint64_t key, std::vector<float>& texels);
+
+    void Select( Planet& planet, int face, int level, int x, int y);
+    bool Resident( uint64_t key);
+    // Roots are pinned and go past the in flight limit
+    void Request( uint64_t key, bool root = false);
+    void Dispatch();
+    void Upload( const Heights& heights);
+    void Store( int slot, const std::vector<float>& texels);
+    int FreeSlot();
+
+    GLuint vao{0};
+    GLuint vbo{0};
+    GLuint ebo{0};
+    GLsizei indexCount{0};
+    GLuint atlas{0};
+
+    std::unordered_map<uint64_t, Tile> tiles;
+    std::vector<int> freeSlots;
+    std::unordered_set<unsigned int> starved;   // seeds whose roots found no slot
+    std::vector<uint64_t> requests;     // this frame
+    std::shared_ptr<Generated> generated;
+    int inFlight{0};
+    bool synchronous{false};
+
+    glm::mat4 view{1.0f};
+    glm::mat4 projection{1.0f};
+    float splitDistance[MAX_LEVEL + 1];
+    int levelLimit{MAX_LEVEL};
+    unsigned int frame{0};
+    std::vector<Planet> planets;
+    std::vector<Patch> patches;
+
+    // uniform locations, looked up again when the program changes
+    GLuint locationsProgram{0};
+    GLint uModel, uView, uProjection, uCameraLocal, uPatchOrigin, uPatchStepU, uPatchStepV;
+    GLint uTileOrigin, uMorphRange, uSkirtDepth, uAmplitude, uSunDirection, uHeights, uWireframe, uWireframeColor, uFade;
+};
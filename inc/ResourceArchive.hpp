@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "FileUtils.hpp"
+
+// What an entry holds, so a reader can tell a mesh from a texture without looking inside
+enum ArchiveEntryType
+{
+    ARCHIVE_RAW = 0,        // the file as it is (shaders, with the comments stripped)
+    ARCHIVE_MESH = 1,       // a CookedModel, see MeshCache::Encode()
+    ARCHIVE_KTX = 2         // a BC1/BC3 texture with its mips, see TextureCache::EncodeKTX()
+};
+
+// One row of the directory, the rows are sorted by hash
+struct ArchiveEntry
+{
+    uint64_t hash;          // HashBytes() of the name
+    uint64_t offset;        // of the stored bytes from the start of the archive
+    uint64_t size;          // once unpacked
+    uint64_t storedSize;    // in the archive, the same as size when not compressed
+    uint32_t nameOffset;    // into the name table
+    uint32_t nameLength;
+    uint32_t type;          // ArchiveEntryType
+    uint32_t flags;         // ARCHIVE_LZ4
+    uint64_t sourceSize;    // of the file in res/ it was cooked from
+    uint64_t sourceTime;    // and its modification time
+};
+
+const uint32_t ARCHIVE_LZ4 = 1;
+
+// The cooked res/ directory in one file, made by tools/cook (make cook).
+//
+// A header, the entries one after the other (16 byte aligned), then the directory sorted by the
+// hash of the names and the name table. Open() maps the file and that's it, Find() is a binary
+// search over the mapped directory. An entry that wasn't worth compressing is read right out of
+// the mapping, the others are LZ4 blocks unpacked on the way out.
+//
+// The names are the paths the game asks for, like res/models/box/box.obj, through CanonicalPath().
+// Every entry remembers the size and time of its source. When the loose file is there and has
+// changed since, Find() leaves the entry alone and the game reads the file, so editing res/ works
+// without cooking again. Without the loose files (a release) the archive is used as it is.
+// Only the named file is looked at, a changed .mtl of an unchanged .obj still needs make cook.
+// Read only once open, the worker threads may all read from it at once.
+class ResourceArchive
+{
+public:
+    // False if there is no archive or it isn't one of ours, the game then reads the loose files
+    bool Open( const std::string& path);
+    void Close();
+    bool IsOpen() const { return entries != nullptr; }
+
+    // nullptr if the archive doesn't have it, or the loose file changed since it was cooked
+    const ArchiveEntry* Find( const std::string& path) const;
+    // The bytes in the mapping, only for entries that are not compressed, else nullptr
+    const unsigned char* GetData( const ArchiveEntry& entry) const;
+    // The unpacked bytes, false if the entry is broken
+    bool Read( const ArchiveEntry& entry, std::vector<unsigned char>& data) const;
+    bool Read( const std::string& path, std::vector<unsigned char>& data) const;
+    // Zero copy when it can: the mapping, else unpacked into buffer. nullptr if the entry is broken.
+    const unsigned char* Get( const ArchiveEntry& entry, std::vector<unsigned char>& buffer) const;
+
+    size_t GetEntryCount() const { return entryCount; }
+
+private:
+    MappedFile file;
+    const ArchiveEntry* entries{nullptr};
+    size_t entryCount{0};
+    const char* names{nullptr};
+};
+
+// Puts an archive together, only the cook tool uses it
+class ArchiveWriter
+{
+public:
+    // Compressed with LZ4 when that makes it smaller
+    void Add( const std::string& path, const std::vector<unsigned char>& data, ArchiveEntryType type);
+    bool Write( const std::string& path);
+
+    size_t GetSize() const { return size; }
+    size_t GetStoredSize() const { return storedSize; }
+
+private:
+    struct Item {
+        std::string name;
+        ArchiveEntry entry;
+        std::vector<unsigned char> stored;
+    };
+    std::vector<Item> items;
+    size_t size{0};
+    size_t storedSize{0};
+};
@@ -21,23 +21,29 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <cstdint>
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include "MeshArena.hpp"
+
 class Shader
 {
 public:
     GLuint Program;
+    // The vertex layout the vertex shader reads, models drawn with this shader are uploaded in it
+    VertexFormat vertexFormat;
 
-    // Constructor generates the shader on the fly
-    Shader( const GLchar *vertexPath, const GLchar *fragmentPath );
+    // Constructor generates the shader on the fly. The program comes from the binary cache when it
+    // can, else compiling and linking is only started here and finished by FinishLink().
+    Shader( const GLchar *vertexPath, const GLchar *fragmentPath, VertexFormat format = VERTEX_FORMAT_FULL );
     ~Shader();
-    // Uses the current shader
-    void Use( )
-    {
-        glUseProgram( Program );
-    }
+    // Wait for the link, report the errors and store the binary. Creating all the shaders first
+    // and finishing them later lets the driver compile them side by side.
+    void FinishLink( );
+    // Uses the current shader (skipped if it already is)
+    void Use( );
 
 
     // utility uniform functions
@@ -101,6 +107,12 @@ public:
 
 private:
     void checkCompileErrors(GLuint shader, std::string type);
+
+    // still compiling, see FinishLink()
+    bool pending{false};
+    GLuint vertexShader{0};
+    GLuint fragmentShader{0};
+    uint64_t cacheKey{0};
 };
 
 #endif
\ No newline at end of file
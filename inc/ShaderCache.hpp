@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+// Linked program binaries from glGetProgramBinary, stored in cache/shaders under a hash of the
+// driver (vendor, renderer, version) and both sources. A driver update or an edited shader gives
+// another key, and a binary the driver refuses anyway just means compiling like before.
+class ShaderCache
+{
+public:
+    ShaderCache( const std::string& Directory = "cache/shaders");
+
+    static uint64_t Key( const std::string& vertexCode, const std::string& fragmentCode);
+
+    // Load the binary into the program, false if there is none or it didn't link
+    bool Load( GLuint program, uint64_t key);
+    // Store the binary of a linked program, it needs GL_PROGRAM_BINARY_RETRIEVABLE_HINT set before linking
+    void Save( GLuint program, uint64_t key);
+
+    // GL 4.1 or ARB_get_program_binary, and at least one binary format
+    static bool IsSupported();
+    // Let the driver compile on its own threads, KHR (or ARB) parallel_shader_compile
+    static bool EnableParallelCompile();
+
+    int GetHits() { return hits; }
+    int GetMisses() { return misses; }
+
+private:
+    std::string PathOf( uint64_t key);
+
+    std::string directory;
+    int hits{0};
+    int misses{0};
+};
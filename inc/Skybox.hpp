@@ -17,7 +17,6 @@
 #pragma once
 #include <vector>
 #include <GL/glew.h>
-#include <stb_image.h>
 
 #include "Shader.hpp"
 #include "Camera.hpp"
@@ -25,11 +24,17 @@
 class SkyBox {
 public:
     void RenderSkyBox();
-    void LoadCubemap(std::vector<const GLchar * > faces, GLuint InternalFormat = GL_RGBA);
+    // The faces are streamed in, the sky stays black until they arrive
+    void LoadCubemap(std::vector<const GLchar * > faces);
 
 private:
+    void FaceLevelDone( GLuint face, int level);
+
     GLuint cubemapTexture;
     GLuint skyboxVAO, skyboxVBO;
 
-    GLuint internalFormat{GL_RGBA};
+    GLenum internalFormat{GL_RGBA8};
+    int faceWidth{1}, faceHeight{1};
+    std::vector<int> faceLevels;    // finest level streamed in per face
+    int baseLevel{0};
 };
\ No newline at end of file
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "TextureCompressor.hpp"
+
+// A texture ready for glCompressedTexImage2D, the whole mip chain down to 1x1
+struct CookedTexture
+{
+    GLenum internalFormat{0};
+    int width{0};
+    int height{0};
+    std::vector<std::vector<unsigned char>> levels;
+
+    size_t GetBytes() const;
+};
+
+// Texture cooking: the source image is decoded once, the mip chain is built and block compressed
+// on the CPU (BC1 when opaque, BC3 with alpha) and the result is stored as a KTX file named after
+// the hash of the source file. The next launches only read the KTX, no decoding, no glGenerateMipmap.
+// Change the source and the hash changes with it, so the cache never has to be cleared by hand.
+//
+// Probe() decides the size and format from the image header alone, so the GL textures can be
+// allocated right away while Load() does the real work later on a worker thread.
+class TextureCache
+{
+public:
+    TextureCache( const std::string& Directory = "cache/textures");
+
+    // Size and format the texture will get: BC3 for 4 channels, BC1 for 3, RGBA8 for the rest
+    // or without S3TC. Only reads the header, false if it isn't an image stb_image knows.
+    static bool Probe( const std::string& path, int& width, int& height, GLenum& internalFormat);
+    // Decode into the format Probe() chose, from the cache when it can. Safe on the worker threads.
+    bool Load( const std::string& path, GLenum internalFormat, CookedTexture& texture);
+
+    // Load from the cache, or cook and store it. False if the source can't be read.
+    bool Cook( const std::string& sourcePath, BlockFormat format, CookedTexture& texture);
+    // Plain RGBA8, the mips still come from the CPU
+    static bool LoadUncompressed( const std::string& path, CookedTexture& texture);
+
+    // The driver must know S3TC, every desktop GL does but check anyway
+    static bool IsSupported();
+
+    // A KTX file in memory, BC1/BC3 only. The cache files and the resource archive share these.
+    static bool DecodeKTX( const unsigned char* data, size_t size, CookedTexture& texture);
+    static void EncodeKTX( const CookedTexture& texture, std::vector<unsigned char>& file);
+    // Just the header of one
+    static bool ProbeKTX( const unsigned char* data, size_t size, int& width, int& height, GLenum& internalFormat);
+
+private:
+    bool ReadKTX( const std::string& path, CookedTexture& texture);
+    bool WriteKTX( const std::string& path, const CookedTexture& texture);
+
+    std::string directory;
+};
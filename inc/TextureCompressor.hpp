@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+// CPU block compression for the texture cooker, no OpenGL in here.
+enum BlockFormat
+{
+    BLOCK_FORMAT_BC1,   // DXT1, 8 bytes per 4x4 block, opaque images
+    BLOCK_FORMAT_BC3    // DXT5, 16 bytes per 4x4 block, BC1 color + interpolated alpha
+};
+
+// One uncompressed image level, RGBA8, top row first
+struct ImageRGBA8
+{
+    int width{0};
+    int height{0};
+    std::vector<unsigned char> pixels;
+};
+
+// True if any pixel is not fully opaque
+bool ImageHasAlpha( const ImageRGBA8& image);
+
+// Half the size (at least 1x1) with a 2x2 box filter
+ImageRGBA8 DownsampleImage( const ImageRGBA8& image);
+
+// Compress a whole level, the edges are padded by repeating the last row/column.
+// The rows of blocks are spread over the worker threads.
+std::vector<unsigned char> CompressImage( const ImageRGBA8& image, BlockFormat format);
+
+// Size in bytes of a compressed level
+size_t CompressedImageSize( int width, int height, BlockFormat format);
+
+// Single blocks, 16 RGBA pixels in, 8 (BC1) or 16 (BC3) bytes out
+void EncodeBC1Block( const unsigned char* rgba, unsigned char* out);
+void EncodeBC3Block( const unsigned char* rgba, unsigned char* out);
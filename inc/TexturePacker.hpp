@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+#include "TextureCache.hpp"
+
+// Index into MaterialTable's interned texture paths
+typedef uint32_t TextureId;
+const TextureId NO_TEXTURE = 0xffffffff;
+
+// Where a texture ended up: a layer of one of the texture arrays
+struct TextureSlot
+{
+    int group{-1};      // -1 = not loaded
+    GLuint layer{0};
+};
+
+// All the model textures of the same format and size go into one GL_TEXTURE_2D_ARRAY.
+// The meshes carry their layer in the vertices, so switching between meshes with different
+// textures of the same group needs no texture bind at all (and could be one draw call).
+//
+// Add() every texture while loading the models, only the image header is read so the layer is
+// known right away and can go into the vertex data. Build() allocates the arrays with a grey
+// placeholder and hands the layers to the texture streamer, each array gets sharper as the
+// mip levels of all its layers come in.
+class TexturePacker
+{
+public:
+    // Queue an interned texture, cooked to BC1/BC3 if possible else RGBA8. MaterialTable
+    // calls it once per id and keeps the slot, the path is looked up there too.
+    TextureSlot Add( TextureId id);
+    // Allocate the texture arrays and start streaming the queued layers
+    void Build();
+
+    // The array texture of a group, 0 before Build()
+    GLuint GetTexture( int group) { return group >= 0 && group < (int)groups.size() ? groups[group].texture : 0; }
+    size_t GetGroupCount() { return groups.size(); }
+
+    void CleanUp();
+
+private:
+    struct Group {
+        GLenum internalFormat;
+        int width;
+        int height;
+        GLuint texture{0};
+        GLuint layerCount{0};
+        std::vector<TextureId> textures;    // of the layers
+        std::vector<int> layerLevels;       // the finest level streamed in so far, per layer
+        int baseLevel{0};                   // GL_TEXTURE_BASE_LEVEL, the coarsest of layerLevels
+    };
+
+    // Streaming callback, lowers the base level once every layer has the level
+    void LevelDone( int group, GLuint layer, int level);
+
+    // The GL minimum for GL_MAX_ARRAY_TEXTURE_LAYERS, a full group starts a new one
+    static const GLuint MAX_LAYERS = 256;
+
+    std::vector<Group> groups;
+};
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <chrono>
+
+#include <GL/glew.h>
+
+#include "TextureCache.hpp"
+
+// One image to stream into a texture that is already allocated (see AllocateLevels)
+struct StreamRequest
+{
+    std::string name;                       // for the messages
+    GLuint texture{0};
+    GLenum target{GL_TEXTURE_2D_ARRAY};     // GL_TEXTURE_2D_ARRAY, GL_TEXTURE_2D or a cube map face
+    GLint layer{0};                         // the array layer, GL_TEXTURE_2D_ARRAY only
+    GLenum internalFormat{GL_RGBA8};        // the texture's format, the decoded image must match
+    int width{0};
+    int height{0};
+    std::function<bool( CookedTexture&)> decode;   // runs on a worker thread
+    std::function<void( int level)> levelDone;     // GL thread, the smallest level comes first
+};
+
+// Texture loading that never stalls a frame. The images are decoded (or read from the texture
+// cache) on the worker threads, then Update() copies at most one ring segment per frame into a
+// pixel buffer and lets the driver pull it from there with glTex(Sub)Image, smallest mip first.
+// A segment is only written again when the fence of its last use has passed, otherwise the
+// uploads wait for the next frame.
+// With GL_ARB_buffer_storage the pixel buffer is mapped once, persistently, else it is
+// mapped unsynchronized each frame (the fences keep that safe as well).
+class TextureStreamer
+{
+public:
+    // Needs the GL context, segmentBytes is the upload budget of one frame
+    bool Init( size_t segmentBytes = 4 * 1024 * 1024);
+    // Start decoding, the texture keeps its placeholder until the levels arrive. An image that fails
+    // to decode or doesn't match the allocation streams in as magenta, so its levels still arrive.
+    void Request( const StreamRequest& request);
+    // Once per frame on the GL thread
+    void Update();
+    // Update until everything requested so far is in, for the headless benchmark and loading screens
+    void Finish();
+    // Requests not completely uploaded yet
+    size_t GetPending() { return pending; }
+
+    void CleanUp();
+
+    // Allocate the whole mip chain of a texture (every layer of an array, or one cube map face) with
+    // the smallest level filled with the placeholder color. Returns the number of levels, set
+    // GL_TEXTURE_BASE_LEVEL to the last one until the real levels have arrived.
+    static int AllocateLevels( GLenum target, GLenum internalFormat, int width, int height, GLsizei layers, const unsigned char placeholder[4]);
+    static int LevelCount( int width, int height);
+
+private:
+    static const int SEGMENT_COUNT = 3;
+
+    // Shared with the decode jobs, they may finish after CleanUp()
+    struct Decoded {
+        std::mutex mutex;
+        std::vector<std::pair<StreamRequest, std::shared_ptr<CookedTexture>>> ready;
+        bool stopping{false};
+    };
+
+    // A decoded image on its way to the GPU
+    struct Upload {
+        StreamRequest request;
+        std::shared_ptr<CookedTexture> texture;
+        int level;      // counts down to 0
+        int row;        // rows of pixels, or of blocks when compressed
+    };
+
+    struct Segment {
+        GLsync fence{0};
+    };
+
+    GLuint pbo{0};
+    unsigned char* mapped{nullptr};     // persistent mapping, null if it is mapped per frame
+    size_t segmentBytes{0};
+    Segment segments[SEGMENT_COUNT];
+    int currentSegment{0};
+
+    std::shared_ptr<Decoded> decoded;
+    std::deque<Upload> uploads;
+    size_t pending{0};
+    size_t requested{0};
+    size_t uploadedBytes{0};
+    std::chrono::system_clock::time_point firstRequest;
+};
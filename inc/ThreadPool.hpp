@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Simple worker pool, the jobs must never touch OpenGL, that stays on the main thread.
+class ThreadPool
+{
+public:
+    // 0 threads = one less than the number of cores (the main thread is working too)
+    ThreadPool( unsigned int numThreads = 0);
+    ~ThreadPool();
+
+    // Queue a job for the workers
+    void Enqueue( std::function<void()> job);
+    // Block until all the queued jobs are done
+    void Wait();
+    // Run job(0..count-1) spread over the workers and the calling thread, returns when all are done
+    void ParallelFor( unsigned int count, const std::function<void(unsigned int)>& job);
+
+    unsigned int GetThreadCount() { return static_cast<unsigned int>( workers.size()); }
+
+private:
+    void WorkerLoop();
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex jobsMutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable jobsDone;
+    unsigned int jobsRunning{0};
+    bool stopping{false};
+};
@@ -0,0 +1,45 @@
+#version 330 core
+
+in vec2 TexCoords;
+in vec3 Normal;
+in vec3 LocalPos;
+flat in float TextureLayer;
+in float Height;
+out vec4 FragColor;
+
+uniform sampler2DArray texture_diffuse;
+uniform vec3 sunDirection;
+uniform float heat;         // 1 just broken, cools down to 0
+uniform bool terrain_colors;    // the outside like terrain.frag instead of the texture
+
+
+// The colour of a raw height, the same as terrain.frag
+vec3 terrainColour( float height )
+{
+    if ( height < 0.0 )
+        return mix( vec3( 0.02, 0.08, 0.3 ), vec3( 0.1, 0.35, 0.6 ), clamp( 1.0 + height * 5.0, 0.0, 1.0 ) );
+    if ( height < 0.02 )
+        return vec3( 0.76, 0.7, 0.5 );
+    if ( height < 0.35 )
+        return mix( vec3( 0.2, 0.45, 0.15 ), vec3( 0.45, 0.35, 0.25 ), ( height - 0.02 ) / 0.33 );
+    return vec3( 0.95 );
+}
+
+void main()
+{
+    float light = 0.15 + 0.85 * max( dot( normalize( Normal ), sunDirection ), 0.0 );
+    if ( TextureLayer >= 0.0 && terrain_colors ) {
+        FragColor = vec4( terrainColour( Height ) * light, 1.0 );
+        return;
+    }
+    if ( TextureLayer >= 0.0 ) {
+        FragColor = vec4( texture( texture_diffuse, vec3( TexCoords, TextureLayer ) ).rgb * light, 1.0 );
+        return;
+    }
+
+    // rock with some grain, glowing while it is hot
+    float grain = fract( sin( dot( floor( LocalPos * 40.0 ), vec3( 12.9898, 78.233, 37.719 ) ) ) * 43758.5453 );
+    vec3 rock = vec3( 0.32, 0.27, 0.24 ) * ( 0.8 + 0.4 * grain ) * light;
+    vec3 molten = mix( vec3( 1.0, 0.25, 0.02 ), vec3( 1.0, 0.85, 0.4 ), grain * heat );
+    FragColor = vec4( mix( rock, molten, heat * heat ), 1.0 );
+}
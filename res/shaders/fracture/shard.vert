@@ -0,0 +1,28 @@
+#version 330 core
+
+layout ( location = 0 ) in vec3 aPos;
+layout ( location = 1 ) in vec3 aNormal;
+layout ( location = 2 ) in vec2 aTexCoords;
+layout ( location = 3 ) in float aLayer;    // < 0 is the inside
+layout ( location = 4 ) in float aHeight;   // the terrain height, only with terrain_colors
+
+out vec2 TexCoords;
+out vec3 Normal;
+out vec3 LocalPos;
+flat out float TextureLayer;
+out float Height;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+
+void main( )
+{
+    TexCoords = aTexCoords;
+    TextureLayer = aLayer;
+    Height = aHeight;
+    LocalPos = aPos;
+    Normal = mat3( model ) * aNormal;
+    gl_Position = projection * view * model * vec4( aPos, 1.0f );
+}
@@ -0,0 +1,13 @@
+#version 330 core
+
+in vec3 BlipColor;
+out vec4 FragColor;
+
+void main()
+{
+    // round blip with a soft edge
+    float r = length( gl_PointCoord - vec2( 0.5 ) ) * 2.0;
+    if ( r > 1.0 )
+        discard;
+    FragColor = vec4( BlipColor, 1.0 - smoothstep( 0.8, 1.0, r ) );
+}
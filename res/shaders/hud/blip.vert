@@ -0,0 +1,16 @@
+#version 330 core
+
+layout ( location = 0 ) in vec3 aPos;
+layout ( location = 1 ) in vec3 aColor;
+
+out vec3 BlipColor;
+
+uniform mat4 projection;
+uniform float pointSize;
+
+void main( )
+{
+    BlipColor = aColor;
+    gl_PointSize = pointSize;
+    gl_Position = projection * vec4( aPos, 1.0f );
+}
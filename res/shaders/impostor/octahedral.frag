@@ -0,0 +1,99 @@
+#version 330 core
+
+in vec3 WorldPos;
+flat in vec4 CenterRadius;
+flat in vec4 Rotation;
+flat in vec3 LayerFadeExtent;
+out vec4 FragColor;
+
+uniform mat4 viewProjection;
+uniform vec3 cameraPosition;
+uniform vec3 sunDirection;
+uniform int frames;
+uniform sampler2DArray impostorColor;
+uniform sampler2DArray impostorNormal;   // model space
+
+// 4x4 Bayer, the same as terrain.frag so the impostor and the mesh add up to one while fading
+float dither( )
+{
+    const float bayer[16] = float[16]( 0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0 );
+    ivec2 p = ivec2( gl_FragCoord.xy ) & ivec2( 3 );
+    return ( bayer[p.y * 4 + p.x] + 0.5 ) / 16.0;
+}
+
+vec3 rotateInverse( vec4 q, vec3 v )
+{
+    vec3 u = -q.xyz;
+    return v + 2.0 * cross( u, cross( u, v ) + q.w * v );
+}
+
+vec2 octEncode( vec3 v )
+{
+    v /= abs( v.x ) + abs( v.y ) + abs( v.z );
+    if ( v.z < 0.0 )
+        return ( 1.0 - abs( v.yx ) ) * vec2( v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0 );
+    return v.xy;
+}
+
+vec3 octDecode( vec2 e )
+{
+    vec3 v = vec3( e.xy, 1.0 - abs( e.x ) - abs( e.y ) );
+    if ( v.z < 0.0 )
+        v.xy = ( 1.0 - abs( v.yx ) ) * vec2( v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0 );
+    return normalize( v );
+}
+
+void main()
+{
+    // the real mesh draws these
+    if ( dither( ) < LayerFadeExtent.y )
+        discard;
+
+    // where the view ray hits the sphere, that is the depth too
+    vec3 ray = normalize( WorldPos - cameraPosition );
+    vec3 fromCenter = cameraPosition - CenterRadius.xyz;
+    float b = dot( fromCenter, ray );
+    float h = b * b - dot( fromCenter, fromCenter ) + CenterRadius.w * CenterRadius.w;
+    if ( h < 0.0 )
+        discard;
+    vec3 hit = cameraPosition + ray * ( -b - sqrt( h ) );
+    vec4 clip = viewProjection * vec4( hit, 1.0 );
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+
+    // The four frames around the view direction, each looked up at the same point of the sphere
+    vec3 p = rotateInverse( Rotation, ( hit - CenterRadius.xyz ) / CenterRadius.w );
+    vec3 eye = rotateInverse( Rotation, normalize( fromCenter ) );
+    vec2 grid = ( octEncode( eye ) * 0.5 + 0.5 ) * float( frames - 1 );
+    ivec2 base = ivec2( min( floor( grid ), vec2( frames - 2 ) ) );
+    vec2 f = grid - vec2( base );
+
+    vec3 color = vec3( 0.0 );
+    vec3 normal = vec3( 0.0 );
+    float total = 0.0;
+    for ( int i = 0; i < 4; ++i ) {
+        ivec2 frame = base + ivec2( i & 1, i >> 1 );
+        vec3 direction = octDecode( vec2( frame ) / float( frames - 1 ) * 2.0 - 1.0 );
+        // the point is on the back side in that view
+        if ( dot( p, direction ) < 0.0 )
+            continue;
+        vec3 up = abs( direction.y ) > 0.99 ? vec3( 0.0, 0.0, 1.0 ) : vec3( 0.0, 1.0, 0.0 );
+        vec3 right = normalize( cross( up, direction ) );
+        up = cross( direction, right );
+
+        vec2 uv = vec2( dot( p, right ), dot( p, up ) ) / LayerFadeExtent.z * 0.5 + 0.5;
+        vec3 coord = vec3( ( vec2( frame ) + uv ) / float( frames ), LayerFadeExtent.x );
+        vec4 texel = texture( impostorColor, coord );
+        float weight = ( ( i & 1 ) == 1 ? f.x : 1.0 - f.x ) * ( ( i >> 1 ) == 1 ? f.y : 1.0 - f.y ) * texel.a;
+        color += texel.rgb * weight;
+        normal += ( texture( impostorNormal, coord ).xyz * 2.0 - 1.0 ) * weight;
+        total += weight;
+    }
+    if ( total < 0.0001 ) {
+        color = vec3( 0.5 );
+        normal = p;
+        total = 1.0;
+    }
+
+    float light = 0.15 + 0.85 * max( dot( normalize( normal ), rotateInverse( Rotation, sunDirection ) ), 0.0 );
+    FragColor = vec4( color / total * light, 1.0 );
+}
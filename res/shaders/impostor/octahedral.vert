@@ -0,0 +1,35 @@
+#version 330 core
+
+// A quad per instance, see Impostor.hpp
+layout ( location = 0 ) in vec2 aCorner;            // -1..1
+layout ( location = 1 ) in vec4 aCenterRadius;      // world
+layout ( location = 2 ) in vec4 aRotation;          // quaternion, model to world
+layout ( location = 3 ) in vec3 aLayerFadeExtent;   // atlas layer, the mesh's part of the fade, baked extent in radii
+
+out vec3 WorldPos;
+flat out vec4 CenterRadius;
+flat out vec4 Rotation;
+flat out vec3 LayerFadeExtent;
+
+uniform mat4 viewProjection;
+uniform vec3 cameraPosition;
+
+void main( )
+{
+    vec3 toCamera = cameraPosition - aCenterRadius.xyz;
+    float distance = length( toCamera );
+    vec3 forward = toCamera / distance;
+    vec3 up = abs( forward.y ) > 0.99 ? vec3( 0.0, 0.0, 1.0 ) : vec3( 0.0, 1.0, 0.0 );
+    vec3 right = normalize( cross( up, forward ) );
+    up = cross( forward, right );
+
+    // the silhouette of a sphere is a bit bigger than the sphere, the closer the more
+    float radius = aCenterRadius.w;
+    float size = radius * distance / sqrt( max( distance * distance - radius * radius, 0.0001 * radius * radius ) );
+
+    WorldPos = aCenterRadius.xyz + ( aCorner.x * right + aCorner.y * up ) * size;
+    CenterRadius = aCenterRadius;
+    Rotation = aRotation;
+    LayerFadeExtent = aLayerFadeExtent;
+    gl_Position = viewProjection * vec4( WorldPos, 1.0f );
+}
@@ -1,12 +1,10 @@
 #version 330 core
 
 in vec2 TexCoords;
+flat in float TextureLayer;
 out vec4 FragColor;
-uniform sampler2D texture_diffuse1;
-uniform sampler2D texture_diffuse2;
-uniform sampler2D texture_diffuse3;
-uniform sampler2D texture_specular1;
-uniform sampler2D texture_specular2;
+// the texture array of the mesh, the layer comes with the vertices
+uniform sampler2DArray texture_diffuse;
 
 uniform bool wireframe_enable;
 uniform vec3 wireframeColor;
@@ -16,7 +14,7 @@ void main()
     if ( wireframe_enable)
         FragColor = vec4(wireframeColor,1.f);
     else {
-	    FragColor = texture( texture_diffuse1, TexCoords);
+	    FragColor = texture( texture_diffuse, vec3( TexCoords, TextureLayer));
     }
 }
 
@@ -3,8 +3,10 @@
 layout ( location = 0 ) in vec3 aPos;
 layout ( location = 1 ) in vec3 aNormal;
 layout ( location = 2 ) in vec2 aTexCoords;
+layout ( location = 5 ) in uint aMaterial;  // texture array layer
 
 out vec2 TexCoords;
+flat out float TextureLayer;
 
 uniform mat4 model;
 uniform mat4 view;
@@ -14,6 +16,7 @@ uniform mat4 projection;
 void main( )
 {
     TexCoords = aTexCoords;
+    TextureLayer = float( aMaterial );
     gl_Position = projection * view * model * vec4( aPos, 1.0f );
 }
 
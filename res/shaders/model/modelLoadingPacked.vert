@@ -0,0 +1,38 @@
+#version 330 core
+
+// PackedVertex, see Mesh.hpp
+layout ( location = 0 ) in vec4 aPos;       // quantized to the mesh bounds, tangent handedness is w >= 0.5
+layout ( location = 1 ) in vec2 aNormal;    // octahedral
+layout ( location = 2 ) in vec2 aTexCoords;
+layout ( location = 3 ) in vec2 aTangent;   // octahedral
+layout ( location = 5 ) in uint aMaterial;  // the raw bits of aPos.w, the low 15 are the texture array layer
+
+out vec2 TexCoords;
+flat out float TextureLayer;
+out vec3 Normal;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// per mesh dequantization transform
+uniform vec3 dequantOffset;
+uniform vec3 dequantScale;
+
+vec3 octDecode( vec2 e )
+{
+    vec3 v = vec3( e.xy, 1.0 - abs( e.x ) - abs( e.y ) );
+    if ( v.z < 0.0 )
+        v.xy = ( 1.0 - abs( v.yx ) ) * vec2( v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0 );
+    return normalize( v );
+}
+
+void main( )
+{
+    vec3 position = aPos.xyz * dequantScale + dequantOffset;
+
+    TexCoords = aTexCoords;
+    TextureLayer = float( aMaterial & 0x7fffu );
+    Normal = mat3( model ) * octDecode( aNormal );
+    gl_Position = projection * view * model * vec4( position, 1.0f );
+}
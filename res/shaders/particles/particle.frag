@@ -0,0 +1,14 @@
+#version 330 core
+
+in vec4 ParticleColor;
+out vec4 FragColor;
+
+void main()
+{
+    // round with a soft edge, premultiplied
+    float r = length( gl_PointCoord - vec2( 0.5 ) ) * 2.0;
+    if ( r > 1.0 )
+        discard;
+    float alpha = ParticleColor.a * ( 1.0 - smoothstep( 0.5, 1.0, r ) );
+    FragColor = vec4( ParticleColor.rgb * alpha, alpha );
+}
@@ -0,0 +1,26 @@
+#version 330 core
+
+// Straight from the particle arrays, see Particles.hpp
+layout ( location = 0 ) in float aX;
+layout ( location = 1 ) in float aY;
+layout ( location = 2 ) in float aZ;
+layout ( location = 3 ) in float aLife;     // seconds left
+
+out vec4 ParticleColor;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform float pointScale;       // pixels per unit at distance 1
+uniform float size;
+uniform float lifetime;
+uniform vec3 startColor;
+uniform vec3 endColor;
+
+void main( )
+{
+    vec4 viewPosition = view * vec4( aX, aY, aZ, 1.0f );
+    float t = clamp( aLife / lifetime, 0.0, 1.0 );
+    ParticleColor = vec4( mix( endColor, startColor, t ), t );
+    gl_PointSize = clamp( size * pointScale / max( -viewPosition.z, 0.01 ), 1.0, 64.0 );
+    gl_Position = projection * viewPosition;
+}
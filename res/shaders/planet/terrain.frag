@@ -0,0 +1,54 @@
+#version 330 core
+
+in vec3 Normal;
+in float Height;
+layout ( location = 0 ) out vec4 FragColor;
+layout ( location = 1 ) out vec4 FragNormal;    // only when baking the impostors
+
+uniform vec3 sunDirection;
+uniform bool wireframe_enable;
+uniform vec3 wireframeColor;
+uniform float fade;             // 1 = solid, less while handing over to the impostor
+uniform bool impostor_bake;     // the unlit color and the normal, see Impostor.hpp
+
+// 4x4 Bayer, the same as octahedral.frag
+float dither( )
+{
+    const float bayer[16] = float[16]( 0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0 );
+    ivec2 p = ivec2( gl_FragCoord.xy ) & ivec2( 3 );
+    return ( bayer[p.y * 4 + p.x] + 0.5 ) / 16.0;
+}
+
+// The colour of a raw height, the same as shard.frag so a planet keeps its colours when it breaks
+vec3 terrainColour( float height )
+{
+    if ( height < 0.0 )
+        return mix( vec3( 0.02, 0.08, 0.3 ), vec3( 0.1, 0.35, 0.6 ), clamp( 1.0 + height * 5.0, 0.0, 1.0 ) );
+    if ( height < 0.02 )
+        return vec3( 0.76, 0.7, 0.5 );
+    if ( height < 0.35 )
+        return mix( vec3( 0.2, 0.45, 0.15 ), vec3( 0.45, 0.35, 0.25 ), ( height - 0.02 ) / 0.33 );
+    return vec3( 0.95 );
+}
+
+void main()
+{
+    if ( dither( ) >= fade )
+        discard;
+
+    if ( wireframe_enable) {
+        FragColor = vec4(wireframeColor,1.f);
+        return;
+    }
+
+    vec3 colour = terrainColour( Height );
+
+    if ( impostor_bake ) {
+        FragColor = vec4( colour, 1.0 );
+        FragNormal = vec4( normalize( Normal ) * 0.5 + 0.5, 1.0 );
+        return;
+    }
+
+    float light = 0.15 + 0.85 * max( dot( normalize( Normal ), sunDirection ), 0.0 );
+    FragColor = vec4( colour * light, 1.0 );
+}
@@ -0,0 +1,58 @@
+#version 330 core
+
+// The patch grid shared by all the patches, see PlanetTerrain.hpp
+layout ( location = 0 ) in vec3 aGrid;      // grid x, y and 1 on the skirt
+
+out vec3 Normal;
+out float Height;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform vec3 cameraLocal;       // the camera in the planet's model space
+uniform vec3 patchOrigin;       // cube face point of grid (0,0)
+uniform vec3 patchStepU;        // cube face step per grid step
+uniform vec3 patchStepV;
+uniform ivec2 tileOrigin;       // texel of the patch heights in the atlas, the border is at -1
+uniform vec2 morphRange;        // distance the morph starts, 1 / the distance it takes
+uniform float skirtDepth;
+uniform float amplitude;
+uniform sampler2D heights;      // r = displacement, g = raw height
+
+vec2 heightAt( ivec2 g )
+{
+    return texelFetch( heights, tileOrigin + g + ivec2( 1 ), 0 ).rg;
+}
+
+vec3 directionAt( vec2 g )
+{
+    return normalize( patchOrigin + g.x * patchStepU + g.y * patchStepV );
+}
+
+vec3 surfaceAt( ivec2 g )
+{
+    return directionAt( vec2( g ) ) * ( 1.0 + heightAt( g ).r * amplitude );
+}
+
+void main( )
+{
+    ivec2 g = ivec2( aGrid.xy );
+    vec3 direction = directionAt( aGrid.xy );
+    vec2 height = heightAt( g );
+
+    // Odd vertices slide to the middle of the coarser grid's edge they are on. The diagonals
+    // run the same way on every level, both odd is the middle of one of those.
+    float k = clamp( ( distance( cameraLocal, direction ) - morphRange.x ) * morphRange.y, 0.0, 1.0 );
+    ivec2 odd = g & ivec2( 1 );
+    if ( odd.x + odd.y > 0 )
+        height.r = mix( height.r, 0.5 * ( heightAt( g - odd ).r + heightAt( g + odd ).r ), k );
+
+    vec3 position = direction * ( 1.0 + height.r * amplitude - aGrid.z * skirtDepth );
+
+    vec3 du = surfaceAt( g + ivec2( 1, 0 ) ) - surfaceAt( g - ivec2( 1, 0 ) );
+    vec3 dv = surfaceAt( g + ivec2( 0, 1 ) ) - surfaceAt( g - ivec2( 0, 1 ) );
+    Normal = mat3( model ) * normalize( cross( du, dv ) );
+    Height = height.g;
+    gl_Position = projection * view * model * vec4( position, 1.0f );
+}
@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+
+#include "AssetManager.hpp"
+#include "FileUtils.hpp"
+#include "GLState.hpp"
+#include "ThreadPool.hpp"
+
+AssetManager assetManager;
+extern TexturePacker texturePacker;
+extern GLStateCache glState;
+extern ThreadPool threadPool;
+
+static double MillisecondsSince( std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start).count();
+}
+
+
+void AssetManager::Prefetch( const std::string& path)
+{
+    std::string canonical = CanonicalPath( path);
+    if ( imports.count( canonical) > 0)
+        return;
+
+    std::shared_ptr<Import> import = std::make_shared<Import>();
+    imports[canonical] = import;
+    threadPool.Enqueue( [import, canonical]() {
+        auto start = std::chrono::steady_clock::now();
+        CookedModel cooked;
+        Model::Import( canonical, cooked);
+        std::unique_lock<std::mutex> lock( import->mutex);
+        import->cooked = std::move( cooked);
+        import->milliseconds = MillisecondsSince( start);
+        import->done = true;
+        import->finished.notify_all();
+    });
+}
+
+
+std::shared_ptr<Model> AssetManager::GetModel( const std::string& path, VertexFormat format)
+{
+    std::string canonical = CanonicalPath( path);
+    std::string key = canonical + "|" + std::to_string( (int)format);
+    std::shared_ptr<Model> model = models[key].lock();
+    if ( model) {
+        hits++;
+        return model;
+    }
+
+    Timing timing = { canonical, 0.0, 0.0, 0.0, false };
+    CookedModel cooked;
+    auto found = imports.find( canonical);
+    if ( found != imports.end()) {
+        // prefetched, only wait for that one
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<Import> import = found->second;
+        imports.erase( found);
+        std::unique_lock<std::mutex> lock( import->mutex);
+        import->finished.wait( lock, [&]() { return import->done; });
+        cooked = std::move( import->cooked);
+        timing.importMilliseconds = import->milliseconds;
+        timing.waitMilliseconds = MillisecondsSince( start);
+        timing.prefetched = true;
+    } else {
+        auto start = std::chrono::steady_clock::now();
+        Model::Import( canonical, cooked);
+        timing.importMilliseconds = MillisecondsSince( start);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    model = std::make_shared<Model>( canonical, cooked, format);
+    timing.uploadMilliseconds = MillisecondsSince( start);
+    timings.push_back( timing);
+    models[key] = model;
+    return model;
+}
+
+
+std::shared_ptr<Mesh> AssetManager::GetMesh( const std::string& path, size_t index, VertexFormat format)
+{
+    std::shared_ptr<Model> model = GetModel( path, format);
+    if ( index >= model->meshes.size())
+        return nullptr;
+    // shares the model's count
+    return std::shared_ptr<Mesh>( model, &model->meshes[index]);
+}
+
+
+std::shared_ptr<Shader> AssetManager::GetShader( const std::string& vertexPath, const std::string& fragmentPath, VertexFormat format)
+{
+    std::string vertex = CanonicalPath( vertexPath);
+    std::string fragment = CanonicalPath( fragmentPath);
+    std::string key = vertex + "|" + fragment + "|" + std::to_string( (int)format);
+    std::shared_ptr<Shader> shader = shaders[key].lock();
+    if ( shader) {
+        hits++;
+        return shader;
+    }
+
+    // Shader copies share the program, so it is only deleted here
+    shader = std::shared_ptr<Shader>( new Shader( vertex.c_str(), fragment.c_str(), format), []( Shader* s) {
+        glDeleteProgram( s->Program);
+        glState.ForgetProgram( s->Program);
+        delete s;
+    });
+    shaders[key] = shader;
+    return shader;
+}
+
+
+TextureSlot AssetManager::GetTexture( TextureId id)
+{
+    return texturePacker.Add( id);
+}
+
+
+void AssetManager::PrintTimings()
+{
+    double imports = 0.0, waits = 0.0, uploads = 0.0;
+    std::cout << std::fixed << std::setprecision( 1);
+    for ( auto& timing: timings) {
+        std::cout << "  " << timing.path << ": import " << timing.importMilliseconds << " ms" << ( timing.prefetched ? " (worker)" : " (main)")
+                  << ", waited " << timing.waitMilliseconds << " ms, upload " << timing.uploadMilliseconds << " ms\n";
+        imports += timing.importMilliseconds;
+        waits += timing.waitMilliseconds;
+        uploads += timing.uploadMilliseconds;
+    }
+    // the imports add up to more than the main thread waited when they ran side by side
+    std::cout << "  Models: " << imports << " ms of imports on " << threadPool.GetThreadCount() << " workers, the main thread waited "
+              << waits << " ms and uploaded " << uploads << " ms\n" << std::defaultfloat;
+}
+
+
+size_t AssetManager::ReleaseGeometry()
+{
+    size_t bytes = 0;
+    for ( auto& entry: models) {
+        std::shared_ptr<Model> model = entry.second.lock();
+        if ( model)
+            bytes += model->ReleaseGeometry();
+    }
+    return bytes;
+}
+
+
+size_t AssetManager::GetModelCount()
+{
+    return Prune( models);
+}
+
+
+size_t AssetManager::GetShaderCount()
+{
+    return Prune( shaders);
+}
+
+
+template <class T> size_t AssetManager::Prune( std::map<std::string, std::weak_ptr<T>>& registry)
+{
+    for ( auto it = registry.begin(); it != registry.end(); ) {
+        if ( it->second.expired())
+            it = registry.erase( it);
+        else
+            ++it;
+    }
+    return registry.size();
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "DrawList.hpp"
+#include "GLState.hpp"
+
+extern GLStateCache glState;
+
+
+void DrawList::Begin( unsigned int bucketCount)
+{
+    // keep the buckets, their storage is reused every frame
+    if ( buckets.size() < bucketCount)
+        buckets.resize( bucketCount);
+    for ( auto& bucket: buckets)
+        bucket.clear();
+    merged.clear();
+}
+
+
+// 12 bits shader | 1 bit wireframe | 19 bits model | 32 bits depth
+uint64_t DrawList::MakeKey( const Shader* shader, const Model* model, bool wireframe, float viewDepth)
+{
+    // positive floats sort the same as their bit patterns
+    viewDepth = std::max( viewDepth, 0.0f);
+    uint32_t depthBits;
+    memcpy( &depthBits, &viewDepth, sizeof( depthBits));
+
+    uint64_t modelBits = ( reinterpret_cast<uintptr_t>( model) >> 4) & 0x7ffff;
+    return ( static_cast<uint64_t>( shader->Program & 0xfff) << 52)
+         | ( static_cast<uint64_t>( wireframe ? 1 : 0) << 51)
+         | ( modelBits << 32)
+         | depthBits;
+}
+
+
+void DrawList::Submit( const glm::mat4& view, const glm::mat4& projection)
+{
+    size_t total = 0;
+    for ( auto& bucket: buckets)
+        total += bucket.size();
+    merged.reserve( total);
+    for ( auto& bucket: buckets)
+        merged.insert( merged.end(), bucket.begin(), bucket.end());
+
+    std::sort( merged.begin(), merged.end(), []( const DrawPacket& a, const DrawPacket& b) { return a.key < b.key; });
+
+    // the program, fill mode and line width changes are filtered by the state cache, the
+    // uniforms are not, so those are only set when the shader or the fill mode changes
+    Shader* currentShader = nullptr;
+    int currentWireframe = -1;
+    for ( auto& packet: merged) {
+        bool shaderChanged = packet.shader != currentShader;
+        if ( shaderChanged) {
+            currentShader = packet.shader;
+            currentShader->Use();
+            currentShader->setMat4( "projection", projection);
+            currentShader->setMat4( "view", view);
+        }
+
+        if ( shaderChanged || currentWireframe != (int)packet.wireframe) {
+            currentWireframe = packet.wireframe;
+            glState.PolygonMode( packet.wireframe ? GL_LINE : GL_FILL);
+            currentShader->setBool( "wireframe_enable", packet.wireframe);
+        }
+
+        glState.LineWidth( packet.wireframe ? packet.lineWidth : 1.0f);
+        if ( packet.wireframe)
+            currentShader->setVec3( "wireframeColor", packet.wireframeColor);
+
+        currentShader->setMat4( "model", packet.modelMatrix);
+        packet.model->Draw( *currentShader);
+    }
+}
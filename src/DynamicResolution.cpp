@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include "DynamicResolution.hpp"
+#include "GLState.hpp"
+
+DynamicResolution dynamicResolution;
+extern GLStateCache glState;
+
+
+bool DynamicResolution::Init( int Width, int Height)
+{
+    width = Width;
+    height = Height;
+    glGenQueries( QUERY_COUNT, queries);
+    return scene.Create( width, height);
+}
+
+
+void DynamicResolution::Resize( int Width, int Height)
+{
+    width = Width;
+    height = Height;
+    scene.Resize( width, height);
+}
+
+
+void DynamicResolution::CleanUp()
+{
+    scene.Destroy();
+    glDeleteQueries( QUERY_COUNT, queries);
+    for ( int i = 0; i < QUERY_COUNT; ++i) {
+        queries[i] = 0;
+        inFlight[i] = false;
+    }
+}
+
+
+void DynamicResolution::SetFixedScale( float Scale)
+{
+    fixedScale = Scale;
+    scale = Scale > 0.0f ? std::min( 1.0f, std::max( minScale, Scale)) : 1.0f;
+}
+
+
+void DynamicResolution::BeginScene( GLuint TargetFBO)
+{
+    targetFBO = TargetFBO;
+
+    // the timings that have arrived, usually from two or three frames ago
+    for ( int i = 0; i < QUERY_COUNT; ++i) {
+        if ( !inFlight[i])
+            continue;
+        GLint available = 0;
+        glGetQueryObjectiv( queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if ( !available)
+            continue;
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v( queries[i], GL_QUERY_RESULT, &nanoseconds);
+        inFlight[i] = false;
+        Adapt( nanoseconds / 1000000.0f);
+    }
+
+    // all queries still busy, this frame just isn't timed
+    measuring = !inFlight[nextQuery];
+    if ( measuring)
+        glBeginQuery( GL_TIME_ELAPSED, queries[nextQuery]);
+
+    scaled = scale < 1.0f;
+    if ( scaled) {
+        scene.Bind();
+        glViewport( 0, 0, ScaledWidth(), ScaledHeight());
+    } else {
+        glBindFramebuffer( GL_FRAMEBUFFER, targetFBO);
+        glViewport( 0, 0, width, height);
+    }
+}
+
+
+void DynamicResolution::EndScene()
+{
+    if ( measuring) {
+        glEndQuery( GL_TIME_ELAPSED);
+        inFlight[nextQuery] = true;
+        nextQuery = ( nextQuery + 1) % QUERY_COUNT;
+    }
+
+    if ( scaled) {
+        glBindFramebuffer( GL_READ_FRAMEBUFFER, scene.GetFBO());
+        glBindFramebuffer( GL_DRAW_FRAMEBUFFER, targetFBO);
+        glBlitFramebuffer( 0, 0, ScaledWidth(), ScaledHeight(), 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer( GL_FRAMEBUFFER, targetFBO);
+        glViewport( 0, 0, width, height);
+    }
+
+    // the HUD goes over the scene, whatever its depth
+    glState.DepthMask( GL_TRUE);
+    glClear( GL_DEPTH_BUFFER_BIT);
+}
+
+
+void DynamicResolution::Adapt( float milliseconds)
+{
+    // smoothed, a single slow frame changes nothing
+    gpuTime = gpuTime == 0.0f ? milliseconds : gpuTime * 0.8f + milliseconds * 0.2f;
+
+    // give the average time to follow the last change
+    if ( fixedScale > 0.0f || ++framesSinceChange < SETTLE_FRAMES)
+        return;
+
+    // close enough, leave it
+    if ( gpuTime <= budget && gpuTime >= budget * 0.8f)
+        return;
+
+    // the cost goes with the pixel count, so the scale with the square root of the time.
+    // Down as far as needed, but up only one step at a time.
+    float wanted = scale * std::sqrt( budget / std::max( gpuTime, 0.1f));
+    if ( gpuTime < budget)
+        wanted = std::min( wanted, scale + 0.05f);
+
+    // 5% steps, always at least one step down when over the budget
+    wanted = std::floor( wanted * 20.0f + 0.001f) / 20.0f;
+    wanted = std::min( 1.0f, std::max( minScale, wanted));
+    if ( wanted != scale) {
+        scale = wanted;
+        framesSinceChange = 0;
+    }
+}
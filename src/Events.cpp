@@ -135,6 +135,15 @@ void Events::Update( )
                 globals.screenwidth = event.window.data1;
                 globals.screenheight = event.window.data2;
             }
+            // Nobody is looking, the frame pacer goes idle
+            else if (event.window.event == SDL_WINDOWEVENT_FOCUS_LOST)
+                sdlEvents.Focused = false;
+            else if (event.window.event == SDL_WINDOWEVENT_FOCUS_GAINED)
+                sdlEvents.Focused = true;
+            else if (event.window.event == SDL_WINDOWEVENT_MINIMIZED)
+                sdlEvents.Minimized = true;
+            else if (event.window.event == SDL_WINDOWEVENT_RESTORED || event.window.event == SDL_WINDOWEVENT_MAXIMIZED)
+                sdlEvents.Minimized = false;
 
             break;
 
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+#include <thread>
+#include <functional>
+#include <algorithm>
+
+#ifdef _WIN32
+    #include <direct.h>
+    #include <sys/stat.h>
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+    #define MAKE_DIRECTORY(path) _mkdir(path)
+#else
+    #include <sys/stat.h>
+    #include <sys/mman.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <dirent.h>
+    #define MAKE_DIRECTORY(path) mkdir(path, 0755)
+#endif
+
+#include "FileUtils.hpp"
+
+
+uint64_t HashBytes( const void* data, size_t size, uint64_t hash)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for ( size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+
+std::string CanonicalPath( const std::string& path)
+{
+    std::vector<std::string> parts;
+    bool absolute = !path.empty() && ( path[0] == '/' || path[0] == '\\');
+    size_t start = 0;
+    for ( size_t i = 0; i <= path.size(); ++i) {
+        if ( i < path.size() && path[i] != '/' && path[i] != '\\')
+            continue;
+        std::string part = path.substr( start, i - start);
+        start = i + 1;
+        if ( part.empty() || part == ".")
+            continue;
+        if ( part == ".." && !parts.empty() && parts.back() != "..")
+            parts.pop_back();
+        else if ( part != ".." || !absolute)
+            parts.push_back( part);
+    }
+
+    std::string canonical = absolute ? "/" : "";
+    for ( size_t i = 0; i < parts.size(); ++i)
+        canonical += ( i > 0 ? "/" : "") + parts[i];
+    return canonical.empty() ? "." : canonical;
+}
+
+
+void MakeDirectories( const std::string& path)
+{
+    for ( size_t i = 1; i <= path.size(); ++i)
+        if ( i == path.size() || path[i] == '/')
+            MAKE_DIRECTORY( path.substr( 0, i).c_str());
+}
+
+
+static void ListDirectory( const std::string& directory, std::vector<std::string>& files)
+{
+#ifdef _WIN32
+    WIN32_FIND_DATAA found;
+    HANDLE handle = FindFirstFileA( ( directory + "/*").c_str(), &found);
+    if ( handle == INVALID_HANDLE_VALUE)
+        return;
+    do {
+        std::string name = found.cFileName;
+        if ( name == "." || name == "..")
+            continue;
+        if ( found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            ListDirectory( directory + "/" + name, files);
+        else
+            files.push_back( directory + "/" + name);
+    } while ( FindNextFileA( handle, &found));
+    FindClose( handle);
+#else
+    DIR* dir = opendir( directory.c_str());
+    if ( dir == nullptr)
+        return;
+    while ( dirent* entry = readdir( dir)) {
+        std::string name = entry->d_name;
+        if ( name == "." || name == "..")
+            continue;
+        std::string path = directory + "/" + name;
+        struct stat status;
+        if ( stat( path.c_str(), &status) != 0)
+            continue;
+        if ( S_ISDIR( status.st_mode))
+            ListDirectory( path, files);
+        else if ( S_ISREG( status.st_mode))
+            files.push_back( path);
+    }
+    closedir( dir);
+#endif
+}
+
+
+void ListFiles( const std::string& directory, std::vector<std::string>& files)
+{
+    files.clear();
+    ListDirectory( directory, files);
+    std::sort( files.begin(), files.end());
+}
+
+
+bool GetFileStamp( const std::string& path, uint64_t& size, uint64_t& time)
+{
+#ifdef _WIN32
+    struct _stat64 status;
+    if ( _stat64( path.c_str(), &status) != 0 || !( status.st_mode & _S_IFREG))
+        return false;
+#else
+    struct stat status;
+    if ( stat( path.c_str(), &status) != 0 || !S_ISREG( status.st_mode))
+        return false;
+#endif
+    size = (uint64_t)status.st_size;
+    time = (uint64_t)status.st_mtime;
+    return true;
+}
+
+
+bool ReadFile( const std::string& path, std::vector<unsigned char>& data)
+{
+    std::ifstream file( path, std::ios::binary);
+    if ( !file)
+        return false;
+    data.assign( (std::istreambuf_iterator<char>( file)), std::istreambuf_iterator<char>());
+    return true;
+}
+
+
+bool WriteFileAtomic( const std::string& path, const void* data, size_t size)
+{
+    std::string temporary = path + "." + std::to_string( std::hash<std::thread::id>()( std::this_thread::get_id())) + ".tmp";
+    {
+        std::ofstream file( temporary, std::ios::binary);
+        if ( !file)
+            return false;
+        file.write( (const char*)data, size);
+        if ( !file)
+            return false;
+    }
+    std::remove( path.c_str());
+    return std::rename( temporary.c_str(), path.c_str()) == 0;
+}
+
+
+bool MappedFile::Open( const std::string& path)
+{
+    Close();
+#ifdef _WIN32
+    HANDLE handle = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if ( handle == INVALID_HANDLE_VALUE)
+        return false;
+    file = handle;
+    LARGE_INTEGER fileSize;
+    if ( !GetFileSizeEx( handle, &fileSize) || fileSize.QuadPart == 0) {
+        Close();
+        return false;
+    }
+    mapping = CreateFileMappingA( handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if ( mapping != nullptr)
+        data = (const unsigned char*)MapViewOfFile( (HANDLE)mapping, FILE_MAP_READ, 0, 0, 0);
+    size = (size_t)fileSize.QuadPart;
+#else
+    file = open( path.c_str(), O_RDONLY);
+    if ( file < 0)
+        return false;
+    struct stat status;
+    if ( fstat( file, &status) != 0 || status.st_size == 0) {
+        Close();
+        return false;
+    }
+    void* view = mmap( nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    if ( view != MAP_FAILED)
+        data = (const unsigned char*)view;
+    size = (size_t)status.st_size;
+#endif
+    if ( data == nullptr) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+    if ( data != nullptr)
+        UnmapViewOfFile( data);
+    if ( mapping != nullptr)
+        CloseHandle( (HANDLE)mapping);
+    if ( file != nullptr)
+        CloseHandle( (HANDLE)file);
+    mapping = nullptr;
+    file = nullptr;
+#else
+    if ( data != nullptr)
+        munmap( (void*)data, size);
+    if ( file >= 0)
+        close( file);
+    file = -1;
+#endif
+    data = nullptr;
+    size = 0;
+}
@@ -0,0 +1,520 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <iostream>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <cstddef>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Fracture.hpp"
+#include "ThreadPool.hpp"
+#include "GLState.hpp"
+#include "TexturePacker.hpp"
+#include "PlanetTerrain.hpp"
+
+FractureCache fractureCache;
+extern ThreadPool threadPool;
+extern GLStateCache glState;
+extern TexturePacker texturePacker;
+
+typedef std::vector<ShardVertex> Polygon;
+
+struct Plane
+{
+    glm::vec3 normal;
+    float distance;     // inside is dot( normal, p) <= distance
+};
+
+
+static ShardVertex Lerp( const ShardVertex& a, const ShardVertex& b, float t)
+{
+    ShardVertex v;
+    v.Position = a.Position + ( b.Position - a.Position) * t;
+    v.Normal = a.Normal + ( b.Normal - a.Normal) * t;
+    v.TexCoords = a.TexCoords + ( b.TexCoords - a.TexCoords) * t;
+    v.Layer = a.Layer;
+    return v;
+}
+
+// Sutherland-Hodgman, one plane
+static void Clip( Polygon& polygon, const Plane& plane)
+{
+    if ( polygon.empty())
+        return;
+    Polygon out;
+    out.reserve( polygon.size() + 1);
+    for ( size_t i = 0; i < polygon.size(); ++i) {
+        const ShardVertex& a = polygon[i];
+        const ShardVertex& b = polygon[( i + 1) % polygon.size()];
+        float da = glm::dot( plane.normal, a.Position) - plane.distance;
+        float db = glm::dot( plane.normal, b.Position) - plane.distance;
+        if ( da <= 0.0f)
+            out.push_back( a);
+        if ( ( da <= 0.0f) != ( db <= 0.0f))
+            out.push_back( Lerp( a, b, da / ( da - db)));
+    }
+    polygon.swap( out);
+    if ( polygon.size() < 3)
+        polygon.clear();
+}
+
+// A convex polygon as a fan
+static void AddPolygon( const Polygon& polygon, std::vector<ShardVertex>& vertices, std::vector<GLuint>& indices)
+{
+    GLuint first = (GLuint)vertices.size();
+    for ( auto& v: polygon) {
+        vertices.push_back( v);
+        vertices.back().Normal = glm::normalize( v.Normal);
+    }
+    for ( GLuint i = 2; i < polygon.size(); ++i)
+        indices.insert( indices.end(), { first, first + i - 1, first + i});
+}
+
+
+void FractureCache::CutModel( const Source& source, int shardCount, unsigned int seed, Cut& cut)
+{
+    glm::vec3 center = ( source.boundsMin + source.boundsMax) * 0.5f;
+    glm::vec3 halfSize = ( source.boundsMax - source.boundsMin) * 0.5f;
+    float reach = glm::length( halfSize) * 2.0f;
+
+    // the seeds, inside the ellipsoid of the bounds
+    std::minstd_rand random( seed);
+    std::uniform_real_distribution<float> unit( -1.0f, 1.0f);
+    std::vector<glm::vec3> seeds;
+    while ( (int)seeds.size() < shardCount) {
+        glm::vec3 p( unit( random), unit( random), unit( random));
+        if ( glm::dot( p, p) <= 0.8f)
+            seeds.push_back( center + p * halfSize);
+    }
+
+    // the hull, every triangle's plane facing out
+    std::vector<Plane> hull;
+    for ( size_t i = 0; i + 2 < source.indices.size(); i += 3) {
+        glm::vec3 a = source.vertices[source.indices[i]].Position;
+        glm::vec3 b = source.vertices[source.indices[i + 1]].Position;
+        glm::vec3 c = source.vertices[source.indices[i + 2]].Position;
+        glm::vec3 n = glm::cross( b - a, c - a);
+        if ( glm::length( n) < 1e-9f)
+            continue;
+        Plane plane = { glm::normalize( n), 0.0f };
+        plane.distance = glm::dot( plane.normal, a);
+        if ( glm::dot( plane.normal, center) > plane.distance) {
+            plane.normal = -plane.normal;
+            plane.distance = -plane.distance;
+        }
+        hull.push_back( plane);
+    }
+
+    for ( int i = 0; i < shardCount; ++i) {
+        // the half of space nearer to seed i than to seed j, per j
+        std::vector<Plane> cell;
+        std::vector<int> neighbours;
+        for ( int j = 0; j < shardCount; ++j) {
+            if ( j == i)
+                continue;
+            Plane plane;
+            plane.normal = glm::normalize( seeds[j] - seeds[i]);
+            plane.distance = glm::dot( plane.normal, ( seeds[i] + seeds[j]) * 0.5f);
+            cell.push_back( plane);
+        }
+
+        Shard shard;
+        shard.firstIndex = (GLuint)cut.indices.size();
+        size_t firstVertex = cut.vertices.size();
+
+        // the outside, the model's own triangles
+        for ( size_t t = 0; t + 2 < source.indices.size(); t += 3) {
+            Polygon polygon;
+            for ( int k = 0; k < 3; ++k) {
+                const Vertex& v = source.vertices[source.indices[t + k]];
+                polygon.push_back( ShardVertex{ v.Position, v.Normal, v.TexCoords, (float)v.Material });
+            }
+            for ( auto& plane: cell)
+                Clip( polygon, plane);
+            if ( !polygon.empty())
+                AddPolygon( polygon, cut.vertices, cut.indices);
+        }
+
+        // the inside, the cell walls cut to the hull
+        for ( size_t w = 0; w < cell.size(); ++w) {
+            const Plane& wall = cell[w];
+            glm::vec3 tangent = glm::normalize( glm::cross( std::fabs( wall.normal.y) < 0.9f ? glm::vec3( 0.0f, 1.0f, 0.0f) : glm::vec3( 1.0f, 0.0f, 0.0f), wall.normal));
+            glm::vec3 bitangent = glm::cross( wall.normal, tangent);
+            glm::vec3 origin = wall.normal * wall.distance;
+            Polygon polygon;
+            const float corners[4][2] = { { -1.0f, -1.0f}, { 1.0f, -1.0f}, { 1.0f, 1.0f}, { -1.0f, 1.0f} };
+            for ( auto& corner: corners) {
+                glm::vec3 p = origin + ( tangent * corner[0] + bitangent * corner[1]) * reach;
+                polygon.push_back( ShardVertex{ p, wall.normal, glm::vec2( glm::dot( p, tangent), glm::dot( p, bitangent)), -1.0f });
+            }
+            for ( size_t k = 0; k < cell.size() && !polygon.empty(); ++k)
+                if ( k != w)
+                    Clip( polygon, cell[k]);
+            for ( size_t k = 0; k < hull.size() && !polygon.empty(); ++k)
+                Clip( polygon, hull[k]);
+            if ( !polygon.empty())
+                AddPolygon( polygon, cut.vertices, cut.indices);
+        }
+
+        shard.indexCount = (GLsizei)( cut.indices.size() - shard.firstIndex);
+        if ( shard.indexCount == 0)
+            continue;
+
+        // around its own middle, so it spins about that
+        glm::vec3 centroid( 0.0f);
+        for ( size_t v = firstVertex; v < cut.vertices.size(); ++v)
+            centroid += cut.vertices[v].Position;
+        centroid /= (float)( cut.vertices.size() - firstVertex);
+        for ( size_t v = firstVertex; v < cut.vertices.size(); ++v)
+            cut.vertices[v].Position -= centroid;
+        shard.centroid = centroid;
+        cut.shards.push_back( shard);
+    }
+
+    // where the outside vertices sit on the model, for the terrain heights
+    cut.directions.assign( cut.vertices.size(), glm::vec3( 0.0f));
+    for ( const Shard& shard: cut.shards) {
+        for ( GLsizei i = 0; i < shard.indexCount; ++i) {
+            GLuint vertex = cut.indices[shard.firstIndex + i];
+            if ( cut.vertices[vertex].Layer >= 0.0f)
+                cut.directions[vertex] = cut.vertices[vertex].Position + shard.centroid;
+        }
+    }
+}
+
+
+void FractureCache::Request( Model* model, int shardCount, unsigned int seed)
+{
+    for ( auto& f: fractured)
+        if ( f.model == model)
+            return;
+    Fractured f;
+    f.model = model;
+    fractured.push_back( f);
+
+    // a copy, the model may change while the workers are on it
+    std::shared_ptr<Source> source = std::make_shared<Source>();
+    source->boundsMin = model->GetMinValue();
+    source->boundsMax = model->GetMaxValue();
+    for ( auto& mesh: model->meshes) {
+        GLuint base = (GLuint)source->vertices.size();
+        source->vertices.insert( source->vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+        for ( GLuint index: mesh.indices)
+            source->indices.push_back( base + index);
+        if ( fractured.back().textureGroup < 0)
+            fractured.back().textureGroup = mesh.textureGroup;
+    }
+
+    if ( !done)
+        done = std::make_shared<Done>();
+    std::shared_ptr<Done> state = done;
+    pending++;
+    threadPool.Enqueue( [state, source, model, shardCount, seed]() {
+        {
+            std::unique_lock<std::mutex> lock( state->mutex);
+            if ( state->stopping)
+                return;
+        }
+        Cut cut;
+        CutModel( *source, shardCount, seed, cut);
+
+        std::unique_lock<std::mutex> lock( state->mutex);
+        state->ready.emplace_back( model, std::move( cut));
+    });
+}
+
+
+void FractureCache::Update()
+{
+    if ( pending == 0)
+        return;
+
+    std::vector<std::pair<Model*, Cut>> ready;
+    std::vector<TerrainHeights> heights;
+    {
+        std::unique_lock<std::mutex> lock( done->mutex);
+        ready.swap( done->ready);
+        heights.swap( done->heights);
+    }
+    for ( auto& item: ready) {
+        Upload( item.first, item.second);
+        pending--;
+    }
+    for ( auto& item: heights) {
+        UploadVariant( item);
+        pending--;
+    }
+}
+
+
+void FractureCache::Finish()
+{
+    while ( pending > 0) {
+        threadPool.Wait();
+        Update();
+    }
+}
+
+
+bool FractureCache::IsReady( Model* model)
+{
+    for ( auto& f: fractured)
+        if ( f.model == model)
+            return f.ready;
+    return false;
+}
+
+
+// The ShardVertex layout, for the bound vertex array and GL_ARRAY_BUFFER
+static void SetShardAttributes()
+{
+    glEnableVertexAttribArray( 0);
+    glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, sizeof( ShardVertex), (void*)offsetof( ShardVertex, Position));
+    glEnableVertexAttribArray( 1);
+    glVertexAttribPointer( 1, 3, GL_FLOAT, GL_FALSE, sizeof( ShardVertex), (void*)offsetof( ShardVertex, Normal));
+    glEnableVertexAttribArray( 2);
+    glVertexAttribPointer( 2, 2, GL_FLOAT, GL_FALSE, sizeof( ShardVertex), (void*)offsetof( ShardVertex, TexCoords));
+    glEnableVertexAttribArray( 3);
+    glVertexAttribPointer( 3, 1, GL_FLOAT, GL_FALSE, sizeof( ShardVertex), (void*)offsetof( ShardVertex, Layer));
+}
+
+
+void FractureCache::Upload( Model* model, const Cut& cut)
+{
+    for ( auto& f: fractured) {
+        if ( f.model != model)
+            continue;
+
+        glGenVertexArrays( 1, &f.vao);
+        glGenBuffers( 1, &f.vbo);
+        glGenBuffers( 1, &f.ebo);
+        glState.BindVertexArray( f.vao);
+        glBindBuffer( GL_ARRAY_BUFFER, f.vbo);
+        glBufferData( GL_ARRAY_BUFFER, cut.vertices.size() * sizeof( ShardVertex), cut.vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, f.ebo);
+        glBufferData( GL_ELEMENT_ARRAY_BUFFER, cut.indices.size() * sizeof( GLuint), cut.indices.data(), GL_STATIC_DRAW);
+        SetShardAttributes();
+        glState.BindVertexArray( 0);
+
+        f.directions = std::make_shared<const std::vector<glm::vec3>>( cut.directions);
+        f.shards = cut.shards;
+        f.ready = true;
+        std::cout << "  Fractured a model in " << f.shards.size() << " shards, " << cut.indices.size() / 3 << " triangles\n";
+        // the planets that asked before the cut was in
+        for ( unsigned int seed: f.terrainSeeds)
+            QueueTerrain( f, seed);
+        return;
+    }
+}
+
+
+void FractureCache::RequestTerrain( Model* model, unsigned int terrainSeed)
+{
+    for ( auto& f: fractured) {
+        if ( f.model != model)
+            continue;
+        if ( std::find( f.terrainSeeds.begin(), f.terrainSeeds.end(), terrainSeed) != f.terrainSeeds.end())
+            return;
+        f.terrainSeeds.push_back( terrainSeed);
+        if ( f.ready)
+            QueueTerrain( f, terrainSeed);
+        return;
+    }
+}
+
+
+// The heights of every outside vertex, 14 octaves of noise each, so on the workers
+void FractureCache::QueueTerrain( const Fractured& f, unsigned int seed)
+{
+    std::shared_ptr<Done> state = done;
+    std::shared_ptr<const std::vector<glm::vec3>> directions = f.directions;
+    Model* model = f.model;
+    pending++;
+    threadPool.Enqueue( [state, directions, model, seed]() {
+        {
+            std::unique_lock<std::mutex> lock( state->mutex);
+            if ( state->stopping)
+                return;
+        }
+        TerrainHeights item;
+        item.model = model;
+        item.seed = seed;
+        item.heights.assign( directions->size(), 0.0f);
+        for ( size_t i = 0; i < directions->size(); ++i)
+            if ( glm::dot( (*directions)[i], (*directions)[i]) > 0.0f)
+                item.heights[i] = PlanetTerrain::GetHeight( (*directions)[i], seed);
+
+        std::unique_lock<std::mutex> lock( state->mutex);
+        state->heights.push_back( std::move( item));
+    });
+}
+
+
+// The same shards with a second vertex buffer of terrain heights
+void FractureCache::UploadVariant( const TerrainHeights& heights)
+{
+    for ( auto& f: fractured) {
+        if ( f.model != heights.model)
+            continue;
+
+        Variant variant;
+        variant.seed = heights.seed;
+        glGenVertexArrays( 1, &variant.vao);
+        glGenBuffers( 1, &variant.vbo);
+        glState.BindVertexArray( variant.vao);
+        glBindBuffer( GL_ARRAY_BUFFER, f.vbo);
+        SetShardAttributes();
+        glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, f.ebo);
+        glBindBuffer( GL_ARRAY_BUFFER, variant.vbo);
+        glBufferData( GL_ARRAY_BUFFER, heights.heights.size() * sizeof( float), heights.heights.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray( 4);
+        glVertexAttribPointer( 4, 1, GL_FLOAT, GL_FALSE, sizeof( float), (void*)0);
+        glState.BindVertexArray( 0);
+        f.variants.push_back( variant);
+        return;
+    }
+}
+
+
+bool FractureCache::Shatter( Model* model, const glm::mat4& modelMatrix, const glm::vec3& velocity, int terrainSeed)
+{
+    int index = -1;
+    for ( size_t i = 0; i < fractured.size(); ++i)
+        if ( fractured[i].model == model && fractured[i].ready)
+            index = (int)i;
+    if ( index < 0)
+        return false;
+
+    std::minstd_rand random( ++shatterCount);
+    std::uniform_real_distribution<float> unit( 0.0f, 1.0f);
+    float scale = glm::length( glm::vec3( modelMatrix[0]));
+    glm::quat orientation = glm::quat_cast( glm::mat3( modelMatrix) / scale);
+    const Fractured& f = fractured[index];
+    // a look up only, the heights were made ahead on the workers
+    int variant = -1;
+    for ( size_t i = 0; i < f.variants.size() && terrainSeed >= 0; ++i)
+        if ( f.variants[i].seed == (unsigned int)terrainSeed)
+            variant = (int)i;
+    for ( size_t s = 0; s < f.shards.size(); ++s) {
+        Body body;
+        body.fractured = index;
+        body.shard = (int)s;
+        body.variant = variant;
+        body.position = glm::vec3( modelMatrix * glm::vec4( f.shards[s].centroid, 1.0f));
+        body.orientation = orientation;
+        glm::vec3 outwards = orientation * f.shards[s].centroid;
+        float length = glm::length( outwards);
+        outwards = length > 0.0001f ? outwards / length : glm::vec3( 0.0f, 1.0f, 0.0f);
+        body.velocity = velocity + outwards * speed * scale * ( 0.5f + unit( random));
+        glm::vec3 axis = glm::vec3( unit( random), unit( random), unit( random)) * 2.0f - 1.0f;
+        body.spin = ( glm::length( axis) > 0.0001f ? glm::normalize( axis) : glm::vec3( 0.0f, 1.0f, 0.0f)) * ( 0.2f + 1.3f * unit( random));
+        body.scale = scale;
+        body.age = 0.0f;
+        bodies.push_back( body);
+    }
+    return true;
+}
+
+
+void FractureCache::Simulate( float dt)
+{
+    size_t i = 0;
+    while ( i < bodies.size()) {
+        Body& body = bodies[i];
+        body.age += dt;
+        if ( body.age > lifetime) {
+            body = bodies.back();
+            bodies.pop_back();
+            continue;
+        }
+        body.position += body.velocity * dt;
+        float angle = glm::length( body.spin) * dt;
+        if ( angle > 0.0f)
+            body.orientation = glm::normalize( glm::angleAxis( angle, glm::normalize( body.spin)) * body.orientation);
+        ++i;
+    }
+}
+
+
+void FractureCache::Draw( Shader& shader, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& sunDirection)
+{
+    if ( bodies.empty())
+        return;
+
+    shader.Use();
+    shader.setMat4( "view", view);
+    shader.setMat4( "projection", projection);
+    shader.setVec3( "sunDirection", glm::normalize( sunDirection));
+    shader.setInt( "texture_diffuse", 0);
+
+    int current = -1;
+    int currentVariant = -1;
+    for ( const Body& body: bodies) {
+        const Fractured& f = fractured[body.fractured];
+        if ( body.fractured != current || body.variant != currentVariant) {
+            current = body.fractured;
+            currentVariant = body.variant;
+            glState.BindTexture( 0, GL_TEXTURE_2D_ARRAY, texturePacker.GetTexture( f.textureGroup));
+            glState.BindVertexArray( body.variant >= 0 ? f.variants[body.variant].vao : f.vao);
+            shader.setBool( "terrain_colors", body.variant >= 0);
+        }
+        glm::mat4 model = glm::translate( glm::mat4( 1.0f), body.position) * glm::mat4_cast( body.orientation);
+        model = glm::scale( model, glm::vec3( body.scale));
+        shader.setMat4( "model", model);
+        // the inside glows for a few seconds
+        shader.setFloat( "heat", std::max( 0.0f, 1.0f - body.age / 4.0f));
+        const Shard& shard = f.shards[body.shard];
+        glDrawElements( GL_TRIANGLES, shard.indexCount, GL_UNSIGNED_INT, (void*)( shard.firstIndex * sizeof( GLuint)));
+    }
+}
+
+
+void FractureCache::CleanUp()
+{
+    if ( done) {
+        {
+            std::unique_lock<std::mutex> lock( done->mutex);
+            done->stopping = true;
+            done->ready.clear();
+            done->heights.clear();
+        }
+        threadPool.Wait();
+        done.reset();
+    }
+    pending = 0;
+
+    for ( auto& f: fractured) {
+        for ( auto& variant: f.variants) {
+            glDeleteBuffers( 1, &variant.vbo);
+            glDeleteVertexArrays( 1, &variant.vao);
+            glState.ForgetVertexArray( variant.vao);
+        }
+        if ( f.ebo != 0)
+            glDeleteBuffers( 1, &f.ebo);
+        if ( f.vbo != 0)
+            glDeleteBuffers( 1, &f.vbo);
+        if ( f.vao != 0) {
+            glDeleteVertexArrays( 1, &f.vao);
+            glState.ForgetVertexArray( f.vao);
+        }
+    }
+    fractured.clear();
+    bodies.clear();
+}
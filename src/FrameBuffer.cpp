@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+
+#include "FrameBuffer.hpp"
+#include "GLState.hpp"
+
+extern GLStateCache glState;
+
+
+bool FrameBuffer::Create( int Width, int Height)
+{
+    width = Width;
+    height = Height;
+
+    glGenTextures( 1, &colorTexture);
+    // through the state cache, this may happen mid game on a window resize
+    glState.BindTexture( 0, GL_TEXTURE_2D, colorTexture);
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glState.BindTexture( 0, GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers( 1, &depthBuffer);
+    glBindRenderbuffer( GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer( GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers( 1, &fbo);
+    glBindFramebuffer( GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+
+    GLenum status = glCheckFramebufferStatus( GL_FRAMEBUFFER);
+    glBindFramebuffer( GL_FRAMEBUFFER, 0);
+    if ( status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "Error in FrameBuffer::Create, status 0x" << std::hex << status << std::dec << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+void FrameBuffer::Resize( int Width, int Height)
+{
+    if ( Width == width && Height == height)
+        return;
+    Destroy();
+    Create( Width, Height);
+}
+
+
+void FrameBuffer::Destroy()
+{
+    if ( fbo != 0) {
+        glDeleteFramebuffers( 1, &fbo);
+        glDeleteRenderbuffers( 1, &depthBuffer);
+        glDeleteTextures( 1, &colorTexture);
+        glState.ForgetTexture( colorTexture);
+    }
+    fbo = depthBuffer = colorTexture = 0;
+}
+
+
+void FrameBuffer::Bind()
+{
+    glBindFramebuffer( GL_FRAMEBUFFER, fbo);
+    glViewport( 0, 0, width, height);
+}
+
+
+void FrameBuffer::ReadPixels( std::vector<unsigned char>& pixels)
+{
+    pixels.resize( (size_t)width * height * 4);
+    glBindFramebuffer( GL_READ_FRAMEBUFFER, fbo);
+    glPixelStorei( GL_PACK_ALIGNMENT, 1);
+    glReadPixels( 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+}
+
+
+// PNG without a compression library: the zlib stream is made of "stored" deflate blocks.
+// The files are bigger, but the frame dumps are for diffing, not for keeping.
+static unsigned int Crc32( const unsigned char* data, size_t size, unsigned int crc = 0)
+{
+    static unsigned int table[256];
+    static bool tableReady = false;
+    if ( !tableReady) {
+        for ( unsigned int n = 0; n < 256; ++n) {
+            unsigned int c = n;
+            for ( int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        tableReady = true;
+    }
+    crc = ~crc;
+    for ( size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void PutBigEndian( std::vector<unsigned char>& out, unsigned int value)
+{
+    out.push_back( (unsigned char)(value >> 24));
+    out.push_back( (unsigned char)(value >> 16));
+    out.push_back( (unsigned char)(value >> 8));
+    out.push_back( (unsigned char)value);
+}
+
+static void WriteChunk( std::ofstream& file, const char* type, const std::vector<unsigned char>& data)
+{
+    std::vector<unsigned char> chunk;
+    PutBigEndian( chunk, (unsigned int)data.size());
+    chunk.insert( chunk.end(), type, type + 4);
+    chunk.insert( chunk.end(), data.begin(), data.end());
+    // the crc covers the type and the data, not the length
+    PutBigEndian( chunk, Crc32( chunk.data() + 4, chunk.size() - 4));
+    file.write( (const char*)chunk.data(), chunk.size());
+}
+
+
+bool FrameBuffer::SavePNG( const std::string& path)
+{
+    std::vector<unsigned char> pixels;
+    ReadPixels( pixels);
+
+    // Scanlines top to bottom, each starting with filter type 0
+    size_t rowBytes = (size_t)width * 4;
+    std::vector<unsigned char> raw;
+    raw.reserve( (rowBytes + 1) * height);
+    for ( int y = height - 1; y >= 0; --y) {
+        raw.push_back( 0);
+        raw.insert( raw.end(), pixels.begin() + y * rowBytes, pixels.begin() + (y + 1) * rowBytes);
+    }
+
+    std::vector<unsigned char> zlib;
+    zlib.reserve( raw.size() + raw.size() / 65535 * 5 + 16);
+    zlib.push_back( 0x78);
+    zlib.push_back( 0x01);
+    size_t offset = 0;
+    do {
+        size_t blockSize = std::min( raw.size() - offset, (size_t)65535);
+        bool last = offset + blockSize == raw.size();
+        zlib.push_back( last ? 1 : 0);
+        zlib.push_back( (unsigned char)blockSize);
+        zlib.push_back( (unsigned char)(blockSize >> 8));
+        zlib.push_back( (unsigned char)~blockSize);
+        zlib.push_back( (unsigned char)(~blockSize >> 8));
+        zlib.insert( zlib.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+        offset += blockSize;
+    } while ( offset < raw.size());
+
+    unsigned int a = 1, b = 0;
+    for ( unsigned char c : raw) {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    PutBigEndian( zlib, (b << 16) | a);
+
+    std::ofstream file( path, std::ios::binary);
+    if ( !file) {
+        std::cout << "Error in FrameBuffer::SavePNG, can't write " << path << std::endl;
+        return false;
+    }
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    file.write( (const char*)signature, 8);
+
+    std::vector<unsigned char> header;
+    PutBigEndian( header, width);
+    PutBigEndian( header, height);
+    header.push_back( 8);   // bit depth
+    header.push_back( 6);   // RGBA
+    header.push_back( 0);
+    header.push_back( 0);
+    header.push_back( 0);
+    WriteChunk( file, "IHDR", header);
+    WriteChunk( file, "IDAT", zlib);
+    WriteChunk( file, "IEND", std::vector<unsigned char>());
+    return true;
+}
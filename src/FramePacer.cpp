@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <cmath>
+#include <thread>
+#include <algorithm>
+
+#ifdef _WIN32
+    #include <SDL2/include/SDL.h>
+    #include <windows.h>
+    #pragma comment( lib, "winmm.lib")
+#else
+    #include <SDL2/SDL.h>
+#endif
+
+#include "FramePacer.hpp"
+
+FramePacer framePacer;
+
+
+void PacingStats::Add( double interval, double late)
+{
+    frames++;
+    intervalSum += interval;
+    intervalSquares += interval * interval;
+    lateMax = std::max( lateMax, late);
+    if ( late > 0.001)
+        missed++;
+}
+
+
+float PacingStats::AverageMs() const
+{
+    return frames > 0 ? (float)( intervalSum / frames * 1000.0) : 0.0f;
+}
+
+
+float PacingStats::JitterMs() const
+{
+    if ( frames < 2)
+        return 0.0f;
+    double average = intervalSum / frames;
+    double variance = std::max( 0.0, intervalSquares / frames - average * average);
+    return (float)( std::sqrt( variance) * 1000.0);
+}
+
+
+void FramePacer::Init()
+{
+#ifdef _WIN32
+    // the default Windows timer only ticks every 15.6ms, far too coarse to sleep with
+    timeBeginPeriod( 1);
+#endif
+    started = false;
+}
+
+
+void FramePacer::CleanUp()
+{
+#ifdef _WIN32
+    timeEndPeriod( 1);
+#endif
+}
+
+
+int FramePacer::SetVSync( int interval)
+{
+    if ( SDL_GL_SetSwapInterval( interval) == 0)
+        return interval;
+    if ( interval == -1 && SDL_GL_SetSwapInterval( 1) == 0)
+        return 1;
+    return 0;
+}
+
+
+void FramePacer::Wait()
+{
+    Clock::time_point now = Clock::now();
+    float rate = idle ? idleRate : targetRate;
+    double late = 0.0;
+
+    if ( rate > 0.0f) {
+        Clock::duration period = std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( 1.0 / rate));
+
+        // more than a frame behind: start over from now instead of rushing a bunch of frames
+        // out to catch up. Coming back from the idle rate the slot may be too far away.
+        bool behind = started && now > deadline + period;
+        if ( behind)
+            late = std::chrono::duration<double>( now - deadline).count();
+        if ( !started || behind)
+            deadline = now;
+        deadline = std::min( deadline, now + period);
+
+        if ( deadline - now > spinMargin)
+            std::this_thread::sleep_for( deadline - now - spinMargin);
+        while ( ( now = Clock::now()) < deadline)
+            std::this_thread::yield();
+
+        if ( !behind)
+            late = std::chrono::duration<double>( now - deadline).count();
+        deadline += period;
+    }
+
+    if ( started) {
+        double interval = std::chrono::duration<double>( now - lastFrame).count();
+        total.Add( interval, late);
+        recent.Add( interval, late);
+    }
+    lastFrame = now;
+    started = true;
+}
+
+
+PacingStats FramePacer::TakeRecentStats()
+{
+    PacingStats stats = recent;
+    recent = PacingStats();
+    return stats;
+}
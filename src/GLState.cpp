@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GLState.hpp"
+
+GLStateCache glState;
+
+
+// Count the call and tell if it has to go to the driver
+bool GLStateCache::Changed( GLuint& shadow, GLuint value)
+{
+    if ( shadow == value) {
+        saved++;
+        return false;
+    }
+    shadow = value;
+    issued++;
+    return true;
+}
+
+
+void GLStateCache::UseProgram( GLuint Program)
+{
+    if ( Changed( program, Program))
+        glUseProgram( Program);
+}
+
+
+void GLStateCache::BindVertexArray( GLuint VAO)
+{
+    if ( Changed( vao, VAO))
+        glBindVertexArray( VAO);
+}
+
+
+void GLStateCache::BindTexture( GLuint unit, GLenum target, GLuint texture)
+{
+    int slot;
+    switch ( target) {
+        case GL_TEXTURE_CUBE_MAP: slot = TARGET_CUBE_MAP; break;
+        case GL_TEXTURE_2D_ARRAY: slot = TARGET_2D_ARRAY; break;
+        default:                  slot = TARGET_2D; break;
+    }
+    if ( unit >= MAX_TEXTURE_UNITS) {
+        glActiveTexture( GL_TEXTURE0 + unit);
+        glBindTexture( target, texture);
+        activeUnit = unit;
+        issued += 2;
+        return;
+    }
+
+    if ( textures[unit][slot] == texture) {
+        saved++;
+        return;
+    }
+    if ( Changed( activeUnit, unit))
+        glActiveTexture( GL_TEXTURE0 + unit);
+    textures[unit][slot] = texture;
+    issued++;
+    glBindTexture( target, texture);
+}
+
+
+void GLStateCache::PolygonMode( GLenum mode)
+{
+    if ( Changed( polygonMode, mode))
+        glPolygonMode( GL_FRONT_AND_BACK, mode);
+}
+
+
+void GLStateCache::DepthFunc( GLenum func)
+{
+    if ( Changed( depthFunc, func))
+        glDepthFunc( func);
+}
+
+
+void GLStateCache::DepthMask( GLboolean enable)
+{
+    if ( Changed( depthMask, enable))
+        glDepthMask( enable);
+}
+
+
+void GLStateCache::LineWidth( GLfloat width)
+{
+    if ( lineWidth == width) {
+        saved++;
+        return;
+    }
+    lineWidth = width;
+    issued++;
+    glLineWidth( width);
+}
+
+
+void GLStateCache::BlendFunc( GLenum sfactor, GLenum dfactor)
+{
+    if ( blendSrc == sfactor && blendDst == dfactor) {
+        saved++;
+        return;
+    }
+    blendSrc = sfactor;
+    blendDst = dfactor;
+    issued++;
+    glBlendFunc( sfactor, dfactor);
+}
+
+
+void GLStateCache::SetCap( GLenum cap, bool enable)
+{
+    int index;
+    switch ( cap) {
+        case GL_DEPTH_TEST:         index = CAP_DEPTH_TEST; break;
+        case GL_CULL_FACE:          index = CAP_CULL_FACE; break;
+        case GL_BLEND:              index = CAP_BLEND; break;
+        case GL_PROGRAM_POINT_SIZE: index = CAP_PROGRAM_POINT_SIZE; break;
+        default:
+            issued++;
+            if ( enable) glEnable( cap); else glDisable( cap);
+            return;
+    }
+    if ( Changed( caps[index], enable ? 1 : 0)) {
+        if ( enable) glEnable( cap); else glDisable( cap);
+    }
+}
+
+void GLStateCache::Enable( GLenum cap)  { SetCap( cap, true); }
+void GLStateCache::Disable( GLenum cap) { SetCap( cap, false); }
+
+
+void GLStateCache::Invalidate()
+{
+    program = vao = activeUnit = UNKNOWN;
+    for ( auto& unit: textures)
+        for ( auto& bound: unit)
+            bound = UNKNOWN;
+    polygonMode = depthFunc = depthMask = blendSrc = blendDst = UNKNOWN;
+    lineWidth = -1.0f;
+    for ( auto& cap: caps)
+        cap = UNKNOWN;
+}
+
+
+// A deleted program stays in use until the next glUseProgram, that one has to be issued
+void GLStateCache::ForgetProgram( GLuint Program)
+{
+    if ( Program != 0 && program == Program)
+        program = UNKNOWN;
+}
+
+
+void GLStateCache::ForgetVertexArray( GLuint VAO)
+{
+    if ( VAO != 0 && vao == VAO)
+        vao = 0;
+}
+
+
+// Deleting a bound texture binds 0 in its place, on every unit
+void GLStateCache::ForgetTexture( GLuint texture)
+{
+    if ( texture == 0)
+        return;
+    for ( auto& unit: textures)
+        for ( auto& bound: unit)
+            if ( bound == texture)
+                bound = 0;
+}
+
+
+void GLStateCache::BeginFrame()
+{
+    lastIssued = issued;
+    lastSaved = saved;
+    issued = 0;
+    saved = 0;
+}
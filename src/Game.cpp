@@ -16,7 +16,9 @@
 
 
 #include <random>
+#include <cstdio>
 #include <ctime>
+#include <algorithm>
 
 #include "Game.hpp"
 
@@ -31,12 +33,44 @@
 extern Camera camera;
 extern Events events;
 extern Globals globals;
+extern MeshArena meshArena;
+extern ThreadPool threadPool;
+extern GLStateCache glState;
+extern TexturePacker texturePacker;
+extern TextureStreamer textureStreamer;
+extern ShaderCache shaderCache;
+extern DynamicResolution dynamicResolution;
+extern FramePacer framePacer;
+extern PlanetTerrain planetTerrain;
+extern ImpostorAtlas impostorAtlas;
+extern ParticleSystem particleSystem;
+extern FractureCache fractureCache;
+extern AssetManager assetManager;
+extern MaterialTable materialTable;
 
 
 int Game::InitSDL(std::string title, int width, int height) {
     titleHeader = title;
     globals.screenheight = height;
     globals.screenwidth = width;
+
+    if ( globals.headless) {
+        if ( !headlessContext.Create( width, height))
+            return false;
+        glewExperimental = GL_TRUE;
+        // GLEW looks for an X display on Linux, we don't have one and don't need one
+        GLenum glewResult = glewInit();
+        if ( glewResult != GLEW_OK && glewResult != GLEW_ERROR_NO_GLX_DISPLAY) {
+            std::cout << "Error in Game::Init->glewInit " << glewGetErrorString( glewResult) << std::endl;
+            return false;
+        }
+        glGetError();   // glewExperimental leaves an INVALID_ENUM behind
+        if ( !offscreen.Create( width, height))
+            return false;
+        offscreen.Bind();
+        return true;
+    }
+
 // SDL_INIT_EVERYTHING |
     if(SDL_Init( SDL_WINDOW_RESIZABLE) != 0 ) {
         std::cout << "Error in Game::Init->SDL_Init" << std::endl;
@@ -59,10 +93,13 @@ int Game::InitSDL(std::string title, int width, int height) {
         return false;
     }
 
-    if (SDL_GL_SetSwapInterval(0) <0) {
-        std::cout << "Error in Game::Init->SDL_GL_SetSwapInterval < 0" << std::endl;
-        return false;
-    }
+    // the frame rate is up to vsync and the frame pacer, not a spin loop
+    int swapInterval = FramePacer::SetVSync( globals.vsync);
+    if ( swapInterval != globals.vsync)
+        std::cout << "VSync " << ( globals.vsync < 0 ? "adaptive" : "on") << " not available, it is " << ( swapInterval ? "on" : "off") << "...";
+    framePacer.Init();
+    framePacer.SetTargetRate( globals.targetFps);
+    framePacer.SetIdleRate( globals.idleFps);
 
     glewExperimental = GL_TRUE;
     glewInit();
@@ -120,28 +157,74 @@ void Game::InitControllers()
 void Game::InitData() {
     std::cout << "Initializing data...";
 
-    // Setup and compile our shaders
-    std::cout << "Shaders...";
-    shaders.insert( std::make_pair( std::string("model"), Shader( "res/shaders/model/modelLoading.vert","res/shaders/model/modelLoading.frag")) ) ;
-    shaders.insert( std::make_pair( std::string("orthomodel"), Shader( "res/shaders/model/modelLoadingOrtho.vert","res/shaders/model/modelLoadingOrtho.frag")) ) ;
-    shaders.insert( std::make_pair( std::string("skybox"), Shader( "res/shaders/cubemap/skybox.vert","res/shaders/cubemap/skybox.frag")) ) ;
+    // the models are imported on the workers while the shaders compile and the rest is set up
+    static const char* modelPaths[] = { "res/models/box/box.obj", "res/models/sphere/sphere.obj",
+                                        "res/models/humanref/humanref.obj", "res/models/compass/compass.obj" };
+    for ( auto path: modelPaths)
+        assetManager.Prefetch( path);
 
+    // Setup and compile our shaders, they are finished after the models are loaded
+    std::cout << "Shaders...";
+    ShaderCache::EnableParallelCompile();
+    // The model shader reads the packed vertex format (20 bytes per vertex)
+    shaders.insert( std::make_pair( std::string("model"), assetManager.GetShader( "res/shaders/model/modelLoadingPacked.vert", "res/shaders/model/modelLoading.frag", VERTEX_FORMAT_PACKED)) ) ;
+    shaders.insert( std::make_pair( std::string("orthomodel"), assetManager.GetShader( "res/shaders/model/modelLoadingOrtho.vert", "res/shaders/model/modelLoadingOrtho.frag")) ) ;
+    shaders.insert( std::make_pair( std::string("skybox"), assetManager.GetShader( "res/shaders/cubemap/skybox.vert", "res/shaders/cubemap/skybox.frag")) ) ;
+    shaders.insert( std::make_pair( std::string("hudblip"), assetManager.GetShader( "res/shaders/hud/blip.vert", "res/shaders/hud/blip.frag")) ) ;
+    shaders.insert( std::make_pair( std::string("terrain"), assetManager.GetShader( "res/shaders/planet/terrain.vert", "res/shaders/planet/terrain.frag")) ) ;
+    shaders.insert( std::make_pair( std::string("impostor"), assetManager.GetShader( "res/shaders/impostor/octahedral.vert", "res/shaders/impostor/octahedral.frag")) ) ;
+    shaders.insert( std::make_pair( std::string("particles"), assetManager.GetShader( "res/shaders/particles/particle.vert", "res/shaders/particles/particle.frag")) ) ;
+    shaders.insert( std::make_pair( std::string("shard"), assetManager.GetShader( "res/shaders/fracture/shard.vert", "res/shaders/fracture/shard.frag")) ) ;
+
+
+    // textures are decoded on the workers and uploaded a bit every frame
+    textureStreamer.Init();
+
+    // the planet heights are made on the workers too, a headless run waits for them to repeat itself
+    planetTerrain_enable = planetTerrain.Init();
+    planetTerrain.SetSynchronous( globals.headless);
+    particleSystem.Init();
 
     std::cout << "Loading Models...";
 
+    // All the models are drawn with the model shader, so upload them in its vertex layout
+    VertexFormat modelFormat = shaders.find( "model")->second->vertexFormat;
+
     // System objects
-    systemModels.insert( std::make_pair("collisionbox",Model( const_cast<char *>( "res/models/box/box.obj"))) );
-    systemModels.insert( std::make_pair("sphere",Model( const_cast<char *>( "res/models/sphere/sphere.obj"))) );
+    systemModels.insert( std::make_pair("collisionbox", assetManager.GetModel( "res/models/box/box.obj", modelFormat)) );
+    systemModels.insert( std::make_pair("sphere", assetManager.GetModel( "res/models/sphere/sphere.obj", modelFormat)) );
 
     // Game objects
-    gameModels.insert( std::make_pair("player",Model( const_cast<char *>( "res/models/humanref/humanref.obj"))) );
-    gameModels.insert( std::make_pair("sphere",Model( const_cast<char *>( "res/models/sphere/sphere.obj"))) );
+    gameModels.insert( std::make_pair("player", assetManager.GetModel( "res/models/humanref/humanref.obj", modelFormat)) );
+    gameModels.insert( std::make_pair("sphere", assetManager.GetModel( "res/models/sphere/sphere.obj", modelFormat)) );
 
     // HUD objects
-    hudModels.insert( std::make_pair("compass",Model( const_cast<char *>( "res/models/compass/compass.obj"))) );
+    hudModels.insert( std::make_pair("compass", assetManager.GetModel( "res/models/compass/compass.obj", modelFormat)) );
 
     std::cout << "ok\n";
-
+    assetManager.PrintTimings();
+    std::cout << "  Assets: " << assetManager.GetModelCount() << " models, " << assetManager.GetShaderCount() << " shaders, "
+              << assetManager.GetHits() << " requests shared, " << materialTable.GetMaterialCount() << " materials of "
+              << materialTable.GetTextureCount() << " textures\n";
+    // every model texture is known now, one texture array per format and size
+    texturePacker.Build();
+    // the planets break up in these, cut on the workers while the rest loads
+    fractureCache.Request( gameModels.find( "sphere")->second.get(), 24, 1);
+    // that took its copy, nothing else reads the vertices on the CPU (the collisions only use the bounds)
+    std::cout << "  Released " << assetManager.ReleaseGeometry() / 1024 << " KB of CPU geometry\n";
+
+    // the driver had the whole model loading to compile them
+    auto linkStart = std::chrono::steady_clock::now();
+    for ( auto& shader: shaders)
+        shader.second->FinishLink();
+    std::cout << "  Shaders: " << shaders.size() << " programs, " << shaderCache.GetHits() << " from the binary cache, waited "
+              << std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - linkStart).count() << " ms for the links"
+              << ( ShaderCache::IsSupported() ? "" : " (no program binaries on this driver)") << "\n";
+    std::cout << "  Mesh arena: " << meshArena.GetVertexBytes( modelFormat) / 1024 << " KB vertices ("
+        << VertexFormatStride( modelFormat) << " bytes/vertex), " << meshArena.GetIndexBytes( modelFormat) / 1024 << " KB indices\n";
+
+    // Simplified occluder mesh for the planets, all its triangles lie inside the unit sphere
+    OcclusionBuffer::BuildSphereOccluder( 0.98f, 8, 12, occluderVertices, occluderIndices);
 
     SetSpawnPoint( glm::vec3(9.0f, 1.65f, 10.0f));
     camera.SetPosition( GetSpawnPoint());
@@ -150,6 +233,42 @@ void Game::InitData() {
     InitGameObjects();
     InitHUDObjects();
 
+    // the coarsest terrain of every planet, so they never show up without it
+    if ( planetTerrain_enable) {
+        int planetCount = 0;
+        for ( size_t i = 0; i < gameObjects.size(); ++i)
+            if ( gameObjects[i].GetOccluder()) {
+                planetTerrain.Prepare( (unsigned int)i);
+                // and the colours of its shards for when it breaks
+                fractureCache.RequestTerrain( gameModels.find( "sphere")->second.get(), (unsigned int)i);
+                planetCount++;
+            }
+
+        // and their impostors for when they are only a few pixels, one per palette entry.
+        // What doesn't fit in the atlas gets none and is drawn as terrain all the way out.
+        impostorAtlas.Init( std::min( planetCount, impostorPalette));
+        planetImpostors.assign( gameObjects.size(), -1);
+        std::vector<int> palette( std::max( 1, impostorAtlas.GetCount()), -1);
+        Shader& terrain = *shaders.find( "terrain")->second;
+        terrain.Use();
+        terrain.setBool( "impostor_bake", true);
+        int planet = 0;
+        for ( size_t i = 0; i < gameObjects.size(); ++i) {
+            if ( !gameObjects[i].GetOccluder())
+                continue;
+            int& layer = palette[planet++ % palette.size()];
+            if ( layer < 0)
+                layer = impostorAtlas.Bake( 1.0f + planetTerrain.amplitude, [&]( const glm::mat4& view, const glm::mat4& projection) {
+                    planetTerrain.Begin( view, projection, (float)ImpostorAtlas::FRAME_SIZE, 0);
+                    planetTerrain.Add( glm::mat4( 1.0f), (unsigned int)i);
+                    planetTerrain.Draw( terrain, false);
+                });
+            planetImpostors[i] = layer;
+        }
+        terrain.Use();
+        terrain.setBool( "impostor_bake", false);
+    }
+
     // initialise the players config,   this will evaporate at some point....
     playerTRS.translate = camera.GetPosition();         // Translate
     playerTRS.rotate = glm::vec3(0.0f, 0.0f, 0.0f);     // Rotate
@@ -187,7 +306,7 @@ void Game::InitData() {
     faces.emplace_back( "res/images/skybox/stars/back.png"   );
     faces.emplace_back( "res/images/skybox/stars/front.png"  );
 
-    skybox.LoadCubemap( faces, GL_RGBA);
+    skybox.LoadCubemap( faces);
 }
 
 
@@ -204,15 +323,15 @@ void Game::InitSystemObjects() {
         obj.SetViewMatrix( camera.GetViewMatrix());
         obj.SetProjectionMatrix(globals.projectionMatrix);
         obj.SetCenter( glm::vec3(
-            abs( mItr->second.GetMaxValue().x - mItr->second.GetMinValue().x)/2,
-            abs( mItr->second.GetMaxValue().y - mItr->second.GetMinValue().y)/2,
-            abs( mItr->second.GetMaxValue().z - mItr->second.GetMinValue().z)/2
+            abs( mItr->second->GetMaxValue().x - mItr->second->GetMinValue().x)/2,
+            abs( mItr->second->GetMaxValue().y - mItr->second->GetMinValue().y)/2,
+            abs( mItr->second->GetMaxValue().z - mItr->second->GetMinValue().z)/2
             ) );
 
         obj.SetColliderBoxDimentions( glm::vec3(
-             mItr->second.GetMaxValue().x - mItr->second.GetMinValue().x,
-             mItr->second.GetMaxValue().y - mItr->second.GetMinValue().y,
-             mItr->second.GetMaxValue().z - mItr->second.GetMinValue().z
+             mItr->second->GetMaxValue().x - mItr->second->GetMinValue().x,
+             mItr->second->GetMaxValue().y - mItr->second->GetMinValue().y,
+             mItr->second->GetMaxValue().z - mItr->second->GetMinValue().z
             ) );
         obj.SetPosition(glm::vec3( 0.0f, 0.0f, 0.0f));
         obj.SetRenderable(false);
@@ -220,8 +339,8 @@ void Game::InitSystemObjects() {
             obj.SetRenderable(false);
             std::cout << "Playground: (" << obj.GetColliderBoxDimentions().x << "," << obj.GetColliderBoxDimentions().y <<"," << obj.GetColliderBoxDimentions().z << ")\n";
         }
-        obj.SetModel( &mItr->second);
-        obj.SetShader( &myShader->second);
+        obj.SetModel( mItr->second.get());
+        obj.SetShader( myShader->second.get());
         obj.SetCollider(false);
         obj.DetachCamera();
 
@@ -232,7 +351,7 @@ void Game::InitSystemObjects() {
 
 float floatrand()
 {
-    static std::mt19937 rng_engine( (unsigned)time(nullptr) );
+    static std::mt19937 rng_engine( globals.randomSeed != 0 ? globals.randomSeed : (unsigned)time(nullptr) );
     static std::uniform_real_distribution<float> distribution;
 
     return distribution(rng_engine);
@@ -257,15 +376,15 @@ void Game::InitGameObjects() {
         obj.SetCollider( true);
         obj.SetStatus( obj.ALIVE);
         obj.SetCenter( glm::vec3(
-            abs( mItr->second.GetMaxValue().x - mItr->second.GetMinValue().x)/2,
-            abs( mItr->second.GetMaxValue().y - mItr->second.GetMinValue().y)/2,
-            abs( mItr->second.GetMaxValue().z - mItr->second.GetMinValue().z)/2
+            abs( mItr->second->GetMaxValue().x - mItr->second->GetMinValue().x)/2,
+            abs( mItr->second->GetMaxValue().y - mItr->second->GetMinValue().y)/2,
+            abs( mItr->second->GetMaxValue().z - mItr->second->GetMinValue().z)/2
             ) );
 
         obj.SetColliderBoxDimentions( glm::vec3(
-             mItr->second.GetMaxValue().x - mItr->second.GetMinValue().x,
-             mItr->second.GetMaxValue().y - mItr->second.GetMinValue().y,
-             mItr->second.GetMaxValue().z - mItr->second.GetMinValue().z
+             mItr->second->GetMaxValue().x - mItr->second->GetMinValue().x,
+             mItr->second->GetMaxValue().y - mItr->second->GetMinValue().y,
+             mItr->second->GetMaxValue().z - mItr->second->GetMinValue().z
             ) );
 
         if ( mItr->first == "player") {
@@ -278,8 +397,9 @@ void Game::InitGameObjects() {
             obj.SetRenderable( true);
 
 
-        obj.SetModel( &mItr->second);
-        obj.SetShader( &myShader->second);
+        obj.SetModel( mItr->second.get());
+        obj.SetShader( myShader->second.get());
+        obj.SetOccluder( mItr->first == "sphere");
 
         // Make 10 of each sphere object
         if ( mItr->first == "sphere") {
@@ -328,11 +448,22 @@ void Game::InitHUDObjects() {
             obj.SetPosition(glm::vec3( 1.0f, -1.0f, 0.0f));
         obj.SetCollider(false);
 
-        obj.SetModel( &mItr->second);
-        obj.SetShader( &myShader->second);
+        obj.SetModel( mItr->second.get());
+        obj.SetShader( myShader->second.get());
 
         hudObjects.push_back(obj);
     }
+
+    // Resolve the radar and compass resources once, not every frame
+    auto blipShader = shaders.find( "hudblip");
+    auto compassModel = hudModels.find( "compass");
+    auto sphereModel = systemModels.find( "sphere");
+    if ( blipShader == shaders.end() || compassModel == hudModels.end() || sphereModel == systemModels.end()) {
+        std::cout << "Could not find the HUD shaders/models" << endl;
+        return;
+    }
+    hudBlipRadius = ( sphereModel->second->GetMaxValue().x - sphereModel->second->GetMinValue().x) / 2.0f;
+    hud.Init( myShader->second.get(), compassModel->second.get(), blipShader->second.get());
 }
 
 
@@ -358,11 +489,15 @@ void Game::InitCamera() {
 
 bool Game::InitGL()
 {
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
+    glState.Enable(GL_DEPTH_TEST);
+    // LEQUAL for everything, so the skybox doesn't have to switch back and forth
+    glState.DepthFunc(GL_LEQUAL);
+    glState.Enable(GL_CULL_FACE);
     glCullFace(GL_BACK);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glState.Enable(GL_BLEND);
+    glState.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // the radar blips set their own size
+    glState.Enable(GL_PROGRAM_POINT_SIZE);
 
     GLfloat fov = 65.f;
     GLfloat nearPlane = 0.1f;
@@ -378,6 +513,11 @@ bool Game::InitGL()
 
     // set the world matrix
     globals.worldMatrix = glm::mat4(1.f);
+
+    // the scene resolution follows the GPU time, unless it was given on the command line
+    if ( !dynamicResolution.Init( globals.screenwidth, globals.screenheight))
+        return false;
+    dynamicResolution.SetFixedScale( globals.renderScale);
 	return true;
 }
 
@@ -391,12 +531,25 @@ void Game::Timing()
 	// Our time per frame coefficient
 	dt = elapsedTime.count();
 
+	// Headless runs step the simulation at a fixed 60Hz so the frames are the same on every machine
+	if ( globals.headless) {
+		if ( frameNumber > 0)
+			frameTimes.push_back( dt);
+		dt = 1.0f / 60.0f;
+		return;
+	}
+
 	fFrameTimer += dt;
 	nFrameCount++;
 	if (fFrameTimer >= 1.0f)
 	{
 		fFrameTimer -= 1.0f;
-		std::string sTitle = titleHeader + " - FPS: " + std::to_string(nFrameCount) + " / " + std::to_string(dt*1000) + "ms";
+		PacingStats pacing = framePacer.TakeRecentStats();
+		std::string sTitle = titleHeader + " - FPS: " + std::to_string(nFrameCount) + " / " + std::to_string(dt*1000) + "ms"
+            + " - Culled: " + std::to_string(occlusionBuffer.GetCulledCount()) + "/" + std::to_string(occlusionBuffer.GetTestedCount())
+            + " - GL calls: " + std::to_string(glState.GetCallsIssued()) + " saved: " + std::to_string(glState.GetCallsSaved())
+            + " - Scale: " + std::to_string((int)(dynamicResolution.GetScale() * 100.0f + 0.5f)) + "% (" + std::to_string(dynamicResolution.GetGPUTime()) + "ms GPU)"
+            + " - Jitter: " + std::to_string(pacing.JitterMs()) + "ms" + (framePacer.IsIdle() ? " (idle)" : "");
         SDL_SetWindowTitle(sdlWindow, sTitle.c_str());
 		nFrameCount = 0;
 	}
@@ -410,7 +563,9 @@ void Game::HandleEvents()
     // SDL Events
     if (events.sdlEvents.ScreenResize)  {
         glViewport(0, 0, globals.screenwidth, globals.screenheight);
+        dynamicResolution.Resize( globals.screenwidth, globals.screenheight);
     }
+    framePacer.SetIdle( !events.sdlEvents.Focused || events.sdlEvents.Minimized);
 
     // Key Events
     if ( events.keys.Esc) {
@@ -639,16 +794,25 @@ void Game::Update()
     }
 
     camera.ProcessInertia( dt);
+
+    particleSystem.Update( dt);
+    fractureCache.Simulate( dt);
 }
 
 
 void Game::RenderModels()
 {
     GameObject *gO = nullptr;
+    glm::mat4 view = camera.GetViewMatrix( );
+    glm::vec3 cameraPos = camera.GetPosition();
+
+    // Stage 1, build the draw packets. The game objects are split in one chunk per worker
+    // (and one for this thread), every chunk writes its own bucket, the last bucket is the system objects.
+    unsigned int chunks = threadPool.GetThreadCount() + 1;
+    drawList.Begin( chunks + 1);
 
-    // Draw the system objects
     for ( auto &go: systemObjects) {
-        go.SetViewMatrix(camera.GetViewMatrix( ));
+        go.SetViewMatrix( view);
 
         if ( go.GetName() == "ground_small")
             go.SetPosition( glm::vec3(0.0f));
@@ -657,17 +821,75 @@ void Game::RenderModels()
         if ( go.GetName() == "collisionbox")
             gO = &go;
 
-        if ( go.GetRenderable())
-            go.Draw(drawLineMode_enable);
+        if ( go.GetRenderable()) {
+            DrawPacket packet;
+            go.BuildDrawPacket( packet, drawLineMode_enable, cameraPos);
+            drawList.Add( chunks, packet);
+        }
     }
 
+    // Skip the game objects hidden behind the nearest planets, the buffer is only read from here on
+    BuildOcclusionBuffer();
+    glm::mat4 viewProjection = globals.projectionMatrix * view;
+    size_t objectCount = gameObjects.size();
+    threadPool.ParallelFor( chunks, [&]( unsigned int chunk) {
+        size_t first = objectCount * chunk / chunks;
+        size_t last = objectCount * ( chunk + 1) / chunks;
+        for ( size_t i = first; i < last; ++i) {
+            GameObject& go = gameObjects[i];
+            go.SetViewMatrix( view);
+            if ( !go.GetRenderable() || ( planetTerrain_enable && go.GetOccluder()))
+                continue;
+
+            if ( occlusionCulling_enable) {
+                glm::vec3 boundsMin, boundsMax;
+                go.GetBounds( boundsMin, boundsMax);
+                if ( !occlusionBuffer.IsVisible( boundsMin, boundsMax, viewProjection))
+                    continue;
+            }
+            DrawPacket packet;
+            go.BuildDrawPacket( packet, drawLineMode_enable, cameraPos);
+            drawList.Add( chunk, packet);
+        }
+    });
+
+    // Stage 2, merge, sort and draw on this (the GL) thread
+    drawList.Submit( view, globals.projectionMatrix);
+    glState.PolygonMode( drawLineMode_enable ? GL_LINE : GL_FILL);
+
+    // Stage 3, the planets. The terrain picks the detail for the scaled resolution it ends up at.
+    if ( planetTerrain_enable) {
+        float viewportHeight = globals.screenheight * dynamicResolution.GetScale();
+        float pixelsPerUnit = viewportHeight * globals.projectionMatrix[1][1] * 0.5f;
+        planetTerrain.Begin( view, globals.projectionMatrix, viewportHeight);
+        impostorAtlas.Begin();
+        for ( size_t i = 0; i < gameObjects.size(); ++i) {
+            GameObject& go = gameObjects[i];
+            if ( !go.GetRenderable() || !go.GetOccluder())
+                continue;
+            if ( occlusionCulling_enable) {
+                glm::vec3 boundsMin, boundsMax;
+                go.GetBounds( boundsMin, boundsMax);
+                if ( !occlusionBuffer.IsVisible( boundsMin, boundsMax, viewProjection))
+                    continue;
+            }
 
-    // Draw the game objects
-    for ( auto &go: gameObjects) {
-        go.SetViewMatrix(camera.GetViewMatrix( ));
-        if ( go.GetRenderable())
-            go.Draw(drawLineMode_enable);
+            // the terrain's part, by the radius on the screen
+            float fade = 1.0f;
+            if ( planetImpostors[i] >= 0) {
+                float pixels = go.GetScale().x * pixelsPerUnit / std::max( glm::length( go.GetPosition() - cameraPos), 0.001f);
+                fade = glm::clamp( ( pixels - impostorPixels) / impostorPixels, 0.0f, 1.0f);
+            }
+            glm::mat4 model = go.ComputeModelMatrix();
+            if ( fade < 1.0f)
+                impostorAtlas.Add( model, planetImpostors[i], fade);
+            if ( fade > 0.0f)
+                planetTerrain.Add( model, (unsigned int)i, fade);
+        }
+        planetTerrain.Draw( *shaders.find( "terrain")->second, drawLineMode_enable);
+        impostorAtlas.Draw( *shaders.find( "impostor")->second, view, globals.projectionMatrix, planetTerrain.sunDirection);
     }
+    fractureCache.Draw( *shaders.find( "shard")->second, view, globals.projectionMatrix, planetTerrain.sunDirection);
 
 
     // draw the bounding boxes in wireframe
@@ -685,11 +907,10 @@ void Game::RenderModels()
                 gO->SetWireframe( true);
                 gO->SetColliderBoxWireframeThickness(1.0f);
                 gO->Draw(drawLineMode_enable);
-                if ( !drawLineMode_enable)
-                    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
             }
 
         }
+        glState.PolygonMode( drawLineMode_enable ? GL_LINE : GL_FILL);
     }
 
 
@@ -714,6 +935,19 @@ void Game::RenderModels()
                     objCollidedWith->SetStatus(objCollidedWith->DEAD);
                     objCollidedWith->SetCollider(false);
                     objCollidedWith->SetWireframe(true);
+                    // planets go up in a cloud of debris
+                    if ( objCollidedWith->GetOccluder()) {
+                        particleSystem.Explode( objCollidedWith->GetPosition(), objCollidedWith->GetScale().x);
+                        if ( planetTerrain_enable) {
+                            // what's on screen is the terrain: its radius with the mountains, its colours
+                            glm::mat4 model = glm::scale( objCollidedWith->ComputeModelMatrix(), glm::vec3( 1.0f + planetTerrain.amplitude));
+                            unsigned int seed = (unsigned int)( objCollidedWith - &gameObjects[0]);
+                            fractureCache.Shatter( objCollidedWith->GetModel(), model, glm::vec3( 0.0f), (int)seed);
+                            planetTerrain.Remove( seed);
+                        }
+                        else
+                            fractureCache.Shatter( objCollidedWith->GetModel(), objCollidedWith->ComputeModelMatrix(), glm::vec3( 0.0f));
+                    }
                 }
             }
         }
@@ -727,19 +961,45 @@ void Game::RenderModels()
 
     // Skybox
     shaderItr = shaders.find( "skybox"); if ( shaderItr  == shaders.end()) { std::cout << "Could not find shader model" << endl; }
-    shaderItr->second.Use();
-    shaderItr->second.setMat4("view", glm::mat3(camera.GetViewMatrix( )) ); // Remove any translation component of the view matrix
-    shaderItr->second.setMat4("projection",  globals.projectionMatrix);
+    shaderItr->second->Use();
+    shaderItr->second->setMat4("view", glm::mat3(camera.GetViewMatrix( )) ); // Remove any translation component of the view matrix
+    shaderItr->second->setMat4("projection",  globals.projectionMatrix);
     skybox.RenderSkyBox();
 
+    // last, they are see-through
+    particleSystem.Draw( *shaders.find( "particles")->second, view, globals.projectionMatrix, globals.screenheight * dynamicResolution.GetScale());
+}
 
-    // Draw ortho gui
-    PlotObjectsOnCompass( -camera.GetYaw(), glm::vec3(0.02f));
-    // Draw compass: direction, scale, position
-    DrawCompass( -camera.GetYaw());
 
-}
 
+// Rasterize the nearest occluders into the CPU depth buffer
+void Game::BuildOcclusionBuffer()
+{
+    occlusionBuffer.Clear();
+    if ( !occlusionCulling_enable)
+        return;
+
+    // Pick the nearest ones, they cover the most of the screen
+    std::vector<std::pair<float, GameObject*>> occluders;
+    glm::vec3 cameraPos = camera.GetPosition();
+    for ( auto &go: gameObjects)
+        if ( go.GetOccluder() && go.GetRenderable())
+            occluders.push_back( std::make_pair( glm::length2( go.GetPosition() - cameraPos), &go));
+
+    unsigned int count = std::min( maxOccluders, (unsigned int)occluders.size());
+    std::partial_sort( occluders.begin(), occluders.begin() + count, occluders.end());
+
+    glm::mat4 viewProjection = globals.projectionMatrix * camera.GetViewMatrix( );
+    for ( unsigned int i = 0; i < count; ++i) {
+        GameObject* go = occluders[i].second;
+        // The occluder is a unit sphere, stretch it to the inside of the collider box
+        glm::mat4 model = glm::translate( glm::mat4(1.0f), go->GetPosition());
+        model = glm::scale( model, go->GetCenter() * go->GetScale());
+        occlusionBuffer.AddOccluder( occluderVertices, occluderIndices, viewProjection * model);
+    }
+
+    occlusionBuffer.Rasterize();
+}
 
 
 /*
@@ -763,12 +1023,6 @@ void Game::RenderModels()
 void Game::PlotObjectsOnCompass( float direction, glm::vec3 scale, glm::vec3 pos, const float showRange) {
     float deleteme = direction+0.001f;deleteme += 0.00001f; // shut up compiler!!! I will use it sometime...
 
-    shaderItr = shaders.find( "model"); if ( shaderItr  == shaders.end()) { std::cout << "Could not find shader modelLoadingOrtho" << endl; }
-    obj.SetShader( &shaderItr->second);
-
-    modelItr = systemModels.find("sphere"); if ( modelItr == systemModels.end()) { std::cout << "Could not find ortho test model box " << endl; }
-    obj.SetName( modelItr->first);
-    obj.SetModel( &modelItr->second);
     glm::mat4 orthoMat4 = glm::ortho(
         -2.0f,  // left
         2.0f,   // right
@@ -776,38 +1030,27 @@ void Game::PlotObjectsOnCompass( float direction, glm::vec3 scale, glm::vec3 pos
         1.5f,   // top
         -1.0f, 1.0f // near, far
         );
-    obj.SetPosition( glm::vec3(0.0f));
-    obj.SetViewMatrix( glm::mat4(1.0f));
-    obj.SetModelMatrix( glm::mat4(1.0f));
-    // obj.SetScale( glm::vec3(0.05f));
-    obj.SetScale(scale);
-    obj.SetRenderable(true);
-
 
-    glm::mat4 projMat4 = orthoMat4;
+    // Collect all the objects in range, they are drawn with one draw call
+    hud.BeginBlips();
     for ( auto& go: gameObjects) {
         glm::vec3 vecToObj = player->GetPosition() - go.GetPosition();
         float dist = glm::length2( vecToObj);
 
         if ( dist < showRange && go.GetRenderable() && &go != player) {
-            projMat4 = orthoMat4;
-
             glm::vec3 tmpVec3;
             tmpVec3.x = vecToObj.x/200.0f*2.0f;
             tmpVec3.y = vecToObj.z/200.0f*1.5f;
             tmpVec3.z = 0.5f;   // Draw the radar object over the compass
 
-            // plot the object
-            projMat4 = glm::translate( projMat4, tmpVec3);
-
-            // Move the origin to the radar position
-            projMat4 = glm::translate(projMat4, pos);
-            obj.SetProjectionMatrix( projMat4);
-
-            obj.Draw(drawLineMode_enable);
+            // plot the object, moved to the radar position
+            hud.AddBlip( tmpVec3 + pos);
        }
-
     }
+
+    // the ortho space is 4 units wide, so this is the blip's diameter in pixels
+    float pointSize = 2.0f * hudBlipRadius * scale.x / 4.0f * globals.screenwidth;
+    hud.DrawBlips( orthoMat4, pointSize);
 }
 
 
@@ -826,19 +1069,8 @@ void Game::DrawCompass( float direction, glm::vec3 scale, glm::vec3 pos) {
         1.5f,   // top
         -1.0f, 1.0f // near, far
         );
-    obj.SetViewMatrix( glm::mat4(1.0f));
-    obj.SetModelMatrix( glm::mat4(1.0f));
-
-    shaderItr = shaders.find( "model"); if ( shaderItr  == shaders.end()) { std::cout << "Could not find shader modelLoadingOrtho" << endl; }
-    obj.SetShader( &shaderItr->second);
-
-    modelItr = hudModels.find( "compass"); if ( modelItr == hudModels.end()) { std::cout << "Could not find ortho test model box " << endl; }
-    obj.SetName( modelItr->first);
-    obj.SetModel( &modelItr->second);
 
     glm::mat4 modelMat4 = orthoMat4;
-    // scale the compass down to a given size
-    obj.SetScale( scale);
 
     // modelMat4 = glm::translate(modelMat4, glm::vec3( 1.0f, -1.0f, 0.0f));
     modelMat4 = glm::translate(modelMat4, pos);
@@ -850,9 +1082,8 @@ void Game::DrawCompass( float direction, glm::vec3 scale, glm::vec3 pos) {
     // Rotate the compass to the direction of the camera Yaw
     modelMat4 = glm::rotate(modelMat4, glm::radians( direction), glm::vec3( 0.0f, 0.0f, 1.0f) );
 
-    obj.SetProjectionMatrix( modelMat4);
-
-    obj.Draw(drawLineMode_enable);
+    // scale the compass down to a given size
+    hud.DrawCompass( modelMat4, scale, drawLineMode_enable);
 }
 
 void Game::Clear( glm::vec4 col)
@@ -863,17 +1094,31 @@ void Game::Clear( glm::vec4 col)
 
 void Game::Render()
 {
+    glState.BeginFrame();
+    // whatever textures have been decoded since the last frame, within the frame's upload budget
+    textureStreamer.Update();
+    planetTerrain.Update();
+    fractureCache.Update();
+
+    // the scene at the resolution the GPU time allows
+    dynamicResolution.BeginScene( globals.headless ? offscreen.GetFBO() : 0);
     Clear( glm::vec4(0.1f, 0.0f, 0.0f,1.0f));
     RenderModels();
+    dynamicResolution.EndScene();
+
+    // Draw ortho gui, always at the window resolution
+    PlotObjectsOnCompass( -camera.GetYaw(), glm::vec3(0.02f));
+    // Draw compass: direction, scale, position
+    DrawCompass( -camera.GetYaw());
 }
 
 
 void Game::toggleLineMode() {
     drawLineMode_enable = !drawLineMode_enable;
     if ( drawLineMode_enable) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        glState.PolygonMode( GL_LINE);
     } else {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        glState.PolygonMode( GL_FILL);
     }
 }
 
@@ -886,38 +1131,168 @@ int Game::Run()
 	tp2 = std::chrono::system_clock::now();
 
     Timing();
-    InitControllers();
+    if ( !globals.headless)
+        InitControllers();
     InitData();
     InitCamera();
+    // the benchmark measures the game, not the loading, and every run dumps the same frames
+    if ( globals.headless) {
+        textureStreamer.Finish();
+        fractureCache.Finish();
+    }
 
     // MAIN GAME LOOP
     std::cout << "Running engine..." << endl;
     while(globals.m_gameRunning)
     {
         Timing();
+        if ( globals.headless) {
+            Update();
+            Render();
+            EndHeadlessFrame();
+            continue;
+        }
         HandleEvents();
         Update();   // UPDATE game logic
+        // nothing to see when minimized, only keep the game going at the idle rate
+        if ( events.sdlEvents.Minimized) {
+            framePacer.Wait();
+            continue;
+        }
         Render();   // RENDER it
+        framePacer.Wait();  // until it is time for this frame
         SDL_GL_SwapWindow(sdlWindow);   // NO rendering after this point ---
         // glFinish();       // @SlicEnDicE, but if you run into issues and get graphics glitches use either glflush or glfinish
+        if ( globals.benchmarkFrames > 0 && ++frameNumber >= globals.benchmarkFrames)
+            globals.m_gameRunning = false;
     }
     std::cout << "Engine exiting..." << endl;
+    if ( !globals.headless) {
+        const PacingStats& pacing = framePacer.GetStats();
+        std::cout << "Frame pacing: " << pacing.frames << " frames, avg " << pacing.AverageMs() << "ms, jitter " << pacing.JitterMs()
+                  << "ms, " << pacing.missed << " late (worst " << pacing.LateMaxMs() << "ms)" << endl;
+    }
     return globals.m_gameRunning;
 }
 
 
+// Nothing is presented, so wait for the GPU here to have honest frame times, and dump the frame
+void Game::EndHeadlessFrame()
+{
+    glFinish();
+
+    if ( !globals.dumpFramesDir.empty()) {
+        char name[32];
+        snprintf( name, sizeof( name), "/frame_%05d.png", frameNumber);
+        offscreen.SavePNG( globals.dumpFramesDir + name);
+    }
+
+    if ( ++frameNumber < globals.benchmarkFrames)
+        return;
+
+    globals.m_gameRunning = false;
+    if ( frameTimes.empty())
+        return;
+
+    // the first frame carries the loading time, Timing() doesn't record it
+    float total = 0.0f;
+    float fastest = frameTimes[0];
+    float slowest = frameTimes[0];
+    for ( float t : frameTimes) {
+        total += t;
+        fastest = std::min( fastest, t);
+        slowest = std::max( slowest, t);
+    }
+    std::vector<float> sorted = frameTimes;
+    std::sort( sorted.begin(), sorted.end());
+    float average = total / frameTimes.size();
+    std::cout << "Benchmark: " << frameTimes.size() << " frames at " << offscreen.GetWidth() << "x" << offscreen.GetHeight()
+              << ", avg " << average * 1000.0f << "ms (" << 1.0f / average << " fps)"
+              << ", min " << fastest * 1000.0f << "ms"
+              << ", median " << sorted[sorted.size() / 2] * 1000.0f << "ms"
+              << ", 99% " << sorted[sorted.size() * 99 / 100] * 1000.0f << "ms"
+              << ", max " << slowest * 1000.0f << "ms" << std::endl;
+    std::cout << "GL state calls last frame: " << glState.GetCallsIssued() << " issued, " << glState.GetCallsSaved() << " saved" << std::endl;
+}
+
+
+// Drop our handles while there is still a context, the last one frees the model or program
+void Game::ReleaseAssets()
+{
+    hudObjects.clear();
+    gameObjects.clear();
+    systemObjects.clear();
+    player = nullptr;
+    hudModels.clear();
+    gameModels.clear();
+    systemModels.clear();
+    shaders.clear();
+}
+
+
 // Housework
 void Game::CleanUp()
 {
     std::cout << "Cleaning up before exiting...\n";
 
-	std::cout << "  SDL Closing Controllers...";
-    if (SDL_JoystickGetAttached(events.m_controller.m_joystick)) {
-        SDL_JoystickClose(events.m_controller.m_joystick);
-		std::cout << "Joystick released...";
+    if ( !globals.headless) {
+        std::cout << "  SDL Closing Controllers...";
+        if (SDL_JoystickGetAttached(events.m_controller.m_joystick)) {
+            SDL_JoystickClose(events.m_controller.m_joystick);
+            std::cout << "Joystick released...";
+        }
+        std::cout << "ok\n";
     }
+
+    // The GL resources, the same with or without a window, while the context is still there
+
+	std::cout << "  Releasing HUD...";
+    hud.CleanUp();
+	std::cout << "ok\n";
+
+	std::cout << "  Releasing mesh arena...";
+    meshArena.CleanUp();
+	std::cout << "ok\n";
+
+	std::cout << "  Releasing planet terrain...";
+    planetTerrain.CleanUp();
+    impostorAtlas.CleanUp();
+	std::cout << "ok\n";
+
+	std::cout << "  Releasing particles...";
+    particleSystem.CleanUp();
+    fractureCache.CleanUp();
 	std::cout << "ok\n";
 
+	std::cout << "  Releasing models and shaders...";
+    ReleaseAssets();
+	std::cout << "ok\n";
+
+	std::cout << "  Releasing texture streamer...";
+    textureStreamer.CleanUp();
+	std::cout << "ok\n";
+
+	std::cout << "  Releasing texture arrays...";
+    texturePacker.CleanUp();
+    materialTable.CleanUp();
+	std::cout << "ok\n";
+
+	std::cout << "  Releasing scene framebuffer...";
+    dynamicResolution.CleanUp();
+	std::cout << "ok\n";
+
+    // Then the context itself
+    if ( globals.headless) {
+        std::cout << "  Releasing offscreen context...";
+        offscreen.Destroy();
+        headlessContext.Destroy();
+        std::cout << "ok\n";
+        std::cout << "Cleanup complete" << std::endl;
+        return;
+    }
+
+    framePacer.CleanUp();
+
 	std::cout << "  SDL GL Deleting Context...";
     SDL_GL_DeleteContext(sdlGLContext);
 	std::cout << "  ok\n";
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+
+#include "Headless.hpp"
+
+#ifndef _WIN32
+    #include <EGL/eglext.h>
+#endif
+
+
+#ifdef _WIN32
+
+bool HeadlessContext::Create( int width, int height)
+{
+    if ( SDL_Init( SDL_INIT_VIDEO) != 0) {
+        std::cout << "Error in HeadlessContext::Create->SDL_Init " << SDL_GetError() << std::endl;
+        return false;
+    }
+    SDL_GL_SetAttribute( SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+    SDL_GL_SetAttribute( SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+    SDL_GL_SetAttribute( SDL_GL_CONTEXT_MINOR_VERSION, 3);
+
+    window = SDL_CreateWindow( "headless", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    if ( window == nullptr) {
+        std::cout << "Error in HeadlessContext::Create->SDL_CreateWindow " << SDL_GetError() << std::endl;
+        return false;
+    }
+    context = SDL_GL_CreateContext( window);
+    if ( context == nullptr) {
+        std::cout << "Error in HeadlessContext::Create->SDL_GL_CreateContext " << SDL_GetError() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void HeadlessContext::Destroy()
+{
+    if ( context != nullptr)
+        SDL_GL_DeleteContext( context);
+    if ( window != nullptr)
+        SDL_DestroyWindow( window);
+    context = nullptr;
+    window = nullptr;
+    SDL_Quit();
+}
+
+#else
+
+bool HeadlessContext::Create( int width, int height)
+{
+    EGLint major, minor;
+
+    // Prefer the surfaceless platform, it needs no X server and no GPU device at all
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress( "eglGetPlatformDisplayEXT");
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    if ( getPlatformDisplay != nullptr)
+        display = getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+#endif
+    if ( display == EGL_NO_DISPLAY || !eglInitialize( display, &major, &minor)) {
+        display = eglGetDisplay( EGL_DEFAULT_DISPLAY);
+        if ( display == EGL_NO_DISPLAY || !eglInitialize( display, &major, &minor)) {
+            std::cout << "Error in HeadlessContext::Create->eglInitialize" << std::endl;
+            return false;
+        }
+    }
+    std::cout << "EGL " << major << "." << minor << " (" << eglQueryString( display, EGL_VENDOR) << ")...";
+
+    if ( !eglBindAPI( EGL_OPENGL_API)) {
+        std::cout << "Error in HeadlessContext::Create->eglBindAPI, no desktop OpenGL" << std::endl;
+        return false;
+    }
+
+    // The pixel format doesn't matter much, we render into our own framebuffer object
+    EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+        EGL_DEPTH_SIZE, 24,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    if ( !eglChooseConfig( display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+        // surfaceless displays may have no pbuffer configs
+        configAttribs[1] = 0;
+        if ( !eglChooseConfig( display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+            std::cout << "Error in HeadlessContext::Create->eglChooseConfig" << std::endl;
+            return false;
+        }
+    }
+
+    EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_NONE
+    };
+    context = eglCreateContext( display, config, EGL_NO_CONTEXT, contextAttribs);
+    if ( context == EGL_NO_CONTEXT) {
+        std::cout << "Error in HeadlessContext::Create->eglCreateContext" << std::endl;
+        return false;
+    }
+
+    // Surfaceless if we can, else a pbuffer the size of the frame
+    if ( !eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        EGLint pbufferAttribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+        surface = eglCreatePbufferSurface( display, config, pbufferAttribs);
+        if ( surface == EGL_NO_SURFACE || !eglMakeCurrent( display, surface, surface, context)) {
+            std::cout << "Error in HeadlessContext::Create->eglMakeCurrent" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void HeadlessContext::Destroy()
+{
+    if ( display == EGL_NO_DISPLAY)
+        return;
+    eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if ( surface != EGL_NO_SURFACE)
+        eglDestroySurface( display, surface);
+    if ( context != EGL_NO_CONTEXT)
+        eglDestroyContext( display, context);
+    eglTerminate( display);
+    display = EGL_NO_DISPLAY;
+    context = EGL_NO_CONTEXT;
+    surface = EGL_NO_SURFACE;
+}
+
+#endif
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstddef>
+
+#include "Hud.hpp"
+#include "GLState.hpp"
+
+extern GLStateCache glState;
+
+
+void HudRenderer::Init( Shader* CompassShader, Model* CompassModel, Shader* BlipShader)
+{
+    blipShader = BlipShader;
+
+    compass.SetName( "compass");
+    compass.SetShader( CompassShader);
+    compass.SetModel( CompassModel);
+    compass.SetCollider( false);
+    compass.DetachCamera();
+    compass.SetPosition( glm::vec3( 0.0f));
+    compass.SetViewMatrix( glm::mat4( 1.0f));
+    compass.SetModelMatrix( glm::mat4( 1.0f));
+
+    glGenVertexArrays( 1, &blipVAO);
+    glGenBuffers( 1, &blipVBO);
+    glState.BindVertexArray( blipVAO);
+    glBindBuffer( GL_ARRAY_BUFFER, blipVBO);
+    glEnableVertexAttribArray( 0);
+    glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, sizeof( Blip), (void*)offsetof( Blip, position));
+    glEnableVertexAttribArray( 1);
+    glVertexAttribPointer( 1, 3, GL_FLOAT, GL_FALSE, sizeof( Blip), (void*)offsetof( Blip, color));
+    glState.BindVertexArray( 0);
+
+    initialized = true;
+}
+
+
+void HudRenderer::BeginBlips()
+{
+    blips.clear();
+}
+
+
+void HudRenderer::AddBlip( const glm::vec3& position, const glm::vec3& color)
+{
+    Blip blip;
+    blip.position = position;
+    blip.color = color;
+    blips.push_back( blip);
+}
+
+
+void HudRenderer::DrawBlips( const glm::mat4& projection, float pointSize)
+{
+    if ( !initialized || blips.empty())
+        return;
+
+    // Orphan the old storage so we never wait for the GPU to finish with last frame's blips
+    glBindBuffer( GL_ARRAY_BUFFER, blipVBO);
+    if ( (GLsizeiptr)blips.size() > blipCapacity)
+        blipCapacity = blips.size() * 2;
+    glBufferData( GL_ARRAY_BUFFER, blipCapacity * sizeof( Blip), nullptr, GL_STREAM_DRAW);
+    glBufferSubData( GL_ARRAY_BUFFER, 0, blips.size() * sizeof( Blip), blips.data());
+
+    blipShader->Use();
+    blipShader->setMat4( "projection", projection);
+    blipShader->setFloat( "pointSize", pointSize);
+
+    glState.BindVertexArray( blipVAO);
+    glDrawArrays( GL_POINTS, 0, blips.size());
+}
+
+
+void HudRenderer::DrawCompass( const glm::mat4& projectionModel, const glm::vec3& scale, bool wireframe)
+{
+    if ( !initialized)
+        return;
+
+    compass.SetScale( scale);
+    compass.SetProjectionMatrix( projectionModel);
+    compass.Draw( wireframe);
+}
+
+
+void HudRenderer::CleanUp()
+{
+    if ( !initialized)
+        return;
+    glDeleteVertexArrays( 1, &blipVAO);
+    glState.ForgetVertexArray( blipVAO);
+    glDeleteBuffers( 1, &blipVBO);
+    initialized = false;
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <iostream>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Impostor.hpp"
+#include "GLState.hpp"
+
+ImpostorAtlas impostorAtlas;
+extern GLStateCache glState;
+
+static const int ATLAS_SIZE = ImpostorAtlas::FRAMES * ImpostorAtlas::FRAME_SIZE;
+
+
+// The view direction of a frame, the frames sit on the corners of the octahedral grid.
+// impostor.frag has the same.
+static glm::vec3 FrameDirection( int x, int y)
+{
+    glm::vec2 e = glm::vec2( x, y) / (float)( ImpostorAtlas::FRAMES - 1) * 2.0f - 1.0f;
+    glm::vec3 v( e.x, e.y, 1.0f - std::fabs( e.x) - std::fabs( e.y));
+    if ( v.z < 0.0f) {
+        float vx = v.x;
+        v.x = ( 1.0f - std::fabs( v.y)) * ( vx >= 0.0f ? 1.0f : -1.0f);
+        v.y = ( 1.0f - std::fabs( vx)) * ( v.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return glm::normalize( v);
+}
+
+static glm::vec3 FrameUp( const glm::vec3& direction)
+{
+    return std::fabs( direction.y) > 0.99f ? glm::vec3( 0.0f, 0.0f, 1.0f) : glm::vec3( 0.0f, 1.0f, 0.0f);
+}
+
+
+bool ImpostorAtlas::Init( int Count)
+{
+    // one layer per object, an array can't have more than the driver allows (256 at least)
+    GLint maxLayers = 256;
+    glGetIntegerv( GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    count = std::min( Count, (int)maxLayers);
+    if ( count < Count)
+        std::cout << "\n  Impostors: room for " << count << " of " << Count << " objects, the rest have none";
+    baked = 0;
+    extents.assign( count, 1.0f);
+    if ( count == 0)
+        return true;
+
+    GLuint* arrays[2] = { &colorArray, &normalArray };
+    for ( GLuint* array: arrays) {
+        glGenTextures( 1, array);
+        glState.BindTexture( 0, GL_TEXTURE_2D_ARRAY, *array);
+        glTexImage3D( GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, ATLAS_SIZE, ATLAS_SIZE, count, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    glGenRenderbuffers( 1, &depthBuffer);
+    glBindRenderbuffer( GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, ATLAS_SIZE, ATLAS_SIZE);
+    glBindRenderbuffer( GL_RENDERBUFFER, 0);
+    glGenFramebuffers( 1, &fbo);
+
+    // a unit quad, the instances place it
+    static const GLfloat corners[8] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+    glGenVertexArrays( 1, &vao);
+    glGenBuffers( 1, &quadVBO);
+    glGenBuffers( 1, &instanceVBO);
+    glState.BindVertexArray( vao);
+    glBindBuffer( GL_ARRAY_BUFFER, quadVBO);
+    glBufferData( GL_ARRAY_BUFFER, sizeof( corners), corners, GL_STATIC_DRAW);
+    glEnableVertexAttribArray( 0);
+    glVertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof( GLfloat), (void*)0);
+
+    glBindBuffer( GL_ARRAY_BUFFER, instanceVBO);
+    glEnableVertexAttribArray( 1);
+    glVertexAttribPointer( 1, 4, GL_FLOAT, GL_FALSE, sizeof( Instance), (void*)offsetof( Instance, centerRadius));
+    glVertexAttribDivisor( 1, 1);
+    glEnableVertexAttribArray( 2);
+    glVertexAttribPointer( 2, 4, GL_FLOAT, GL_FALSE, sizeof( Instance), (void*)offsetof( Instance, rotation));
+    glVertexAttribDivisor( 2, 1);
+    glEnableVertexAttribArray( 3);
+    glVertexAttribPointer( 3, 3, GL_FLOAT, GL_FALSE, sizeof( Instance), (void*)offsetof( Instance, layerFade));
+    glVertexAttribDivisor( 3, 1);
+    glState.BindVertexArray( 0);
+
+    if ( glGetError() != GL_NO_ERROR) {
+        std::cout << "\n  Impostors: could not create the atlas";
+        return false;
+    }
+    return true;
+}
+
+
+void ImpostorAtlas::CleanUp()
+{
+    if ( colorArray != 0) {
+        glDeleteTextures( 1, &colorArray);
+        glState.ForgetTexture( colorArray);
+    }
+    if ( normalArray != 0) {
+        glDeleteTextures( 1, &normalArray);
+        glState.ForgetTexture( normalArray);
+    }
+    if ( depthBuffer != 0)
+        glDeleteRenderbuffers( 1, &depthBuffer);
+    if ( fbo != 0)
+        glDeleteFramebuffers( 1, &fbo);
+    if ( instanceVBO != 0)
+        glDeleteBuffers( 1, &instanceVBO);
+    if ( quadVBO != 0)
+        glDeleteBuffers( 1, &quadVBO);
+    if ( vao != 0) {
+        glDeleteVertexArrays( 1, &vao);
+        glState.ForgetVertexArray( vao);
+    }
+    colorArray = normalArray = depthBuffer = fbo = instanceVBO = quadVBO = vao = 0;
+    count = baked = 0;
+    instances.clear();
+}
+
+
+int ImpostorAtlas::Bake( float extent, const std::function<void( const glm::mat4& view, const glm::mat4& projection)>& draw)
+{
+    if ( baked >= count)
+        return -1;
+    int layer = baked++;
+    extents[layer] = extent;
+
+    glBindFramebuffer( GL_FRAMEBUFFER, fbo);
+    glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorArray, 0, layer);
+    glFramebufferTextureLayer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, normalArray, 0, layer);
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    static const GLenum buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers( 2, buffers);
+    if ( glCheckFramebufferStatus( GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "\n  Impostors: the bake framebuffer is incomplete";
+        glBindFramebuffer( GL_FRAMEBUFFER, 0);
+        return -1;
+    }
+
+    static const GLfloat clear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    static const GLfloat depth = 1.0f;
+    glViewport( 0, 0, ATLAS_SIZE, ATLAS_SIZE);
+    glState.DepthMask( GL_TRUE);
+    glClearBufferfv( GL_COLOR, 0, clear);
+    glClearBufferfv( GL_COLOR, 1, clear);
+    glClearBufferfv( GL_DEPTH, 0, &depth);
+
+    // orthographic, the tile is exactly the object's bounds
+    float distance = extent + 1.0f;
+    glm::mat4 projection = glm::ortho( -extent, extent, -extent, extent, 0.01f, distance * 2.0f);
+    for ( int y = 0; y < FRAMES; ++y) {
+        for ( int x = 0; x < FRAMES; ++x) {
+            glm::vec3 direction = FrameDirection( x, y);
+            glViewport( x * FRAME_SIZE, y * FRAME_SIZE, FRAME_SIZE, FRAME_SIZE);
+            draw( glm::lookAt( direction * distance, glm::vec3( 0.0f), FrameUp( direction)), projection);
+        }
+    }
+
+    glDrawBuffers( 1, buffers);
+    glBindFramebuffer( GL_FRAMEBUFFER, 0);
+    return layer;
+}
+
+
+void ImpostorAtlas::Begin()
+{
+    instances.clear();
+}
+
+
+void ImpostorAtlas::Add( const glm::mat4& model, int layer, float fade)
+{
+    if ( layer < 0 || layer >= baked)
+        return;
+    float radius = glm::length( glm::vec3( model[0]));
+    glm::quat rotation = glm::quat_cast( glm::mat3( model) / radius);
+
+    Instance instance;
+    instance.centerRadius = glm::vec4( glm::vec3( model[3]), radius);
+    instance.rotation = glm::vec4( rotation.x, rotation.y, rotation.z, rotation.w);
+    instance.layerFade = glm::vec2( (float)layer, fade);
+    instance.extent = extents[layer];
+    instances.push_back( instance);
+}
+
+
+void ImpostorAtlas::Draw( Shader& shader, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& sunDirection)
+{
+    if ( instances.empty())
+        return;
+
+    // orphaned every frame, the driver hands out a fresh one while the last is still drawn from
+    glBindBuffer( GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData( GL_ARRAY_BUFFER, instances.size() * sizeof( Instance), nullptr, GL_STREAM_DRAW);
+    glBufferSubData( GL_ARRAY_BUFFER, 0, instances.size() * sizeof( Instance), instances.data());
+
+    shader.Use();
+    glm::mat4 viewProjection = projection * view;
+    shader.setMat4( "viewProjection", viewProjection);
+    shader.setVec3( "cameraPosition", glm::vec3( glm::inverse( view)[3]));
+    shader.setVec3( "sunDirection", glm::normalize( sunDirection));
+    shader.setInt( "frames", FRAMES);
+    shader.setInt( "impostorColor", 0);
+    shader.setInt( "impostorNormal", 1);
+    glState.BindTexture( 0, GL_TEXTURE_2D_ARRAY, colorArray);
+    glState.BindTexture( 1, GL_TEXTURE_2D_ARRAY, normalArray);
+
+    glState.BindVertexArray( vao);
+    glDrawArraysInstanced( GL_TRIANGLE_STRIP, 0, 4, (GLsizei)instances.size());
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <cstdint>
+#include <cstring>
+
+#include "LZ4.hpp"
+
+static const size_t MIN_MATCH = 4;
+static const size_t LAST_LITERALS = 5;      // a block always ends in literals
+static const size_t MATCH_LIMIT = 12;       // and its last match starts at least this far from the end
+static const int HASH_BITS = 16;
+
+static uint32_t Read32( const unsigned char* p)
+{
+    uint32_t v;
+    memcpy( &v, p, sizeof( v));
+    return v;
+}
+
+static void WriteLength( std::vector<unsigned char>& out, size_t length)
+{
+    for ( ; length >= 255; length -= 255)
+        out.push_back( 255);
+    out.push_back( (unsigned char)length);
+}
+
+static void WriteSequence( std::vector<unsigned char>& out, const unsigned char* literals, size_t literalLength, size_t offset, size_t matchLength)
+{
+    size_t matchCode = matchLength >= MIN_MATCH ? matchLength - MIN_MATCH : 0;
+    out.push_back( (unsigned char)( ( literalLength < 15 ? literalLength : 15) << 4 | ( matchCode < 15 ? matchCode : 15)));
+    if ( literalLength >= 15)
+        WriteLength( out, literalLength - 15);
+    out.insert( out.end(), literals, literals + literalLength);
+    if ( matchLength == 0)
+        return;
+    out.push_back( (unsigned char)( offset & 0xff));
+    out.push_back( (unsigned char)( offset >> 8));
+    if ( matchCode >= 15)
+        WriteLength( out, matchCode - 15);
+}
+
+
+void LZ4Compress( const unsigned char* source, size_t size, std::vector<unsigned char>& out)
+{
+    out.reserve( out.size() + size + size / 255 + 16);
+    size_t anchor = 0;
+    if ( size > MATCH_LIMIT) {
+        // positions + 1, 0 is empty
+        std::vector<uint32_t> table( (size_t)1 << HASH_BITS, 0);
+        size_t position = 0;
+        while ( position + MATCH_LIMIT <= size) {
+            uint32_t sequence = Read32( source + position);
+            uint32_t hash = ( sequence * 2654435761u) >> ( 32 - HASH_BITS);
+            size_t candidate = table[hash];
+            table[hash] = (uint32_t)( position + 1);
+            if ( candidate == 0 || position + 1 - candidate > 65535 || Read32( source + candidate - 1) != sequence) {
+                ++position;
+                continue;
+            }
+            size_t match = candidate - 1;
+            size_t length = MIN_MATCH;
+            while ( position + length < size - LAST_LITERALS && source[match + length] == source[position + length])
+                ++length;
+            WriteSequence( out, source + anchor, position - anchor, position - match, length);
+            position += length;
+            anchor = position;
+        }
+    }
+    WriteSequence( out, source + anchor, size - anchor, 0, 0);
+}
+
+
+bool LZ4Decompress( const unsigned char* source, size_t size, unsigned char* destination, size_t destinationSize)
+{
+    const unsigned char* in = source;
+    const unsigned char* inEnd = source + size;
+    unsigned char* out = destination;
+    unsigned char* outEnd = destination + destinationSize;
+
+    while ( in < inEnd) {
+        unsigned int token = *in++;
+        size_t literalLength = token >> 4;
+        if ( literalLength == 15) {
+            unsigned char b;
+            do {
+                if ( in >= inEnd)
+                    return false;
+                b = *in++;
+                literalLength += b;
+            } while ( b == 255);
+        }
+        if ( literalLength > (size_t)( inEnd - in) || literalLength > (size_t)( outEnd - out))
+            return false;
+        memcpy( out, in, literalLength);
+        in += literalLength;
+        out += literalLength;
+        // the last sequence has no match
+        if ( in == inEnd)
+            break;
+
+        if ( inEnd - in < 2)
+            return false;
+        size_t offset = in[0] | ( (size_t)in[1] << 8);
+        in += 2;
+        if ( offset == 0 || offset > (size_t)( out - destination))
+            return false;
+        size_t matchLength = token & 15;
+        if ( matchLength == 15) {
+            unsigned char b;
+            do {
+                if ( in >= inEnd)
+                    return false;
+                b = *in++;
+                matchLength += b;
+            } while ( b == 255);
+        }
+        matchLength += MIN_MATCH;
+        if ( matchLength > (size_t)( outEnd - out))
+            return false;
+        // may overlap itself, byte by byte
+        const unsigned char* match = out - offset;
+        for ( size_t i = 0; i < matchLength; ++i)
+            out[i] = match[i];
+        out += matchLength;
+    }
+    return out == outEnd;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <iostream>
+
+#include "Material.hpp"
+#include "AssetManager.hpp"
+#include "FileUtils.hpp"
+
+MaterialTable materialTable;
+extern AssetManager assetManager;
+
+
+MaterialTable::MaterialTable()
+{
+    CleanUp();
+}
+
+
+MaterialId MaterialTable::Add( const std::string& directory, const std::vector<std::pair<TextureType, std::string>>& textures)
+{
+    std::array<TextureId, TEXTURE_TYPE_COUNT> key;
+    key.fill( NO_TEXTURE);
+    // the first of a type wins, the mesh never used the others
+    for ( auto& texture: textures)
+        if ( texture.first < TEXTURE_TYPE_COUNT && key[texture.first] == NO_TEXTURE)
+            key[texture.first] = InternTexture( directory + '/' + texture.second);
+
+    auto found = materialIds.find( key);
+    if ( found != materialIds.end())
+        return found->second;
+    if ( materials.size() > 0xffff) {
+        std::cout << "Too many materials, using the plain one" << std::endl;
+        return 0;
+    }
+
+    Material material;
+    for ( int i = 0; i < TEXTURE_TYPE_COUNT; ++i)
+        material.textures[i] = key[i];
+    TextureSlot diffuse = GetTextureSlot( key[TEXTURE_DIFFUSE]);
+    if ( diffuse.group >= 0) {
+        material.textureGroup = diffuse.group;
+        material.layer = diffuse.layer;
+    }
+    MaterialId id = (MaterialId)materials.size();
+    materials.push_back( material);
+    materialIds[key] = id;
+    return id;
+}
+
+
+TextureId MaterialTable::InternTexture( const std::string& path)
+{
+    if ( path.empty())
+        return NO_TEXTURE;
+    std::string canonical = CanonicalPath( path);
+    auto found = textureIds.find( canonical);
+    if ( found != textureIds.end())
+        return found->second;
+
+    TextureId id = (TextureId)paths.size();
+    paths.push_back( canonical);
+    textureIds[canonical] = id;
+    slots.push_back( assetManager.GetTexture( id));
+    return id;
+}
+
+
+void MaterialTable::CleanUp()
+{
+    materials.clear();
+    materialIds.clear();
+    paths.clear();
+    slots.clear();
+    textureIds.clear();
+
+    std::array<TextureId, TEXTURE_TYPE_COUNT> none;
+    none.fill( NO_TEXTURE);
+    Material plain;
+    for ( int i = 0; i < TEXTURE_TYPE_COUNT; ++i)
+        plain.textures[i] = NO_TEXTURE;
+    materials.push_back( plain);
+    materialIds[none] = 0;
+}
@@ -4,96 +4,131 @@
 // This tutorial series will cover how to use modern OpenGL instead of the old and deprecated Immediate Mode.
 // These tutorials are based on the work of <a href="http://learnopengl.com/">http://learnopengl.com/</a> and <a href="http://open.gl">http://open.gl/</a>.
 
+#include <cmath>
+#include <glm/gtc/packing.hpp>
+
 #include "Mesh.hpp"
+#include "GLState.hpp"
+
+extern MeshArena meshArena;
+extern GLStateCache glState;
+extern TexturePacker texturePacker;
+extern MaterialTable materialTable;
+
 
+// Octahedral encoding, the unit sphere folded out on a square -1..1
+static glm::vec2 OctEncode( glm::vec3 n)
+{
+    n /= ( std::fabs( n.x) + std::fabs( n.y) + std::fabs( n.z) + 1e-20f);
+    glm::vec2 e( n.x, n.y);
+    if ( n.z < 0.0f) {
+        e.x = ( 1.0f - std::fabs( n.y)) * ( n.x >= 0.0f ? 1.0f : -1.0f);
+        e.y = ( 1.0f - std::fabs( n.x)) * ( n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return e;
+}
 
-Mesh::Mesh( vector<Vertex> vert, vector<GLuint> indi, vector<Texture> text )
+static GLshort PackSnorm16( float v)
 {
-    vertices = vert;
-    indices = indi;
-    textures = text;
+    return (GLshort)std::lround( glm::clamp( v, -1.0f, 1.0f) * 32767.0f);
+}
+
+
+Mesh::Mesh( vector<Vertex> vert, vector<GLuint> indi, MaterialId materialId, VertexFormat format )
+{
+    // moved, not copied, the import's buffers end up here
+    vertices = std::move( vert);
+    indices = std::move( indi);
+    material = materialId;
+
+    // The diffuse texture picks the texture array, its layer goes into every vertex
+    const Material& m = materialTable.Get( material);
+    textureGroup = m.textureGroup;
+    for (auto& vertex: vertices)
+        vertex.Material = m.layer;
 
     // Now that we have all the required data, set the vertex buffers and its attribute pointers.
-    setupMesh( );
+    setupMesh( format );
+}
+
+
+size_t Mesh::ReleaseGeometry()
+{
+    size_t bytes = vertices.capacity() * sizeof( Vertex) + indices.capacity() * sizeof( GLuint);
+    // swapped out, clear() would keep the memory
+    vector<Vertex>().swap( vertices);
+    vector<GLuint>().swap( indices);
+    return bytes;
 }
 
 
 // render the mesh
 void Mesh::Draw(Shader& shader)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-
-            if ( name != "texture_diffuse")
-                std::cout << "Texture: " << name << std::endl;
-
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.Program, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        // one texture array on unit 0 (the default of every sampler uniform), the layer comes
+        // with the vertices so meshes sharing the array don't rebind anything
+        if (textureGroup >= 0)
+            glState.BindTexture(0, GL_TEXTURE_2D_ARRAY, texturePacker.GetTexture(textureGroup));
+
+        // packed positions are quantized to the mesh bounds
+        if (allocation.format == VERTEX_FORMAT_PACKED) {
+            shader.setVec3("dequantOffset", dequantOffset);
+            shader.setVec3("dequantScale", dequantScale);
         }
 
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        // draw mesh, the VAO is shared by all the meshes so it is only bound when it changes
+        meshArena.Draw(allocation);
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+void Mesh::setupMesh( VertexFormat format )
+    {
+        // suballocate the vertices and indices in the shared buffers, the vertex attribute
+        // pointers are set up once per vertex format by the arena.
+        if (format == VERTEX_FORMAT_PACKED) {
+            vector<PackedVertex> packed = packVertices();
+            allocation = meshArena.Allocate(format, packed.data(), packed.size(), indices.data(), indices.size());
+        } else
+            allocation = meshArena.Allocate(format, vertices.data(), vertices.size(), indices.data(), indices.size());
     }
 
-void Mesh::setupMesh()
+
+vector<PackedVertex> Mesh::packVertices()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-        glBindVertexArray(0);
-    }
\ No newline at end of file
+        // quantize the positions to 16 bits inside the bounds of this mesh
+        glm::vec3 minPos(1e30f), maxPos(-1e30f);
+        for (const auto& v: vertices) {
+            minPos = glm::min(minPos, v.Position);
+            maxPos = glm::max(maxPos, v.Position);
+        }
+        if (vertices.empty())
+            minPos = maxPos = glm::vec3(0.0f);
+        dequantOffset = minPos;
+        dequantScale = glm::max(maxPos - minPos, glm::vec3(1e-20f));
+
+        vector<PackedVertex> packed(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            const Vertex& v = vertices[i];
+            PackedVertex& p = packed[i];
+
+            glm::vec3 q = glm::round((v.Position - dequantOffset) / dequantScale * 65535.0f);
+            q = glm::clamp(q, glm::vec3(0.0f), glm::vec3(65535.0f));
+            p.Position[0] = (GLushort)q.x;
+            p.Position[1] = (GLushort)q.y;
+            p.Position[2] = (GLushort)q.z;
+            // handedness of the tangent frame, so the bitangent can be rebuilt in the shader
+            bool rightHanded = glm::dot(glm::cross(v.Normal, v.Tangent), v.Bitangent) >= 0.0f;
+            p.Position[3] = (GLushort)((rightHanded ? 0x8000 : 0) | (v.Material & 0x7fff));
+
+            glm::vec2 n = OctEncode(v.Normal);
+            p.Normal[0] = PackSnorm16(n.x);
+            p.Normal[1] = PackSnorm16(n.y);
+
+            glm::vec2 t = OctEncode(v.Tangent);
+            p.Tangent[0] = PackSnorm16(t.x);
+            p.Tangent[1] = PackSnorm16(t.y);
+
+            p.TexCoords[0] = glm::packHalf1x16(v.TexCoords.x);
+            p.TexCoords[1] = glm::packHalf1x16(v.TexCoords.y);
+        }
+        return packed;
+    }
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstddef>
+#include <algorithm>
+
+#include "MeshArena.hpp"
+#include "Mesh.hpp"
+#include "GLState.hpp"
+
+MeshArena meshArena;
+extern GLStateCache glState;
+
+// Start size of the buffers, they double when full
+const GLsizei ARENA_INITIAL_VERTICES = 64 * 1024;
+const GLsizei ARENA_INITIAL_INDICES = 3 * ARENA_INITIAL_VERTICES;
+
+
+GLsizei VertexFormatStride( VertexFormat format)
+{
+    switch ( format) {
+    case VERTEX_FORMAT_PACKED:
+        return sizeof( PackedVertex);
+    case VERTEX_FORMAT_FULL:
+    default:
+        return sizeof( Vertex);
+    }
+}
+
+
+MeshAllocation MeshArena::Allocate( VertexFormat format, const void* vertices, GLsizei vertexCount, const GLuint* indices, GLsizei indexCount)
+{
+    Pool& pool = pools[format];
+    if ( pool.vertexUsed + vertexCount > pool.vertexCapacity || pool.indexUsed + indexCount > pool.indexCapacity)
+        Grow( format, pool.vertexUsed + vertexCount, pool.indexUsed + indexCount);
+
+    GLsizei stride = VertexFormatStride( format);
+
+    // Upload through the copy target, binding the element buffer would change whatever VAO is bound
+    glBindBuffer( GL_COPY_WRITE_BUFFER, pool.VBO);
+    glBufferSubData( GL_COPY_WRITE_BUFFER, (GLintptr)pool.vertexUsed * stride, (GLsizeiptr)vertexCount * stride, vertices);
+    glBindBuffer( GL_COPY_WRITE_BUFFER, pool.EBO);
+    glBufferSubData( GL_COPY_WRITE_BUFFER, (GLintptr)pool.indexUsed * sizeof( GLuint), (GLsizeiptr)indexCount * sizeof( GLuint), indices);
+    glBindBuffer( GL_COPY_WRITE_BUFFER, 0);
+
+    MeshAllocation allocation;
+    allocation.format = format;
+    allocation.baseVertex = pool.vertexUsed;
+    allocation.firstIndex = pool.indexUsed;
+    allocation.indexCount = indexCount;
+
+    pool.vertexUsed += vertexCount;
+    pool.indexUsed += indexCount;
+    return allocation;
+}
+
+
+void MeshArena::Bind( VertexFormat format)
+{
+    glState.BindVertexArray( pools[format].VAO);
+}
+
+
+void MeshArena::Draw( const MeshAllocation& allocation)
+{
+    if ( allocation.indexCount == 0)
+        return;
+
+    Bind( allocation.format);
+    glDrawElementsBaseVertex( GL_TRIANGLES, allocation.indexCount, GL_UNSIGNED_INT,
+        (void*)( (size_t)allocation.firstIndex * sizeof( GLuint)), allocation.baseVertex);
+}
+
+
+GLsizeiptr MeshArena::GetVertexBytes( VertexFormat format)
+{
+    return (GLsizeiptr)pools[format].vertexUsed * VertexFormatStride( format);
+}
+
+GLsizeiptr MeshArena::GetIndexBytes( VertexFormat format)
+{
+    return (GLsizeiptr)pools[format].indexUsed * sizeof( GLuint);
+}
+
+
+// Make room, the old content is copied over on the GPU so the allocations keep their offsets
+void MeshArena::Grow( VertexFormat format, GLsizei minVertices, GLsizei minIndices)
+{
+    Pool& pool = pools[format];
+    GLsizei stride = VertexFormatStride( format);
+
+    GLsizei vertexCapacity = std::max( pool.vertexCapacity, ARENA_INITIAL_VERTICES);
+    while ( vertexCapacity < minVertices)
+        vertexCapacity *= 2;
+    GLsizei indexCapacity = std::max( pool.indexCapacity, ARENA_INITIAL_INDICES);
+    while ( indexCapacity < minIndices)
+        indexCapacity *= 2;
+
+    GLuint buffers[2];
+    glGenBuffers( 2, buffers);
+
+    glBindBuffer( GL_COPY_WRITE_BUFFER, buffers[0]);
+    glBufferData( GL_COPY_WRITE_BUFFER, (GLsizeiptr)vertexCapacity * stride, nullptr, GL_STATIC_DRAW);
+    if ( pool.vertexUsed > 0) {
+        glBindBuffer( GL_COPY_READ_BUFFER, pool.VBO);
+        glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)pool.vertexUsed * stride);
+    }
+
+    glBindBuffer( GL_COPY_WRITE_BUFFER, buffers[1]);
+    glBufferData( GL_COPY_WRITE_BUFFER, (GLsizeiptr)indexCapacity * sizeof( GLuint), nullptr, GL_STATIC_DRAW);
+    if ( pool.indexUsed > 0) {
+        glBindBuffer( GL_COPY_READ_BUFFER, pool.EBO);
+        glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)pool.indexUsed * sizeof( GLuint));
+    }
+    glBindBuffer( GL_COPY_READ_BUFFER, 0);
+    glBindBuffer( GL_COPY_WRITE_BUFFER, 0);
+
+    if ( pool.VBO != 0) {
+        glDeleteBuffers( 1, &pool.VBO);
+        glDeleteBuffers( 1, &pool.EBO);
+    }
+    pool.VBO = buffers[0];
+    pool.EBO = buffers[1];
+    pool.vertexCapacity = vertexCapacity;
+    pool.indexCapacity = indexCapacity;
+
+    // The VAO points at the buffers, so point it at the new ones
+    if ( pool.VAO == 0)
+        glGenVertexArrays( 1, &pool.VAO);
+    glState.BindVertexArray( pool.VAO);
+    glBindBuffer( GL_ARRAY_BUFFER, pool.VBO);
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, pool.EBO);
+    SetupAttributes( format);
+    glState.BindVertexArray( 0);
+}
+
+
+// set the vertex attribute pointers of the bound VAO
+void MeshArena::SetupAttributes( VertexFormat format)
+{
+    switch ( format) {
+    case VERTEX_FORMAT_PACKED:
+        // quantized position, w is the tangent handedness and the texture array layer
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+        // the same w again as an integer, for the layer
+        glEnableVertexAttribArray(5);
+        glVertexAttribIPointer(5, 1, GL_UNSIGNED_SHORT, sizeof(PackedVertex), (void*)(offsetof(PackedVertex, Position) + 3 * sizeof(GLushort)));
+        // octahedral normal
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+        // half float texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+        // octahedral tangent, the bitangent is cross(normal, tangent) * handedness
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Tangent));
+        break;
+    case VERTEX_FORMAT_FULL:
+    default:
+        // vertex Positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        // vertex tangent
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+        // vertex bitangent
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        // texture array layer
+        glEnableVertexAttribArray(5);
+        glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, sizeof(Vertex), (void*)offsetof(Vertex, Material));
+        break;
+    }
+}
+
+
+void MeshArena::CleanUp()
+{
+    for ( auto& pool: pools) {
+        if ( pool.VAO != 0) {
+            glDeleteVertexArrays( 1, &pool.VAO);
+            glState.ForgetVertexArray( pool.VAO);
+            glDeleteBuffers( 1, &pool.VBO);
+            glDeleteBuffers( 1, &pool.EBO);
+        }
+        pool = Pool();
+    }
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#include "MeshCache.hpp"
+#include "FileUtils.hpp"
+
+MeshCache meshCache;
+
+// Bump when the importer or the mesh optimizer changes what comes out
+static const uint32_t COOK_VERSION = 3;
+
+static const char MESH_MAGIC[4] = { 'P', 'D', 'M', 'C' };
+
+struct MeshCacheHeader
+{
+    char magic[4];
+    uint32_t version;           // COOK_VERSION, the archive has no file name to carry it
+    uint32_t vertexSize;        // sizeof( Vertex), a different layout is a different file
+    uint32_t meshCount;
+    float minValue[3];
+    float maxValue[3];
+};
+
+struct MeshCacheMesh
+{
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t textureCount;
+};
+
+// Reads the mapped file front to back, every read is checked against its end
+struct BlobReader
+{
+    const unsigned char* data;
+    size_t size;
+    size_t position;
+
+    bool Read( void* out, size_t bytes) {
+        if ( bytes > size - position)
+            return false;
+        memcpy( out, data + position, bytes);
+        position += bytes;
+        return true;
+    }
+    bool ReadString( string& out) {
+        uint32_t length;
+        if ( !Read( &length, sizeof( length)) || length > size - position)
+            return false;
+        out.assign( (const char*)data + position, length);
+        position += length;
+        return true;
+    }
+};
+
+static void Append( std::vector<unsigned char>& file, const void* data, size_t bytes)
+{
+    file.insert( file.end(), (const unsigned char*)data, (const unsigned char*)data + bytes);
+}
+
+static void AppendString( std::vector<unsigned char>& file, const string& text)
+{
+    uint32_t length = (uint32_t)text.size();
+    Append( file, &length, sizeof( length));
+    Append( file, text.data(), text.size());
+}
+
+
+MeshCache::MeshCache( const std::string& Directory) : directory( Directory)
+{
+}
+
+
+std::string MeshCache::GetCachePath( const std::string& sourcePath, unsigned int importFlags)
+{
+    std::vector<unsigned char> source;
+    if ( !ReadFile( sourcePath, source))
+        return "";
+    uint64_t hash = HashBytes( source.data(), source.size(), ( COOK_VERSION * 31 + sizeof( Vertex)) * 1099511628211ull);
+    hash = HashBytes( &importFlags, sizeof( importFlags), hash);
+
+    // the materials come from the .mtl files of an OBJ, a change there is a change of the model too
+    std::string directory = sourcePath.substr( 0, sourcePath.find_last_of( '/') + 1);
+    std::istringstream lines( std::string( source.begin(), source.end()));
+    std::string line;
+    while ( std::getline( lines, line)) {
+        if ( line.compare( 0, 7, "mtllib ") != 0)
+            continue;
+        std::string name = line.substr( 7);
+        name.erase( name.find_last_not_of( " \t\r") + 1);
+        std::vector<unsigned char> library;
+        if ( ReadFile( directory + name, library))
+            hash = HashBytes( library.data(), library.size(), hash);
+    }
+
+    char name[32];
+    snprintf( name, sizeof( name), "%016llx.mesh", (unsigned long long)hash);
+    return this->directory + "/" + name;
+}
+
+
+bool MeshCache::Load( const std::string& cachePath, CookedModel& model)
+{
+    MappedFile file;
+    return file.Open( cachePath) && Decode( file.GetData(), file.GetSize(), model);
+}
+
+
+bool MeshCache::Store( const std::string& cachePath, const CookedModel& model)
+{
+    std::vector<unsigned char> file;
+    Encode( model, file);
+    MakeDirectories( directory);
+    return WriteFileAtomic( cachePath, file.data(), file.size());
+}
+
+
+bool MeshCache::Decode( const unsigned char* data, size_t size, CookedModel& model)
+{
+    BlobReader reader = { data, size, 0 };
+    MeshCacheHeader header;
+    if ( !reader.Read( &header, sizeof( header)) || memcmp( header.magic, MESH_MAGIC, sizeof( MESH_MAGIC)) != 0
+         || header.version != COOK_VERSION || header.vertexSize != sizeof( Vertex))
+        return false;
+
+    model.minValue = glm::vec3( header.minValue[0], header.minValue[1], header.minValue[2]);
+    model.maxValue = glm::vec3( header.maxValue[0], header.maxValue[1], header.maxValue[2]);
+    model.meshes.clear();
+    for ( uint32_t m = 0; m < header.meshCount; ++m) {
+        MeshCacheMesh counts;
+        if ( !reader.Read( &counts, sizeof( counts)))
+            return false;
+        // a truncated file can't ask for more than there is
+        size_t remaining = reader.size - reader.position;
+        if ( counts.vertexCount > remaining / sizeof( Vertex) || counts.indexCount > remaining / sizeof( GLuint)
+             || counts.textureCount > remaining / 8)
+            return false;
+
+        model.meshes.emplace_back();
+        CookedMesh& mesh = model.meshes.back();
+        mesh.textures.resize( counts.textureCount);
+        for ( auto& texture: mesh.textures) {
+            uint32_t type;
+            if ( !reader.Read( &type, sizeof( type)) || type >= TEXTURE_TYPE_COUNT || !reader.ReadString( texture.second))
+                return false;
+            texture.first = (TextureType)type;
+        }
+        mesh.vertices.resize( counts.vertexCount);
+        mesh.indices.resize( counts.indexCount);
+        if ( !reader.Read( mesh.vertices.data(), mesh.vertices.size() * sizeof( Vertex))
+             || !reader.Read( mesh.indices.data(), mesh.indices.size() * sizeof( GLuint)))
+            return false;
+        // whole triangles of vertices that exist, the fracture cutter and the draws trust them
+        if ( counts.indexCount % 3 != 0)
+            return false;
+        for ( GLuint index: mesh.indices)
+            if ( index >= counts.vertexCount)
+                return false;
+    }
+    return reader.position == reader.size;
+}
+
+
+// The whole file is put together in memory and written in one go, see WriteFileAtomic()
+void MeshCache::Encode( const CookedModel& model, std::vector<unsigned char>& file)
+{
+    MeshCacheHeader header;
+    memcpy( header.magic, MESH_MAGIC, sizeof( MESH_MAGIC));
+    header.version = COOK_VERSION;
+    header.vertexSize = sizeof( Vertex);
+    header.meshCount = (uint32_t)model.meshes.size();
+    for ( int i = 0; i < 3; ++i) {
+        header.minValue[i] = model.minValue[i];
+        header.maxValue[i] = model.maxValue[i];
+    }
+
+    file.clear();
+    Append( file, &header, sizeof( header));
+    for ( auto& mesh: model.meshes) {
+        MeshCacheMesh counts = { (uint32_t)mesh.vertices.size(), (uint32_t)mesh.indices.size(), (uint32_t)mesh.textures.size() };
+        Append( file, &counts, sizeof( counts));
+        for ( auto& texture: mesh.textures) {
+            uint32_t type = texture.first;
+            Append( file, &type, sizeof( type));
+            AppendString( file, texture.second);
+        }
+        Append( file, mesh.vertices.data(), mesh.vertices.size() * sizeof( Vertex));
+        Append( file, mesh.indices.data(), mesh.indices.size() * sizeof( GLuint));
+    }
+}
@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "MeshOptimizer.hpp"
+
+// Size of the LRU cache Forsyth's scoring simulates
+const int FORSYTH_CACHE_SIZE = 32;
+// Size of the FIFO cache used for the statistics and the overdraw clusters (typical hardware)
+const unsigned int FIFO_CACHE_SIZE = 16;
+// Soft clusters smaller than this are not worth sorting
+const size_t MIN_CLUSTER_TRIANGLES = 16;
+
+
+VertexCacheStats AnalyzeVertexCache( const std::vector<GLuint>& indices, size_t vertexCount, unsigned int cacheSize)
+{
+    VertexCacheStats stats;
+    if ( indices.size() < 3 || vertexCount == 0)
+        return stats;
+
+    // FIFO, a vertex is in the cache if it was pushed less than cacheSize misses ago
+    std::vector<unsigned int> pushedAt( vertexCount, 0);
+    unsigned int misses = 0;
+    for ( GLuint v: indices) {
+        if ( pushedAt[v] == 0 || misses - pushedAt[v] + 1 > cacheSize) {
+            misses++;
+            pushedAt[v] = misses;
+        }
+    }
+
+    stats.acmr = (float)misses / ( indices.size() / 3);
+    stats.atvr = (float)misses / vertexCount;
+    return stats;
+}
+
+
+// Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"
+static float ForsythVertexScore( int cachePosition, unsigned int remaining)
+{
+    if ( remaining == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if ( cachePosition >= 0) {
+        // the last triangle's vertices get a fixed score so we don't favour one of them
+        if ( cachePosition < 3)
+            score = 0.75f;
+        else
+            score = std::pow( 1.0f - (float)( cachePosition - 3) / ( FORSYTH_CACHE_SIZE - 3), 1.5f);
+    }
+    // boost the vertices with few triangles left so we don't leave lonely triangles behind
+    score += 2.0f / std::sqrt( (float)remaining);
+    return score;
+}
+
+
+void OptimizeVertexCache( std::vector<GLuint>& indices, size_t vertexCount)
+{
+    size_t triCount = indices.size() / 3;
+    if ( triCount == 0)
+        return;
+
+    // triangles per vertex
+    std::vector<unsigned int> remaining( vertexCount, 0);
+    for ( GLuint v: indices)
+        remaining[v]++;
+    std::vector<unsigned int> adjacencyOffset( vertexCount + 1, 0);
+    for ( size_t v = 0; v < vertexCount; ++v)
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+    std::vector<unsigned int> adjacency( indices.size());
+    {
+        std::vector<unsigned int> fill( adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for ( size_t t = 0; t < triCount; ++t)
+            for ( int k = 0; k < 3; ++k)
+                adjacency[fill[indices[t * 3 + k]]++] = t;
+    }
+
+    std::vector<int> cachePosition( vertexCount, -1);
+    std::vector<float> vertexScore( vertexCount);
+    for ( size_t v = 0; v < vertexCount; ++v)
+        vertexScore[v] = ForsythVertexScore( -1, remaining[v]);
+
+    std::vector<float> triScore( triCount);
+    std::vector<char> emitted( triCount, 0);
+    int bestTri = -1;
+    float bestScore = -1.0f;
+    for ( size_t t = 0; t < triCount; ++t) {
+        triScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+        if ( triScore[t] > bestScore) {
+            bestScore = triScore[t];
+            bestTri = t;
+        }
+    }
+
+    std::vector<GLuint> cache, newCache;
+    cache.reserve( FORSYTH_CACHE_SIZE + 3);
+    newCache.reserve( FORSYTH_CACHE_SIZE + 3);
+
+    std::vector<GLuint> result;
+    result.reserve( indices.size());
+    size_t deadEndCursor = 0;
+
+    while ( result.size() < indices.size()) {
+        // nothing good around the cache, take the next triangle that is left
+        if ( bestTri < 0) {
+            while ( emitted[deadEndCursor])
+                deadEndCursor++;
+            bestTri = deadEndCursor;
+        }
+
+        const GLuint* tri = &indices[bestTri * 3];
+        emitted[bestTri] = 1;
+        result.insert( result.end(), tri, tri + 3);
+
+        // take the triangle out of its vertices' lists
+        for ( int k = 0; k < 3; ++k) {
+            GLuint v = tri[k];
+            unsigned int* list = &adjacency[adjacencyOffset[v]];
+            for ( unsigned int i = 0; i < remaining[v]; ++i) {
+                if ( list[i] == (unsigned int)bestTri) {
+                    list[i] = list[remaining[v] - 1];
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        // the triangle's vertices go to the front of the LRU cache
+        newCache.assign( tri, tri + 3);
+        for ( GLuint v: cache)
+            if ( v != tri[0] && v != tri[1] && v != tri[2])
+                newCache.push_back( v);
+
+        for ( size_t i = 0; i < newCache.size(); ++i) {
+            GLuint v = newCache[i];
+            cachePosition[v] = i < (size_t)FORSYTH_CACHE_SIZE ? (int)i : -1;
+            vertexScore[v] = ForsythVertexScore( cachePosition[v], remaining[v]);
+        }
+
+        // rescore the triangles around the cache and pick the best one for the next round
+        bestTri = -1;
+        bestScore = -1.0f;
+        for ( GLuint v: newCache) {
+            const unsigned int* list = &adjacency[adjacencyOffset[v]];
+            for ( unsigned int i = 0; i < remaining[v]; ++i) {
+                unsigned int t = list[i];
+                triScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                if ( triScore[t] > bestScore) {
+                    bestScore = triScore[t];
+                    bestTri = t;
+                }
+            }
+        }
+
+        if ( newCache.size() > (size_t)FORSYTH_CACHE_SIZE)
+            newCache.resize( FORSYTH_CACHE_SIZE);
+        cache.swap( newCache);
+    }
+
+    indices.swap( result);
+}
+
+
+// Sander, Nehab, Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw".
+// The cache optimized triangle list is cut into clusters where the cache would be flushed anyway,
+// then the clusters facing outwards are drawn first so they hide the rest.
+void OptimizeOverdraw( std::vector<GLuint>& indices, const std::vector<Vertex>& vertices, float threshold)
+{
+    size_t triCount = indices.size() / 3;
+    if ( triCount < MIN_CLUSTER_TRIANGLES * 2)
+        return;
+
+    // 1. hard boundaries, a triangle where all three vertices miss the cache
+    std::vector<size_t> hard;
+    {
+        std::vector<unsigned int> pushedAt( vertices.size(), 0);
+        unsigned int misses = 0;
+        for ( size_t t = 0; t < triCount; ++t) {
+            int triMisses = 0;
+            for ( int k = 0; k < 3; ++k) {
+                GLuint v = indices[t * 3 + k];
+                if ( pushedAt[v] == 0 || misses - pushedAt[v] + 1 > FIFO_CACHE_SIZE) {
+                    misses++;
+                    pushedAt[v] = misses;
+                    triMisses++;
+                }
+            }
+            if ( triMisses == 3 || t == 0)
+                hard.push_back( t);
+        }
+        hard.push_back( triCount);
+    }
+
+    // 2. soft boundaries, split a cluster as long as the piece isn't much worse than the whole cluster
+    std::vector<size_t> clusters;
+    std::vector<unsigned int> pushedAt( vertices.size(), 0);
+    unsigned int misses = 0;
+    for ( size_t h = 0; h + 1 < hard.size(); ++h) {
+        size_t begin = hard[h], end = hard[h + 1];
+
+        // a vertex pushed before 'start' counts as a miss, that is a cold cache without clearing anything
+        auto simulate = [&]( size_t t, unsigned int start) {
+            for ( int k = 0; k < 3; ++k) {
+                GLuint v = indices[t * 3 + k];
+                if ( pushedAt[v] <= start || misses - pushedAt[v] + 1 > FIFO_CACHE_SIZE) {
+                    misses++;
+                    pushedAt[v] = misses;
+                }
+            }
+        };
+
+        unsigned int start = misses;
+        for ( size_t t = begin; t < end; ++t)
+            simulate( t, start);
+        float clusterAcmr = (float)( misses - start) / ( end - begin);
+
+        clusters.push_back( begin);
+        start = misses;
+        size_t startTri = begin;
+        for ( size_t t = begin; t < end; ++t) {
+            simulate( t, start);
+            size_t tris = t + 1 - startTri;
+            if ( t + 1 < end && tris >= MIN_CLUSTER_TRIANGLES && (float)( misses - start) / tris <= clusterAcmr * threshold) {
+                clusters.push_back( t + 1);
+                start = misses;     // the next piece starts with a cold cache
+                startTri = t + 1;
+            }
+        }
+    }
+    clusters.push_back( triCount);
+
+    // 3. sort the clusters, the ones whose normal points away from the mesh center go first
+    glm::vec3 meshCentroid( 0.0f);
+    float meshArea = 0.0f;
+    std::vector<glm::vec3> clusterCentroid( clusters.size() - 1, glm::vec3( 0.0f));
+    std::vector<glm::vec3> clusterNormal( clusters.size() - 1, glm::vec3( 0.0f));
+    for ( size_t c = 0; c + 1 < clusters.size(); ++c) {
+        float clusterArea = 0.0f;
+        for ( size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+            const glm::vec3& p0 = vertices[indices[t * 3]].Position;
+            const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 n = glm::cross( p1 - p0, p2 - p0);     // length = 2 * area
+            float area = glm::length( n);
+            glm::vec3 centroid = ( p0 + p1 + p2) / 3.0f;
+
+            clusterCentroid[c] += centroid * area;
+            clusterNormal[c] += n;
+            clusterArea += area;
+            meshCentroid += centroid * area;
+        }
+        if ( clusterArea > 0.0f)
+            clusterCentroid[c] /= clusterArea;
+        meshArea += clusterArea;
+    }
+    if ( meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    std::vector<std::pair<float, size_t>> order;
+    for ( size_t c = 0; c + 1 < clusters.size(); ++c) {
+        float len = glm::length( clusterNormal[c]);
+        glm::vec3 n = len > 0.0f ? clusterNormal[c] / len : glm::vec3( 0.0f);
+        order.push_back( std::make_pair( -glm::dot( clusterCentroid[c] - meshCentroid, n), c));
+    }
+    std::stable_sort( order.begin(), order.end(),
+        []( const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) { return a.first < b.first; });
+
+    std::vector<GLuint> result;
+    result.reserve( indices.size());
+    for ( const auto& o: order)
+        result.insert( result.end(), indices.begin() + clusters[o.second] * 3, indices.begin() + clusters[o.second + 1] * 3);
+    indices.swap( result);
+}
+
+
+void OptimizeVertexFetch( std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+{
+    const GLuint unused = ~0u;
+    std::vector<GLuint> remap( vertices.size(), unused);
+    std::vector<Vertex> result;
+    result.reserve( vertices.size());
+
+    // number the vertices in the order the index buffer touches them, unused ones are dropped
+    for ( GLuint& v: indices) {
+        if ( remap[v] == unused) {
+            remap[v] = result.size();
+            result.push_back( vertices[v]);
+        }
+        v = remap[v];
+    }
+    vertices.swap( result);
+}
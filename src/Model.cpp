@@ -7,8 +7,18 @@
 
 
 #include "Model.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshCache.hpp"
+#include "ObjLoader.hpp"
+#include "ResourceArchive.hpp"
+#include "GLState.hpp"
+#include <iomanip>
 #include <glm/gtc/type_ptr.hpp>
 
+extern MeshCache meshCache;
+extern ResourceArchive resourceArchive;
+extern MaterialTable materialTable;
+
 
 void Model::Draw( Shader &shader)
 {
@@ -16,42 +26,122 @@ void Model::Draw( Shader &shader)
             meshes[i].Draw( shader);
 }
 
-void Model::loadModel(string const &path) {
+size_t Model::ReleaseGeometry()
+{
+    size_t bytes = 0;
+    for ( auto& mesh: meshes)
+        bytes += mesh.ReleaseGeometry();
+    return bytes;
+}
+
+// reorder the triangles for the post transform vertex cache, draw the outer clusters first
+// against overdraw, and renumber the vertices in the order they are fetched
+void Model::optimizeMesh(const string& name, CookedMesh& mesh, CookedModel& cooked) {
+    for (auto& vertex: mesh.vertices) {
+        cooked.minValue = glm::min(cooked.minValue, vertex.Position);
+        cooked.maxValue = glm::max(cooked.maxValue, vertex.Position);
+    }
+    vector<Vertex>& vertices = mesh.vertices;
+    vector<GLuint>& indices = mesh.indices;
+    VertexCacheStats before = AnalyzeVertexCache(indices, vertices.size());
+    OptimizeVertexCache(indices, vertices.size());
+    OptimizeOverdraw(indices, vertices);
+    OptimizeVertexFetch(vertices, indices);
+    VertexCacheStats after = AnalyzeVertexCache(indices, vertices.size());
+    std::ostringstream log;
+    log << "\n    " << name << ": " << indices.size() / 3 << " triangles, " << std::fixed << std::setprecision(3)
+        << "ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr;
+    cooked.log += log.str();
+}
+
+bool Model::Import(string const &path, CookedModel& cooked) {
+    const unsigned int importFlags = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+    // cooked into the resource archive by make cook
+    const ArchiveEntry* entry = resourceArchive.Find(path);
+    if (entry != nullptr && entry->type == ARCHIVE_MESH) {
+        std::vector<unsigned char> unpacked;
+        const unsigned char* data = resourceArchive.Get(*entry, unpacked);
+        if (data != nullptr && MeshCache::Decode(data, entry->size, cooked)) {
+            cooked.log = " (archive, " + std::to_string(cooked.meshes.size()) + " meshes)";
+            return true;
+        }
+        cooked = CookedModel();
+    }
+
+    // cooked by an earlier launch, assimp isn't needed at all
+    string cachePath = meshCache.GetCachePath(path, importFlags);
+    if (!cachePath.empty() && meshCache.Load(cachePath, cooked)) {
+        cooked.log = " (cooked, " + std::to_string(cooked.meshes.size()) + " meshes)";
+        return true;
+    }
+
+    // our own reader for the OBJ files, assimp for the rest and for what it can't read
+    if (path.size() > 4 && path.compare(path.size() - 4, 4, ".obj") == 0) {
+        vector<string> names;
+        if (LoadOBJ(path, cooked, names)) {
+            for (size_t i = 0; i < cooked.meshes.size(); i++)
+                optimizeMesh(names[i], cooked.meshes[i], cooked);
+            if (!cachePath.empty() && !meshCache.Store(cachePath, cooked))
+                cooked.log += "\n    Could not write the mesh cache " + cachePath;
+            return true;
+        }
+        cooked = CookedModel();
+    }
+
     // read file via ASSIMP
     Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    const aiScene* scene = importer.ReadFile(path, importFlags);
     // check for errors
     if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
     {
-        cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-        return;
+        cooked.log = string(" ERROR::ASSIMP:: ") + importer.GetErrorString();
+        return false;
     }
+    // process ASSIMP's root node recursively
+    processNode(scene->mRootNode, scene, cooked);
+
+    // and keep what came out for the next launch
+    if (!cachePath.empty() && !meshCache.Store(cachePath, cooked))
+        cooked.log += "\n    Could not write the mesh cache " + cachePath;
+    return true;
+}
+
+void Model::upload(string const &path, CookedModel& cooked) {
     // retrieve the directory path of the filepath
     directory = path.substr(0, path.find_last_of('/'));
-    // process ASSIMP's root node recursively
-    processNode(scene->mRootNode, scene);
+    cout << "\n  " << path << cooked.log;
+    minValue = cooked.minValue;
+    maxValue = cooked.maxValue;
+    meshes.reserve(cooked.meshes.size());
+    // the textures are shared with every other model naming them, the meshes only keep the material id
+    for (auto& mesh: cooked.meshes)
+        meshes.emplace_back(std::move(mesh.vertices), std::move(mesh.indices), materialTable.Add(directory, mesh.textures), vertexFormat);
 }
 
 // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-void Model::processNode(aiNode *node, const aiScene *scene) {
+void Model::processNode(aiNode *node, const aiScene *scene, CookedModel& cooked) {
     // process each mesh located at the current node
     for(unsigned int i = 0; i < node->mNumMeshes; i++) {
         // the node object only contains indices to index the actual objects in the scene.
         // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
         aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        meshes.push_back( processMesh(mesh, scene));
+        cooked.meshes.push_back( processMesh(mesh, scene, cooked));
     }
     // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
     for(unsigned int i = 0; i < node->mNumChildren; i++)
-        processNode(node->mChildren[i], scene);
+        processNode(node->mChildren[i], scene, cooked);
 }
 
 
-Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)  {
+CookedMesh Model::processMesh(aiMesh *mesh, const aiScene *scene, CookedModel& cooked)  {
     // data to fill
-    vector<Vertex> vertices;
-    vector<unsigned int> indices;
-    vector<Texture> textures;
+    CookedMesh result;
+    vector<Vertex>& vertices = result.vertices;
+    vector<unsigned int>& indices = result.indices;
+    // sized up front, Triangulate leaves three indices per face
+    vertices.reserve(mesh->mNumVertices);
+    indices.reserve((size_t)mesh->mNumFaces * 3);
     // Walk through each of the mesh's vertices
     for(unsigned int i = 0; i < mesh->mNumVertices; i++) {
         Vertex vertex;
@@ -61,12 +151,6 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)  {
         vector.y = mesh->mVertices[i].y;
         vector.z = mesh->mVertices[i].z;
         vertex.Position = vector;
-        if ( vector.x < minValue.x) minValue.x = vector.x;
-        if ( vector.y < minValue.y) minValue.y = vector.y;
-        if ( vector.z < minValue.z) minValue.z = vector.z;
-        if ( vector.x > maxValue.x) maxValue.x = vector.x;
-        if ( vector.y > maxValue.y) maxValue.y = vector.y;
-        if ( vector.z > maxValue.z) maxValue.z = vector.z;
         // normals
         if ( mesh->HasNormals()) {
             vector.x = mesh->mNormals[i].x;
@@ -108,6 +192,7 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)  {
         for(unsigned int j = 0; j < face.mNumIndices; j++)
             indices.push_back(face.mIndices[j]);
     }
+    optimizeMesh(mesh->mName.C_Str(), result, cooked);
     // process materials
     aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
     // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
@@ -117,95 +202,25 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)  {
     // specular: texture_specularN
     // normal: texture_normalN
     // 1. diffuse maps
-    std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-    textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+    // only the references here, the textures are packed when the model is uploaded
+    materialTextures(material, aiTextureType_DIFFUSE, TEXTURE_DIFFUSE, result);
     // 2. specular maps
-    std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-    textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+    materialTextures(material, aiTextureType_SPECULAR, TEXTURE_SPECULAR, result);
     // 3. normal maps
-    std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-    textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+    materialTextures(material, aiTextureType_HEIGHT, TEXTURE_NORMAL, result);
     // 4. height maps
-    std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-    textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-    // return a mesh object created from the extracted mesh data
-    return Mesh(vertices, indices, textures);
+    materialTextures(material, aiTextureType_AMBIENT, TEXTURE_HEIGHT, result);
+    return result;
 }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName) {
-    vector<Texture> textures;
+    // collects all material textures of a given type, the paths are relative to the model
+void Model::materialTextures(aiMaterial *mat, aiTextureType type, TextureType textureType, CookedMesh& mesh) {
     for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
     {
         aiString str;
         mat->GetTexture(type, i, &str);
-        // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-        bool skip = false;
-        for(unsigned int j = 0; j < textures_loaded.size(); j++)
-        {
-            if(std::strcmp(textures_loaded[j].path.data, str.C_Str()) == 0)
-            {
-                textures.push_back(textures_loaded[j]);
-                skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                break;
-            }
-        }
-        if(!skip)
-        {   // if texture hasn't been loaded already, load it
-            Texture texture;
-            texture.id = TextureFromFile(str.C_Str(), this->directory);
-            texture.type = typeName;
-            texture.path = str.C_Str();
-            textures.push_back(texture);
-            textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-        }
-    }
-    return textures;
-}
-
-
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma) {
-    string filename = string(path);
-    filename = directory + '/' + filename;
-
-    // TODO:  use this gamma for something...
-    bool dummythingy;
-    dummythingy = gamma; // just to get rid of the compiler warning
-    gamma = dummythingy;
-
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *image = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (image) {
-        GLenum format = 0;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, image);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(image);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(image);
+        mesh.textures.push_back(std::make_pair(textureType, string(str.C_Str())));
     }
-
-    return textureID;
 }
 
 
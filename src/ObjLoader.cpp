@@ -0,0 +1,519 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <map>
+#include <algorithm>
+
+#include "ObjLoader.hpp"
+#include "FileUtils.hpp"
+#include "ThreadPool.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+    #include <emmintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+    #define OBJ_SSE2
+#endif
+
+extern ThreadPool threadPool;
+
+// Smaller files are parsed in one piece
+static const size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+// A face corner, 0 based, -1 = not given
+struct Corner
+{
+    int v, t, n;
+    bool operator==( const Corner& o) const { return v == o.v && t == o.t && n == o.n; }
+};
+
+// The triangles of one object and material in a row
+struct Run
+{
+    std::string key;            // object '\n' material
+    std::vector<Corner> corners;
+};
+
+struct Chunk
+{
+    const char* begin;
+    const char* end;
+
+    // counted in the first pass
+    int positionCount{0};
+    int uvCount{0};
+    int normalCount{0};
+    bool setsObject{false};
+    bool setsMaterial{false};
+    std::string lastObject;
+    std::string lastMaterial;
+    std::vector<std::string> libraries;
+
+    // the second pass starts from these
+    int positionBase{0};
+    int uvBase{0};
+    int normalBase{0};
+    std::string object;
+    std::string material;
+    std::vector<Run> runs;
+    bool valid{true};
+};
+
+
+static const char* FindLineEnd( const char* p, const char* end)
+{
+#ifdef OBJ_SSE2
+    const __m128i newline = _mm_set1_epi8( '\n');
+    while ( end - p >= 16) {
+        int mask = _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)p), newline));
+        if ( mask != 0) {
+#ifdef _MSC_VER
+            unsigned long first;
+            _BitScanForward( &first, (unsigned long)mask);
+            return p + first;
+#else
+            return p + __builtin_ctz( (unsigned int)mask);
+#endif
+        }
+        p += 16;
+    }
+#endif
+    while ( p < end && *p != '\n')
+        ++p;
+    return p;
+}
+
+static bool IsSpace( char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* SkipSpaces( const char* p, const char* end)
+{
+    while ( p < end && IsSpace( *p))
+        ++p;
+    return p;
+}
+
+// The statement word followed by a space, p is past it if so
+static bool Keyword( const char*& p, const char* end, const char* word)
+{
+    size_t length = strlen( word);
+    if ( (size_t)( end - p) <= length || memcmp( p, word, length) != 0 || !IsSpace( p[length]))
+        return false;
+    p += length;
+    return true;
+}
+
+// The rest of the line without the surrounding spaces, names may have spaces in them
+static std::string Rest( const char* p, const char* end)
+{
+    p = SkipSpaces( p, end);
+    while ( end > p && IsSpace( end[-1]))
+        --end;
+    return std::string( p, end);
+}
+
+static bool IsDigit( char c)
+{
+    return (unsigned int)( c - '0') < 10;
+}
+
+// Decimal digits into an integer mantissa and a power of ten, exact up to 18 digits, which is
+// all an OBJ exporter ever writes
+static const char* ParseFloat( const char* p, const char* end, float& value)
+{
+    static const double POWERS[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    p = SkipSpaces( p, end);
+    bool negative = false;
+    if ( p < end && ( *p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    for ( ; p < end && IsDigit( *p); ++p) {
+        if ( digits < 18) {
+            mantissa = mantissa * 10 + ( *p - '0');
+            digits += mantissa != 0;
+        } else
+            exponent++;
+    }
+    if ( p < end && *p == '.') {
+        for ( ++p; p < end && IsDigit( *p); ++p) {
+            if ( digits < 18) {
+                mantissa = mantissa * 10 + ( *p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+    if ( p < end && ( *p == 'e' || *p == 'E')) {
+        ++p;
+        bool negativeExponent = false;
+        if ( p < end && ( *p == '-' || *p == '+'))
+            negativeExponent = *p++ == '-';
+        int e = 0;
+        for ( ; p < end && IsDigit( *p); ++p)
+            e = std::min( e * 10 + ( *p - '0'), 1000);
+        exponent += negativeExponent ? -e : e;
+    }
+
+    double v = (double)mantissa;
+    if ( exponent < 0)
+        v = -exponent <= 22 ? v / POWERS[-exponent] : v * std::pow( 10.0, exponent);
+    else if ( exponent > 0)
+        v = exponent <= 22 ? v * POWERS[exponent] : v * std::pow( 10.0, exponent);
+    value = (float)( negative ? -v : v);
+    return p;
+}
+
+static const char* ParseInt( const char* p, const char* end, int& value)
+{
+    bool negative = false;
+    if ( p < end && ( *p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    int v = 0;
+    for ( ; p < end && IsDigit( *p); ++p)
+        v = v * 10 + ( *p - '0');
+    value = negative ? -v : v;
+    return p;
+}
+
+// 1 based or negative = from the last one, to 0 based. -1 when missing, -2 when broken.
+static int Resolve( int index, int count)
+{
+    if ( index > 0)
+        return index - 1;
+    if ( index < 0 && count + index >= 0)
+        return count + index;
+    return -2;
+}
+
+
+static void CountChunk( Chunk& chunk)
+{
+    for ( const char* line = chunk.begin; line < chunk.end; ) {
+        const char* lineEnd = FindLineEnd( line, chunk.end);
+        const char* p = SkipSpaces( line, lineEnd);
+        if ( Keyword( p, lineEnd, "v"))
+            chunk.positionCount++;
+        else if ( Keyword( p, lineEnd, "vt"))
+            chunk.uvCount++;
+        else if ( Keyword( p, lineEnd, "vn"))
+            chunk.normalCount++;
+        else if ( Keyword( p, lineEnd, "o")) {
+            chunk.lastObject = Rest( p, lineEnd);
+            chunk.setsObject = true;
+        } else if ( Keyword( p, lineEnd, "usemtl")) {
+            chunk.lastMaterial = Rest( p, lineEnd);
+            chunk.setsMaterial = true;
+        } else if ( Keyword( p, lineEnd, "mtllib"))
+            chunk.libraries.push_back( Rest( p, lineEnd));
+        line = lineEnd + 1;
+    }
+}
+
+
+static void ParseChunk( Chunk& chunk, std::vector<glm::vec3>& positions, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals)
+{
+    int positionCount = chunk.positionBase;
+    int uvCount = chunk.uvBase;
+    int normalCount = chunk.normalBase;
+    std::string key = chunk.object + '\n' + chunk.material;
+    std::vector<Corner> face;
+
+    for ( const char* line = chunk.begin; line < chunk.end; ) {
+        const char* lineEnd = FindLineEnd( line, chunk.end);
+        const char* p = SkipSpaces( line, lineEnd);
+        if ( Keyword( p, lineEnd, "v")) {
+            glm::vec3& v = positions[positionCount++];
+            p = ParseFloat( p, lineEnd, v.x);
+            p = ParseFloat( p, lineEnd, v.y);
+            ParseFloat( p, lineEnd, v.z);
+        } else if ( Keyword( p, lineEnd, "vt")) {
+            glm::vec2& t = uvs[uvCount++];
+            p = ParseFloat( p, lineEnd, t.x);
+            ParseFloat( p, lineEnd, t.y);
+        } else if ( Keyword( p, lineEnd, "vn")) {
+            glm::vec3& n = normals[normalCount++];
+            p = ParseFloat( p, lineEnd, n.x);
+            p = ParseFloat( p, lineEnd, n.y);
+            ParseFloat( p, lineEnd, n.z);
+        } else if ( Keyword( p, lineEnd, "f")) {
+            face.clear();
+            for ( p = SkipSpaces( p, lineEnd); p < lineEnd; p = SkipSpaces( p, lineEnd)) {
+                int v = 0, t = 0, n = 0;
+                p = ParseInt( p, lineEnd, v);
+                if ( p < lineEnd && *p == '/') {
+                    if ( ++p < lineEnd && *p != '/')
+                        p = ParseInt( p, lineEnd, t);
+                    if ( p < lineEnd && *p == '/')
+                        p = ParseInt( p + 1, lineEnd, n);
+                }
+                Corner corner = { Resolve( v, positionCount), t != 0 ? Resolve( t, uvCount) : -1, n != 0 ? Resolve( n, normalCount) : -1 };
+                if ( corner.v < 0 || corner.t < -1 || corner.n < -1 || ( p < lineEnd && !IsSpace( *p))) {
+                    chunk.valid = false;
+                    return;
+                }
+                face.push_back( corner);
+            }
+            if ( face.size() >= 3) {
+                if ( chunk.runs.empty() || chunk.runs.back().key != key)
+                    chunk.runs.push_back( Run{ key, std::vector<Corner>() });
+                std::vector<Corner>& corners = chunk.runs.back().corners;
+                for ( size_t i = 1; i + 1 < face.size(); ++i)
+                    corners.insert( corners.end(), { face[0], face[i], face[i + 1] });
+            }
+        } else if ( Keyword( p, lineEnd, "o")) {
+            chunk.object = Rest( p, lineEnd);
+            key = chunk.object + '\n' + chunk.material;
+        } else if ( Keyword( p, lineEnd, "usemtl")) {
+            chunk.material = Rest( p, lineEnd);
+            key = chunk.object + '\n' + chunk.material;
+        }
+        line = lineEnd + 1;
+    }
+}
+
+
+// The texture maps of every material in the libraries, in the order the assimp path adds them
+static void LoadMaterials( const std::string& directory, const std::vector<std::string>& libraries,
+                           std::map<std::string, std::vector<std::pair<TextureType, std::string>>>& materials)
+{
+    static const struct { const char* keyword; TextureType type; } MAPS[] = {
+        { "map_Kd", TEXTURE_DIFFUSE }, { "map_Ks", TEXTURE_SPECULAR }, { "map_Bump", TEXTURE_NORMAL },
+        { "bump", TEXTURE_NORMAL }, { "map_bump", TEXTURE_NORMAL }, { "map_Ka", TEXTURE_HEIGHT } };
+
+    for ( auto& library: libraries) {
+        std::vector<unsigned char> file;
+        if ( !ReadFile( directory + library, file))
+            continue;
+        const char* data = (const char*)file.data();
+        const char* end = data + file.size();
+        std::vector<std::pair<TextureType, std::string>> found;
+        std::string material;
+        bool inMaterial = false;
+
+        auto finish = [&]() {
+            if ( !inMaterial)
+                return;
+            std::vector<std::pair<TextureType, std::string>>& textures = materials[material];
+            for ( int type = 0; type < TEXTURE_TYPE_COUNT; ++type)
+                for ( auto& texture: found)
+                    if ( texture.first == type)
+                        textures.push_back( texture);
+            found.clear();
+        };
+
+        for ( const char* line = data; line < end; ) {
+            const char* lineEnd = FindLineEnd( line, end);
+            const char* p = SkipSpaces( line, lineEnd);
+            if ( Keyword( p, lineEnd, "newmtl")) {
+                finish();
+                material = Rest( p, lineEnd);
+                inMaterial = true;
+            } else {
+                for ( auto& map: MAPS) {
+                    if ( !Keyword( p, lineEnd, map.keyword))
+                        continue;
+                    // the options come first, the file name is the last word
+                    std::string value = Rest( p, lineEnd);
+                    size_t space = value.find_last_of( " \t");
+                    found.push_back( std::make_pair( map.type, space == std::string::npos ? value : value.substr( space + 1)));
+                    break;
+                }
+            }
+            line = lineEnd + 1;
+        }
+        finish();
+    }
+}
+
+
+// Every distinct corner becomes one vertex, tangents as assimp's CalcTangentSpace does them
+static void BuildMesh( const std::vector<const std::vector<Corner>*>& runs, const std::vector<glm::vec3>& positions,
+                       const std::vector<glm::vec2>& uvs, const std::vector<glm::vec3>& normals, CookedMesh& mesh, bool& valid)
+{
+    size_t cornerCount = 0;
+    for ( auto run: runs)
+        cornerCount += run->size();
+
+    size_t tableSize = 16;
+    while ( tableSize < cornerCount * 2)
+        tableSize *= 2;
+    std::vector<int> table( tableSize, -1);
+    std::vector<Corner> unique;
+    unique.reserve( cornerCount / 2);
+    mesh.indices.reserve( cornerCount);
+
+    bool hasUVs = false;
+    for ( auto run: runs) {
+        for ( const Corner& corner: *run) {
+            if ( corner.v >= (int)positions.size() || corner.t >= (int)uvs.size() || corner.n >= (int)normals.size()) {
+                valid = false;
+                return;
+            }
+            hasUVs |= corner.t >= 0;
+            uint32_t hash = (uint32_t)corner.v * 73856093u ^ (uint32_t)corner.t * 19349663u ^ (uint32_t)corner.n * 83492791u;
+            hash ^= hash >> 15;
+            size_t slot = hash & ( tableSize - 1);
+            while ( table[slot] >= 0 && !( unique[table[slot]] == corner))
+                slot = ( slot + 1) & ( tableSize - 1);
+            if ( table[slot] < 0) {
+                table[slot] = (int)unique.size();
+                unique.push_back( corner);
+            }
+            mesh.indices.push_back( (GLuint)table[slot]);
+        }
+    }
+
+    mesh.vertices.resize( unique.size());
+    for ( size_t i = 0; i < unique.size(); ++i) {
+        Vertex& vertex = mesh.vertices[i];
+        const Corner& corner = unique[i];
+        vertex.Position = positions[corner.v];
+        vertex.Normal = corner.n >= 0 ? normals[corner.n] : glm::vec3( 0.0f);
+        // FlipUVs
+        vertex.TexCoords = corner.t >= 0 ? glm::vec2( uvs[corner.t].x, 1.0f - uvs[corner.t].y) : glm::vec2( 0.0f);
+        vertex.Tangent = glm::vec3( 0.0f);
+        vertex.Bitangent = glm::vec3( 0.0f);
+        vertex.Material = 0;
+    }
+    if ( !hasUVs)
+        return;
+
+    for ( size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        Vertex& a = mesh.vertices[mesh.indices[i]];
+        Vertex& b = mesh.vertices[mesh.indices[i + 1]];
+        Vertex& c = mesh.vertices[mesh.indices[i + 2]];
+        glm::vec3 e1 = b.Position - a.Position, e2 = c.Position - a.Position;
+        glm::vec2 d1 = b.TexCoords - a.TexCoords, d2 = c.TexCoords - a.TexCoords;
+        float r = d1.x * d2.y - d2.x * d1.y;
+        float direction = r < 0.0f ? -1.0f : 1.0f;
+        glm::vec3 tangent = ( e1 * d2.y - e2 * d1.y) * direction;
+        glm::vec3 bitangent = ( e2 * d1.x - e1 * d2.x) * direction;
+        if ( glm::length( tangent) > 1e-12f)
+            tangent = glm::normalize( tangent);
+        if ( glm::length( bitangent) > 1e-12f)
+            bitangent = glm::normalize( bitangent);
+        for ( Vertex* v: { &a, &b, &c }) {
+            v->Tangent += tangent;
+            v->Bitangent += bitangent;
+        }
+    }
+    for ( auto& vertex: mesh.vertices) {
+        // perpendicular to the normal, then unit length
+        glm::vec3 t = vertex.Tangent - vertex.Normal * glm::dot( vertex.Normal, vertex.Tangent);
+        glm::vec3 b = vertex.Bitangent - vertex.Normal * glm::dot( vertex.Normal, vertex.Bitangent);
+        vertex.Tangent = glm::length( t) > 1e-12f ? glm::normalize( t) : glm::vec3( 0.0f);
+        vertex.Bitangent = glm::length( b) > 1e-12f ? glm::normalize( b) : glm::vec3( 0.0f);
+    }
+}
+
+
+bool LoadOBJ( const std::string& path, CookedModel& model, std::vector<std::string>& meshNames)
+{
+    MappedFile file;
+    if ( !file.Open( path))
+        return false;
+    const char* data = (const char*)file.GetData();
+    const char* end = data + file.GetSize();
+
+    // cut at line ends, about one chunk per thread
+    size_t chunkCount = std::min( (size_t)threadPool.GetThreadCount() + 1, file.GetSize() / MIN_CHUNK_SIZE + 1);
+    std::vector<Chunk> chunks( chunkCount);
+    const char* begin = data;
+    for ( size_t i = 0; i < chunkCount; ++i) {
+        const char* chunkEnd = end;
+        if ( i + 1 < chunkCount) {
+            chunkEnd = std::max( begin, FindLineEnd( data + file.GetSize() / chunkCount * ( i + 1), end));
+            chunkEnd = std::min( chunkEnd + 1, end);
+        }
+        chunks[i].begin = begin;
+        chunks[i].end = chunkEnd;
+        begin = chunkEnd;
+    }
+
+    // count first, so every chunk knows where its vertices go and what its negative indices mean
+    threadPool.ParallelFor( (unsigned int)chunkCount, [&]( unsigned int i) { CountChunk( chunks[i]); });
+    int positionCount = 0, uvCount = 0, normalCount = 0;
+    std::string object, material;
+    std::vector<std::string> libraries;
+    for ( auto& chunk: chunks) {
+        chunk.positionBase = positionCount;
+        chunk.uvBase = uvCount;
+        chunk.normalBase = normalCount;
+        chunk.object = object;
+        chunk.material = material;
+        positionCount += chunk.positionCount;
+        uvCount += chunk.uvCount;
+        normalCount += chunk.normalCount;
+        if ( chunk.setsObject)
+            object = chunk.lastObject;
+        if ( chunk.setsMaterial)
+            material = chunk.lastMaterial;
+        libraries.insert( libraries.end(), chunk.libraries.begin(), chunk.libraries.end());
+    }
+
+    std::vector<glm::vec3> positions( positionCount);
+    std::vector<glm::vec2> uvs( uvCount);
+    std::vector<glm::vec3> normals( normalCount);
+    threadPool.ParallelFor( (unsigned int)chunkCount, [&]( unsigned int i) { ParseChunk( chunks[i], positions, uvs, normals); });
+    for ( auto& chunk: chunks)
+        if ( !chunk.valid)
+            return false;
+
+    // one mesh per object and material, in the order they first show up
+    std::vector<std::string> keys;
+    std::vector<std::vector<const std::vector<Corner>*>> meshRuns;
+    for ( auto& chunk: chunks) {
+        for ( auto& run: chunk.runs) {
+            size_t m = std::find( keys.begin(), keys.end(), run.key) - keys.begin();
+            if ( m == keys.size()) {
+                keys.push_back( run.key);
+                meshRuns.emplace_back();
+            }
+            meshRuns[m].push_back( &run.corners);
+        }
+    }
+
+    std::map<std::string, std::vector<std::pair<TextureType, std::string>>> materials;
+    LoadMaterials( path.substr( 0, path.find_last_of( '/') + 1), libraries, materials);
+
+    model.meshes.resize( keys.size());
+    std::vector<char> valid( keys.size(), 1);
+    threadPool.ParallelFor( (unsigned int)keys.size(), [&]( unsigned int m) {
+        bool ok = true;
+        BuildMesh( meshRuns[m], positions, uvs, normals, model.meshes[m], ok);
+        valid[m] = ok;
+    });
+    for ( size_t m = 0; m < keys.size(); ++m) {
+        if ( !valid[m])
+            return false;
+        size_t split = keys[m].find( '\n');
+        auto found = materials.find( keys[m].substr( split + 1));
+        if ( found != materials.end())
+            model.meshes[m].textures = found->second;
+        meshNames.push_back( split > 0 ? keys[m].substr( 0, split) : keys[m].substr( split + 1));
+    }
+    return true;
+}
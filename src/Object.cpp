@@ -15,6 +15,9 @@
  */
 
 #include "Object.hpp"
+#include "GLState.hpp"
+
+extern GLStateCache glState;
 
 // If collider is set, then this are in the list of collidables
 void GameObject::SetCollider( const bool Collider) { collider = Collider; }
@@ -121,6 +124,11 @@ void GameObject::SetModel( Model *mModel) { model = mModel; }
 void GameObject::SetName( std::string Name) { name = Name; }
 // Get the name of the object
 std::string GameObject::GetName( ) { return name; }
+// World space bounding box, same box as the collision uses
+void GameObject::GetBounds( glm::vec3& BoundsMin, glm::vec3& BoundsMax) {
+    BoundsMin = position - center * scale;
+    BoundsMax = position + center * scale;
+}
 // Draw collision bounding box for visualisation
 void GameObject::DrawCollisionBox()
 {
@@ -137,29 +145,22 @@ void GameObject::Draw(bool globalWireframe_enabled)
 
     // if either Collider set og global wireframe set then do the wireframe
     if ( globalWireframe_enabled || GetWireframe()) {
-        glLineWidth( GetColliderBoxWireframeThickness());
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        glState.LineWidth( GetColliderBoxWireframeThickness());
+        glState.PolygonMode( GL_LINE);
         shader->setBool("wireframe_enable", 1);
         if ( GetWireframe())
             shader->setVec3("wireframeColor", GetWireframeColor());
         else
             shader->setVec3("wireframeColor", GetColliderWireframeColor());
     } else { // if not global wireframe set then set back to solid mode
-        glLineWidth(1.0f);
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        glState.LineWidth( 1.0f);
+        glState.PolygonMode( GL_FILL);
         shader->setBool("wireframe_enable", 0);
     }
 
     shader->setMat4("projection", projectionMatrix);
     shader->setMat4("view", viewMatrix);
-    modelMatrix = glm::mat4(1.0f);
-
-    modelMatrix = glm::translate(modelMatrix, position);
-    modelMatrix = glm::scale(modelMatrix, scale);
-
-    modelMatrix = glm::rotate(modelMatrix, rotate.z, glm::vec3(0.f, 0.f, 1.f));
-    modelMatrix = glm::rotate(modelMatrix, rotate.y, glm::vec3(0.f, 1.f, 0.f));
-    modelMatrix = glm::rotate(modelMatrix, rotate.x, glm::vec3(1.f, 0.f, 0.f));
+    modelMatrix = ComputeModelMatrix();
 
     shader->setMat4("model", modelMatrix);
 
@@ -167,6 +168,30 @@ void GameObject::Draw(bool globalWireframe_enabled)
 }
 
 
+void GameObject::BuildDrawPacket( DrawPacket& packet, bool globalWireframe_enabled, const glm::vec3& cameraPosition)
+{
+    packet.shader = shader;
+    packet.model = model;
+    packet.wireframe = globalWireframe_enabled || GetWireframe();
+    packet.wireframeColor = GetWireframe() ? GetWireframeColor() : GetColliderWireframeColor();
+    packet.lineWidth = GetColliderBoxWireframeThickness();
+    packet.modelMatrix = modelMatrix = ComputeModelMatrix();
+    packet.key = DrawList::MakeKey( shader, model, packet.wireframe, glm::length( position - cameraPosition));
+}
+
+
+glm::mat4 GameObject::ComputeModelMatrix()
+{
+    glm::mat4 m = glm::translate(glm::mat4(1.0f), position);
+    m = glm::scale(m, scale);
+
+    m = glm::rotate(m, rotate.z, glm::vec3(0.f, 0.f, 1.f));
+    m = glm::rotate(m, rotate.y, glm::vec3(0.f, 1.f, 0.f));
+    m = glm::rotate(m, rotate.x, glm::vec3(1.f, 0.f, 0.f));
+    return m;
+}
+
+
 
 // Update the objects mechanics
 void GameObject::Update(float deltaTime) {
@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "Occlusion.hpp"
+#include "ThreadPool.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+    #include <emmintrin.h>
+    #define OCCLUSION_SSE2
+#endif
+
+extern ThreadPool threadPool;
+
+// Rows of the buffer each worker job rasterizes
+const int OCCLUSION_BAND_ROWS = 16;
+
+
+OcclusionBuffer::OcclusionBuffer( int Width, int Height)
+{
+    Resize( Width, Height);
+}
+
+
+void OcclusionBuffer::Resize( int Width, int Height)
+{
+    width = ( std::max( Width, 4) + 3) & ~3;
+    height = std::max( Height, 1);
+    depth.assign( width * height, 1.0f);
+}
+
+
+void OcclusionBuffer::Clear()
+{
+    std::fill( depth.begin(), depth.end(), 1.0f);
+    triangles.clear();
+    tested = 0;
+    culled = 0;
+}
+
+
+void OcclusionBuffer::AddOccluder( const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices, const glm::mat4& modelViewProjection)
+{
+    std::vector<glm::vec4> clip;
+    clip.reserve( vertices.size());
+    for ( const auto& v: vertices)
+        clip.push_back( modelViewProjection * glm::vec4( v, 1.0f));
+
+    for ( size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const glm::vec4* c[3] = { &clip[indices[i]], &clip[indices[i+1]], &clip[indices[i+2]] };
+
+        // Skip triangles that cross the near plane, dropping occluder area is always safe
+        if ( c[0]->z < -c[0]->w || c[1]->z < -c[1]->w || c[2]->z < -c[2]->w)
+            continue;
+
+        glm::vec3 s[3];
+        for ( int k = 0; k < 3; ++k) {
+            float invW = 1.0f / c[k]->w;
+            s[k].x = ( c[k]->x * invW * 0.5f + 0.5f) * width;
+            s[k].y = ( c[k]->y * invW * 0.5f + 0.5f) * height;
+            s[k].z = c[k]->z * invW * 0.5f + 0.5f;
+        }
+
+        // Only front faces (counter clockwise), the back faces are behind them anyway
+        float area = ( s[1].x - s[0].x) * ( s[2].y - s[0].y) - ( s[1].y - s[0].y) * ( s[2].x - s[0].x);
+        if ( area <= 0.0f)
+            continue;
+
+        ScreenTriangle tri;
+        tri.v0 = s[0];
+        tri.v1 = s[1];
+        tri.v2 = s[2];
+        triangles.push_back( tri);
+    }
+}
+
+
+void OcclusionBuffer::Rasterize()
+{
+    if ( triangles.empty())
+        return;
+
+    // Each band only writes its own rows so the workers never touch the same pixels
+    unsigned int bands = ( height + OCCLUSION_BAND_ROWS - 1) / OCCLUSION_BAND_ROWS;
+    threadPool.ParallelFor( bands, [this]( unsigned int band) {
+        int rowMin = band * OCCLUSION_BAND_ROWS;
+        int rowMax = std::min( height, rowMin + OCCLUSION_BAND_ROWS);
+        for ( const auto& tri: triangles)
+            RasterizeBand( tri, rowMin, rowMax);
+    });
+}
+
+
+void OcclusionBuffer::RasterizeBand( const ScreenTriangle& tri, int rowMin, int rowMax)
+{
+    const glm::vec3& v0 = tri.v0;
+    const glm::vec3& v1 = tri.v1;
+    const glm::vec3& v2 = tri.v2;
+
+    // Bounding box clipped to the band
+    int minX = std::max( 0, (int)std::floor( std::min( v0.x, std::min( v1.x, v2.x))));
+    int maxX = std::min( width - 1, (int)std::ceil( std::max( v0.x, std::max( v1.x, v2.x))));
+    int minY = std::max( rowMin, (int)std::floor( std::min( v0.y, std::min( v1.y, v2.y))));
+    int maxY = std::min( rowMax - 1, (int)std::ceil( std::max( v0.y, std::max( v1.y, v2.y))));
+    if ( minX > maxX || minY > maxY)
+        return;
+    minX &= ~3;     // start on a SIMD lane boundary
+
+    // Edge functions E = A*x + B*y + C, positive inside a counter clockwise triangle
+    float a0 = v1.y - v2.y, b0 = v2.x - v1.x, c0 = -( a0 * v1.x + b0 * v1.y);
+    float a1 = v2.y - v0.y, b1 = v0.x - v2.x, c1 = -( a1 * v2.x + b1 * v2.y);
+    float a2 = v0.y - v1.y, b2 = v1.x - v0.x, c2 = -( a2 * v0.x + b2 * v0.y);
+    float area = a0 * v0.x + b0 * v0.y + c0;
+    if ( area <= 0.0f)
+        return;
+
+    // Depth is linear in screen space, z = zA*x + zB*y + zC
+    float invArea = 1.0f / area;
+    float zA = ( a0 * v0.z + a1 * v1.z + a2 * v2.z) * invArea;
+    float zB = ( b0 * v0.z + b1 * v1.z + b2 * v2.z) * invArea;
+    float zC = ( c0 * v0.z + c1 * v1.z + c2 * v2.z) * invArea;
+
+#ifdef OCCLUSION_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 lane = _mm_set_ps( 3.5f, 2.5f, 1.5f, 0.5f);
+    const __m128 four = _mm_set1_ps( 4.0f);
+    const __m128 A0 = _mm_set1_ps( a0), A1 = _mm_set1_ps( a1), A2 = _mm_set1_ps( a2);
+    const __m128 ZA = _mm_set1_ps( zA);
+
+    for ( int y = minY; y <= maxY; ++y) {
+        float py = y + 0.5f;
+        __m128 rowE0 = _mm_set1_ps( b0 * py + c0);
+        __m128 rowE1 = _mm_set1_ps( b1 * py + c1);
+        __m128 rowE2 = _mm_set1_ps( b2 * py + c2);
+        __m128 rowZ  = _mm_set1_ps( zB * py + zC);
+        __m128 px = _mm_add_ps( _mm_set1_ps( (float)minX), lane);
+        float* row = &depth[y * width];
+
+        for ( int x = minX; x <= maxX; x += 4, px = _mm_add_ps( px, four)) {
+            __m128 e0 = _mm_add_ps( _mm_mul_ps( A0, px), rowE0);
+            __m128 e1 = _mm_add_ps( _mm_mul_ps( A1, px), rowE1);
+            __m128 e2 = _mm_add_ps( _mm_mul_ps( A2, px), rowE2);
+            __m128 inside = _mm_and_ps( _mm_cmpge_ps( e0, zero), _mm_and_ps( _mm_cmpge_ps( e1, zero), _mm_cmpge_ps( e2, zero)));
+            if ( _mm_movemask_ps( inside) == 0)
+                continue;
+
+            __m128 z = _mm_add_ps( _mm_mul_ps( ZA, px), rowZ);
+            __m128 d = _mm_loadu_ps( row + x);
+            __m128 nearest = _mm_min_ps( d, z);
+            _mm_storeu_ps( row + x, _mm_or_ps( _mm_and_ps( inside, nearest), _mm_andnot_ps( inside, d)));
+        }
+    }
+#else
+    for ( int y = minY; y <= maxY; ++y) {
+        float py = y + 0.5f;
+        float* row = &depth[y * width];
+        for ( int x = minX; x <= maxX; ++x) {
+            float px = x + 0.5f;
+            if ( a0 * px + b0 * py + c0 < 0.0f || a1 * px + b1 * py + c1 < 0.0f || a2 * px + b2 * py + c2 < 0.0f)
+                continue;
+            float z = zA * px + zB * py + zC;
+            if ( z < row[x])
+                row[x] = z;
+        }
+    }
+#endif
+}
+
+
+bool OcclusionBuffer::IsVisible( const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& viewProjection)
+{
+    tested++;
+
+    float minX = 1e30f, minY = 1e30f, minZ = 1e30f;
+    float maxX = -1e30f, maxY = -1e30f;
+    for ( int i = 0; i < 8; ++i) {
+        glm::vec4 corner(
+            ( i & 1) ? boundsMax.x : boundsMin.x,
+            ( i & 2) ? boundsMax.y : boundsMin.y,
+            ( i & 4) ? boundsMax.z : boundsMin.z,
+            1.0f);
+        glm::vec4 c = viewProjection * corner;
+        // Crossing the near plane, can't tell so let it be drawn
+        if ( c.z < -c.w)
+            return true;
+
+        float invW = 1.0f / c.w;
+        float sx = ( c.x * invW * 0.5f + 0.5f) * width;
+        float sy = ( c.y * invW * 0.5f + 0.5f) * height;
+        float sz = c.z * invW * 0.5f + 0.5f;
+        minX = std::min( minX, sx); maxX = std::max( maxX, sx);
+        minY = std::min( minY, sy); maxY = std::max( maxY, sy);
+        minZ = std::min( minZ, sz);
+    }
+
+    // Outside of the screen is the frustum's job, not ours
+    if ( maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height)
+        return true;
+
+    int x0 = std::max( 0, (int)std::floor( minX));
+    int x1 = std::min( width - 1, (int)std::ceil( maxX));
+    int y0 = std::max( 0, (int)std::floor( minY));
+    int y1 = std::min( height - 1, (int)std::ceil( maxY));
+
+    // Visible as soon as one pixel has nothing in front of the nearest point of the box
+    for ( int y = y0; y <= y1; ++y) {
+        const float* row = &depth[y * width];
+        int x = x0;
+#ifdef OCCLUSION_SSE2
+        const __m128 Z = _mm_set1_ps( minZ);
+        for ( ; x + 3 <= x1; x += 4)
+            if ( _mm_movemask_ps( _mm_cmpge_ps( _mm_loadu_ps( row + x), Z)) != 0)
+                return true;
+#endif
+        for ( ; x <= x1; ++x)
+            if ( row[x] >= minZ)
+                return true;
+    }
+
+    culled++;
+    return false;
+}
+
+
+void OcclusionBuffer::BuildSphereOccluder( float radius, int rings, int segments, std::vector<glm::vec3>& vertices, std::vector<unsigned int>& indices)
+{
+    const float pi = 3.14159265358979f;
+    vertices.clear();
+    indices.clear();
+
+    for ( int i = 0; i <= rings; ++i) {
+        float theta = pi * i / rings;
+        for ( int j = 0; j <= segments; ++j) {
+            float phi = 2.0f * pi * j / segments;
+            vertices.push_back( radius * glm::vec3( std::sin( theta) * std::cos( phi), std::cos( theta), std::sin( theta) * std::sin( phi)));
+        }
+    }
+
+    // Counter clockwise seen from the outside
+    for ( int i = 0; i < rings; ++i) {
+        for ( int j = 0; j < segments; ++j) {
+            unsigned int a = i * ( segments + 1) + j;
+            unsigned int b = a + segments + 1;
+            indices.push_back( a); indices.push_back( b + 1); indices.push_back( b);
+            indices.push_back( a); indices.push_back( a + 1); indices.push_back( b + 1);
+        }
+    }
+}
@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Particles.hpp"
+#include "ThreadPool.hpp"
+#include "GLState.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+    #include <emmintrin.h>
+    #define PARTICLES_SSE2
+#endif
+
+ParticleSystem particleSystem;
+extern ThreadPool threadPool;
+extern GLStateCache glState;
+
+// Particles per worker job, a multiple of 4
+static const size_t BLOCK_SIZE = 16384;
+
+
+bool ParticleSystem::Init()
+{
+    freeEmitters.clear();
+    for ( int i = MAX_EMITTERS - 1; i >= 0; --i) {
+        emitters[i].active = false;
+        freeEmitters.push_back( i);
+    }
+
+    // rocks, most of the budget
+    ParticleType rock;
+    rock.startColor = glm::vec3( 0.55f, 0.45f, 0.35f);
+    rock.endColor = glm::vec3( 0.15f, 0.12f, 0.1f);
+    rock.size = 0.08f;
+    rock.lifetime = 6.0f;
+    rock.drag = 0.8f;
+    debris = AddType( rock, MAX_PARTICLES / 4 * 3);
+
+    ParticleType flame;
+    flame.startColor = glm::vec3( 1.0f, 0.85f, 0.4f);
+    flame.endColor = glm::vec3( 0.6f, 0.1f, 0.0f);
+    flame.size = 0.25f;
+    flame.lifetime = 1.5f;
+    flame.drag = 0.3f;
+    flame.additive = true;
+    fire = AddType( flame, MAX_PARTICLES / 4);
+
+    if ( debris < 0 || fire < 0 || glGetError() != GL_NO_ERROR) {
+        std::cout << "\n  Particles: could not create the buffers";
+        return false;
+    }
+    return true;
+}
+
+
+void ParticleSystem::CleanUp()
+{
+    for ( auto& pool: pools) {
+        if ( pool.vbo != 0)
+            glDeleteBuffers( 1, &pool.vbo);
+        if ( pool.vao != 0) {
+            glDeleteVertexArrays( 1, &pool.vao);
+            glState.ForgetVertexArray( pool.vao);
+        }
+    }
+    pools.clear();
+    budget = MAX_PARTICLES;
+    freeEmitters.clear();
+    debris = fire = -1;
+}
+
+
+int ParticleSystem::AddType( const ParticleType& type, size_t capacity)
+{
+    if ( capacity == 0 || capacity > budget)
+        return -1;
+    budget -= capacity;
+
+    pools.emplace_back();
+    Pool& pool = pools.back();
+    pool.type = type;
+    pool.capacity = capacity;
+    for ( auto array: { &pool.x, &pool.y, &pool.z, &pool.vx, &pool.vy, &pool.vz, &pool.life})
+        array->resize( capacity);
+
+    // one array after the other, the attributes never move
+    glGenVertexArrays( 1, &pool.vao);
+    glGenBuffers( 1, &pool.vbo);
+    glState.BindVertexArray( pool.vao);
+    glBindBuffer( GL_ARRAY_BUFFER, pool.vbo);
+    glBufferData( GL_ARRAY_BUFFER, capacity * 4 * sizeof( float), nullptr, GL_STREAM_DRAW);
+    for ( GLuint attribute = 0; attribute < 4; ++attribute) {
+        glEnableVertexAttribArray( attribute);
+        glVertexAttribPointer( attribute, 1, GL_FLOAT, GL_FALSE, sizeof( float), (void*)( attribute * capacity * sizeof( float)));
+    }
+    glState.BindVertexArray( 0);
+    return (int)pools.size() - 1;
+}
+
+
+bool ParticleSystem::Emit( int type, const glm::vec3& position, float radius, const glm::vec3& velocity, float speed, size_t count, float duration)
+{
+    if ( type < 0 || type >= (int)pools.size() || freeEmitters.empty())
+        return false;
+
+    Emitter& emitter = emitters[freeEmitters.back()];
+    freeEmitters.pop_back();
+    emitter.active = true;
+    emitter.type = type;
+    emitter.position = position;
+    emitter.radius = radius;
+    emitter.velocity = velocity;
+    emitter.speed = speed;
+    emitter.remaining = count;
+    emitter.rate = count / std::max( duration, 0.001f);
+    emitter.carry = 0.0f;
+    return true;
+}
+
+
+void ParticleSystem::Explode( const glm::vec3& position, float radius)
+{
+    Emit( debris, position, radius, glm::vec3( 0.0f), radius * 6.0f, 200000, 0.4f);
+    Emit( fire, position, radius * 0.8f, glm::vec3( 0.0f), radius * 10.0f, 60000, 0.25f);
+}
+
+
+void ParticleSystem::Spawn( Pool& pool, const Emitter& emitter, size_t count)
+{
+    std::uniform_real_distribution<float> unit( 0.0f, 1.0f);
+    std::normal_distribution<float> normal;
+    count = std::min( count, pool.capacity - pool.count);
+    for ( size_t n = 0; n < count; ++n) {
+        glm::vec3 direction( normal( random), normal( random), normal( random));
+        float length = glm::length( direction);
+        direction = length > 0.0001f ? direction / length : glm::vec3( 0.0f, 1.0f, 0.0f);
+
+        glm::vec3 p = emitter.position + direction * emitter.radius * ( 0.7f + 0.3f * unit( random));
+        glm::vec3 v = emitter.velocity + direction * emitter.speed * ( 0.2f + 0.8f * unit( random));
+        size_t i = pool.count++;
+        pool.x[i] = p.x;
+        pool.y[i] = p.y;
+        pool.z[i] = p.z;
+        pool.vx[i] = v.x;
+        pool.vy[i] = v.y;
+        pool.vz[i] = v.z;
+        pool.life[i] = pool.type.lifetime * ( 0.5f + 0.5f * unit( random));
+    }
+}
+
+
+// v *= drag, p += v * dt, life -= dt
+void ParticleSystem::Integrate( Pool& pool, size_t first, size_t last, float dt, float drag)
+{
+    float* x = pool.x.data();
+    float* y = pool.y.data();
+    float* z = pool.z.data();
+    float* vx = pool.vx.data();
+    float* vy = pool.vy.data();
+    float* vz = pool.vz.data();
+    float* life = pool.life.data();
+
+    size_t i = first;
+#ifdef PARTICLES_SSE2
+    const __m128 DT = _mm_set1_ps( dt);
+    const __m128 DRAG = _mm_set1_ps( drag);
+    for ( ; i + 4 <= last; i += 4) {
+        __m128 VX = _mm_mul_ps( _mm_loadu_ps( vx + i), DRAG);
+        __m128 VY = _mm_mul_ps( _mm_loadu_ps( vy + i), DRAG);
+        __m128 VZ = _mm_mul_ps( _mm_loadu_ps( vz + i), DRAG);
+        _mm_storeu_ps( vx + i, VX);
+        _mm_storeu_ps( vy + i, VY);
+        _mm_storeu_ps( vz + i, VZ);
+        _mm_storeu_ps( x + i, _mm_add_ps( _mm_loadu_ps( x + i), _mm_mul_ps( VX, DT)));
+        _mm_storeu_ps( y + i, _mm_add_ps( _mm_loadu_ps( y + i), _mm_mul_ps( VY, DT)));
+        _mm_storeu_ps( z + i, _mm_add_ps( _mm_loadu_ps( z + i), _mm_mul_ps( VZ, DT)));
+        _mm_storeu_ps( life + i, _mm_sub_ps( _mm_loadu_ps( life + i), DT));
+    }
+#endif
+    for ( ; i < last; ++i) {
+        vx[i] *= drag;
+        vy[i] *= drag;
+        vz[i] *= drag;
+        x[i] += vx[i] * dt;
+        y[i] += vy[i] * dt;
+        z[i] += vz[i] * dt;
+        life[i] -= dt;
+    }
+}
+
+
+// The last live particle moves into every dead one's place
+void ParticleSystem::Compact( Pool& pool)
+{
+    size_t i = 0;
+    while ( i < pool.count) {
+        if ( pool.life[i] > 0.0f) {
+            ++i;
+            continue;
+        }
+        size_t last = --pool.count;
+        pool.x[i] = pool.x[last];
+        pool.y[i] = pool.y[last];
+        pool.z[i] = pool.z[last];
+        pool.vx[i] = pool.vx[last];
+        pool.vy[i] = pool.vy[last];
+        pool.vz[i] = pool.vz[last];
+        pool.life[i] = pool.life[last];
+    }
+}
+
+
+void ParticleSystem::Update( float dt)
+{
+    // the emitters first, the new ones move this frame too
+    for ( int e = 0; e < MAX_EMITTERS; ++e) {
+        Emitter& emitter = emitters[e];
+        if ( !emitter.active)
+            continue;
+        float wanted = emitter.rate * dt + emitter.carry;
+        size_t count = std::min( emitter.remaining, (size_t)wanted);
+        emitter.carry = wanted - (float)(size_t)wanted;
+        Spawn( pools[emitter.type], emitter, count);
+        emitter.remaining -= count;
+        if ( emitter.remaining == 0) {
+            emitter.active = false;
+            freeEmitters.push_back( e);
+        }
+    }
+
+    for ( auto& pool: pools) {
+        if ( pool.count == 0)
+            continue;
+        float drag = std::pow( pool.type.drag, dt);
+        unsigned int blocks = (unsigned int)( ( pool.count + BLOCK_SIZE - 1) / BLOCK_SIZE);
+        threadPool.ParallelFor( blocks, [&]( unsigned int block) {
+            Integrate( pool, block * BLOCK_SIZE, std::min( pool.count, ( block + 1) * BLOCK_SIZE), dt, drag);
+        });
+        Compact( pool);
+    }
+}
+
+
+void ParticleSystem::Draw( Shader& shader, const glm::mat4& view, const glm::mat4& projection, float viewportHeight)
+{
+    bool any = false;
+    for ( auto& pool: pools)
+        any = any || pool.count > 0;
+    if ( !any)
+        return;
+
+    shader.Use();
+    shader.setMat4( "view", view);
+    shader.setMat4( "projection", projection);
+    shader.setFloat( "pointScale", viewportHeight * projection[1][1] * 0.5f);
+
+    // seen through, so no depth writes and no sorting
+    glState.DepthMask( GL_FALSE);
+    for ( auto& pool: pools) {
+        if ( pool.count == 0)
+            continue;
+
+        glBindBuffer( GL_ARRAY_BUFFER, pool.vbo);
+        glBufferData( GL_ARRAY_BUFFER, pool.capacity * 4 * sizeof( float), nullptr, GL_STREAM_DRAW);
+        const std::vector<float>* arrays[4] = { &pool.x, &pool.y, &pool.z, &pool.life };
+        for ( size_t a = 0; a < 4; ++a)
+            glBufferSubData( GL_ARRAY_BUFFER, a * pool.capacity * sizeof( float), pool.count * sizeof( float), arrays[a]->data());
+
+        shader.setVec3( "startColor", pool.type.startColor);
+        shader.setVec3( "endColor", pool.type.endColor);
+        shader.setFloat( "size", pool.type.size);
+        shader.setFloat( "lifetime", pool.type.lifetime);
+        // the shader puts out premultiplied alpha
+        glState.BlendFunc( GL_ONE, pool.type.additive ? GL_ONE : GL_ONE_MINUS_SRC_ALPHA);
+        glState.BindVertexArray( pool.vao);
+        glDrawArrays( GL_POINTS, 0, (GLsizei)pool.count);
+    }
+    glState.BlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glState.DepthMask( GL_TRUE);
+}
+
+
+size_t ParticleSystem::GetLiveCount()
+{
+    size_t count = 0;
+    for ( auto& pool: pools)
+        count += pool.count;
+    return count;
+}
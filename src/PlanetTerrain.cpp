@@ -0,0 +1,631 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "PlanetTerrain.hpp"
+#include "ThreadPool.hpp"
+#include "GLState.hpp"
+
+PlanetTerrain planetTerrain;
+extern ThreadPool threadPool;
+extern GLStateCache glState;
+
+// The cube faces, u x v = n so the grid triangles face outwards on all of them
+static const glm::vec3 FACE_N[6] = { { 1, 0, 0}, {-1, 0, 0}, { 0, 1, 0}, { 0,-1, 0}, { 0, 0, 1}, { 0, 0,-1} };
+static const glm::vec3 FACE_U[6] = { { 0, 0,-1}, { 0, 0, 1}, { 1, 0, 0}, { 1, 0, 0}, { 1, 0, 0}, {-1, 0, 0} };
+static const glm::vec3 FACE_V[6] = { { 0, 1, 0}, { 0, 1, 0}, { 0, 0,-1}, { 0, 0, 1}, { 0, 1, 0}, { 0, 1, 0} };
+
+static const int OCTAVES = 14;
+
+
+static inline uint32_t Hash( int x, int y, int z, uint32_t seed)
+{
+    uint32_t h = seed * 0x9e3779b9u ^ (uint32_t)x * 0x85ebca6bu ^ (uint32_t)y * 0xc2b2ae35u ^ (uint32_t)z * 0x27d4eb2fu;
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    h *= 0x297a2d39u;
+    h ^= h >> 15;
+    return h;
+}
+
+// Perlin's twelve cube edge gradients
+static inline float Gradient( uint32_t h, float x, float y, float z)
+{
+    switch ( h % 12) {
+    case 0:  return  x + y;
+    case 1:  return -x + y;
+    case 2:  return  x - y;
+    case 3:  return -x - y;
+    case 4:  return  x + z;
+    case 5:  return -x + z;
+    case 6:  return  x - z;
+    case 7:  return -x - z;
+    case 8:  return  y + z;
+    case 9:  return -y + z;
+    case 10: return  y - z;
+    default: return -y - z;
+    }
+}
+
+static inline float Fade( float t) { return t * t * t * ( t * ( t * 6.0f - 15.0f) + 10.0f); }
+
+// Gradient noise, about -1..1
+static float Noise( const glm::vec3& p, uint32_t seed)
+{
+    int x = (int)std::floor( p.x), y = (int)std::floor( p.y), z = (int)std::floor( p.z);
+    float fx = p.x - x, fy = p.y - y, fz = p.z - z;
+    float u = Fade( fx), v = Fade( fy), w = Fade( fz);
+
+    float n000 = Gradient( Hash( x,     y,     z,     seed), fx,        fy,        fz);
+    float n100 = Gradient( Hash( x + 1, y,     z,     seed), fx - 1.0f, fy,        fz);
+    float n010 = Gradient( Hash( x,     y + 1, z,     seed), fx,        fy - 1.0f, fz);
+    float n110 = Gradient( Hash( x + 1, y + 1, z,     seed), fx - 1.0f, fy - 1.0f, fz);
+    float n001 = Gradient( Hash( x,     y,     z + 1, seed), fx,        fy,        fz - 1.0f);
+    float n101 = Gradient( Hash( x + 1, y,     z + 1, seed), fx - 1.0f, fy,        fz - 1.0f);
+    float n011 = Gradient( Hash( x,     y + 1, z + 1, seed), fx,        fy - 1.0f, fz - 1.0f);
+    float n111 = Gradient( Hash( x + 1, y + 1, z + 1, seed), fx - 1.0f, fy - 1.0f, fz - 1.0f);
+
+    float nx00 = n000 + u * ( n100 - n000);
+    float nx10 = n010 + u * ( n110 - n010);
+    float nx01 = n001 + u * ( n101 - n001);
+    float nx11 = n011 + u * ( n111 - n011);
+    float nxy0 = nx00 + v * ( nx10 - nx00);
+    float nxy1 = nx01 + v * ( nx11 - nx01);
+    return nxy0 + w * ( nxy1 - nxy0);
+}
+
+// The terrain height on the unit sphere, below 0 is sea
+static float TerrainHeight( const glm::vec3& direction, uint32_t seed)
+{
+    float height = 0.0f;
+    float amplitude = 0.5f;
+    glm::vec3 p = direction * 1.6f;
+    for ( int octave = 0; octave < OCTAVES; ++octave) {
+        height += amplitude * Noise( p, seed * OCTAVES + octave);
+        p *= 2.03f;
+        amplitude *= 0.5f;
+    }
+    return height + 0.05f;
+}
+
+
+float PlanetTerrain::GetHeight( const glm::vec3& direction, unsigned int seed)
+{
+    return TerrainHeight( glm::normalize( direction), seed & 0xffff);
+}
+
+
+// seed 16 bits | face 3 | level 4 | x 12 | y 12
+uint64_t PlanetTerrain::MakeKey( unsigned int seed, int face, int level, int x, int y)
+{
+    return ( (uint64_t)( seed & 0xffff) << 31) | ( (uint64_t)face << 28) | ( (uint64_t)level << 24) | ( (uint64_t)x << 12) | (uint64_t)y;
+}
+
+
+// Runs on the workers, the heights of one patch with a border of one
+void PlanetTerrain::Generate( uint64_t key, std::vector<float>& texels)
+{
+    uint32_t seed = (uint32_t)( key >> 31);
+    int face = (int)( key >> 28) & 7;
+    int level = (int)( key >> 24) & 15;
+    int x = (int)( key >> 12) & 0xfff;
+    int y = (int)key & 0xfff;
+
+    float step = 2.0f / ( ( GRID_SIZE - 1) << level);
+    float u0 = -1.0f + x * ( GRID_SIZE - 1) * step;
+    float v0 = -1.0f + y * ( GRID_SIZE - 1) * step;
+
+    texels.resize( TILE_SIZE * TILE_SIZE * 2);
+    for ( int j = 0; j < TILE_SIZE; ++j) {
+        for ( int i = 0; i < TILE_SIZE; ++i) {
+            glm::vec3 cube = FACE_N[face] + ( u0 + ( i - 1) * step) * FACE_U[face] + ( v0 + ( j - 1) * step) * FACE_V[face];
+            float height = TerrainHeight( glm::normalize( cube), seed);
+            texels[( j * TILE_SIZE + i) * 2] = std::max( height, 0.0f);    // the sea is flat
+            texels[( j * TILE_SIZE + i) * 2 + 1] = height;
+        }
+    }
+}
+
+
+bool PlanetTerrain::Init()
+{
+    // The grid, then a skirt vertex under every edge vertex: z = 1
+    std::vector<GLfloat> vertices;
+    for ( int y = 0; y < GRID_SIZE; ++y)
+        for ( int x = 0; x < GRID_SIZE; ++x)
+            vertices.insert( vertices.end(), { (GLfloat)x, (GLfloat)y, 0.0f});
+
+    // the edge counterclockwise, so the skirts face outwards
+    std::vector<GLushort> edge;
+    for ( int x = 0; x < GRID_SIZE - 1; ++x)
+        edge.push_back( (GLushort)x);
+    for ( int y = 0; y < GRID_SIZE - 1; ++y)
+        edge.push_back( (GLushort)( y * GRID_SIZE + GRID_SIZE - 1));
+    for ( int x = GRID_SIZE - 1; x > 0; --x)
+        edge.push_back( (GLushort)( ( GRID_SIZE - 1) * GRID_SIZE + x));
+    for ( int y = GRID_SIZE - 1; y > 0; --y)
+        edge.push_back( (GLushort)( y * GRID_SIZE));
+    GLushort skirt = (GLushort)( vertices.size() / 3);
+    for ( GLushort index: edge)
+        vertices.insert( vertices.end(), { vertices[index * 3], vertices[index * 3 + 1], 1.0f});
+
+    // The diagonals all go from (x,y) to (x+1,y+1), the same as the ones of the coarser grid,
+    // so a morphed odd vertex lies on a coarse edge
+    std::vector<GLushort> indices;
+    for ( int y = 0; y < GRID_SIZE - 1; ++y) {
+        for ( int x = 0; x < GRID_SIZE - 1; ++x) {
+            GLushort a = (GLushort)( y * GRID_SIZE + x);
+            GLushort b = a + 1;
+            GLushort c = b + GRID_SIZE;
+            GLushort d = a + GRID_SIZE;
+            indices.insert( indices.end(), { a, b, c, a, c, d});
+        }
+    }
+    for ( size_t i = 0; i < edge.size(); ++i) {
+        GLushort a = edge[i];
+        GLushort b = edge[( i + 1) % edge.size()];
+        GLushort sa = (GLushort)( skirt + i);
+        GLushort sb = (GLushort)( skirt + ( i + 1) % edge.size());
+        indices.insert( indices.end(), { a, sa, b, b, sa, sb});
+    }
+    indexCount = (GLsizei)indices.size();
+
+    glGenVertexArrays( 1, &vao);
+    glGenBuffers( 1, &vbo);
+    glGenBuffers( 1, &ebo);
+    glState.BindVertexArray( vao);
+    glBindBuffer( GL_ARRAY_BUFFER, vbo);
+    glBufferData( GL_ARRAY_BUFFER, vertices.size() * sizeof( GLfloat), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof( GLushort), indices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray( 0);
+    glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof( GLfloat), (void*)0);
+    glState.BindVertexArray( 0);
+
+    // Displacement and raw height (for the sea colour) of every patch, only ever texelFetch'ed
+    glGenTextures( 1, &atlas);
+    glState.BindTexture( 0, GL_TEXTURE_2D, atlas);
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_RG32F, ATLAS_COLUMNS * TILE_SIZE, ATLAS_COLUMNS * TILE_SIZE, 0, GL_RG, GL_FLOAT, nullptr);
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+    freeSlots.clear();
+    for ( int slot = ATLAS_TILES - 1; slot >= 0; --slot)
+        freeSlots.push_back( slot);
+    generated = std::make_shared<Generated>();
+
+    if ( glGetError() != GL_NO_ERROR) {
+        std::cout << "\n  Planet terrain: could not create the height atlas";
+        return false;
+    }
+    return true;
+}
+
+
+void PlanetTerrain::CleanUp()
+{
+    if ( generated) {
+        {
+            std::unique_lock<std::mutex> lock( generated->mutex);
+            generated->stopping = true;
+            generated->ready.clear();
+        }
+        threadPool.Wait();
+        generated.reset();
+    }
+    inFlight = 0;
+    tiles.clear();
+    freeSlots.clear();
+    starved.clear();
+    requests.clear();
+
+    if ( atlas != 0) {
+        glDeleteTextures( 1, &atlas);
+        glState.ForgetTexture( atlas);
+    }
+    if ( ebo != 0)
+        glDeleteBuffers( 1, &ebo);
+    if ( vbo != 0)
+        glDeleteBuffers( 1, &vbo);
+    if ( vao != 0) {
+        glDeleteVertexArrays( 1, &vao);
+        glState.ForgetVertexArray( vao);
+    }
+    atlas = ebo = vbo = vao = 0;
+    locationsProgram = 0;
+}
+
+
+bool PlanetTerrain::Prepare( unsigned int seed)
+{
+    std::vector<Heights> roots;
+    for ( int face = 0; face < 6; ++face) {
+        uint64_t key = MakeKey( seed, face, 0, 0, 0);
+        if ( tiles.find( key) == tiles.end())
+            roots.push_back( Heights{ key, {}});
+    }
+    if ( roots.empty())
+        return true;
+    if ( starved.count( seed & 0xffff))
+        return false;
+
+    // The slots first, no use making the heights when they can't be stored
+    std::vector<int> slots;
+    for ( size_t i = 0; i < roots.size(); ++i) {
+        int slot = FreeSlot();
+        if ( slot < 0) {
+            freeSlots.insert( freeSlots.end(), slots.begin(), slots.end());
+            starved.insert( seed & 0xffff);
+            std::cout << "  Planet terrain: the atlas is full of roots, no terrain for planet " << seed << "\n";
+            return false;
+        }
+        slots.push_back( slot);
+    }
+
+    threadPool.ParallelFor( (unsigned int)roots.size(), [&]( unsigned int i) {
+        Generate( roots[i].key, roots[i].texels);
+    });
+    for ( size_t i = 0; i < roots.size(); ++i) {
+        Tile& tile = tiles[roots[i].key];
+        tile.pinned = true;
+        tile.slot = slots[i];
+        tile.lastUsed = frame;
+        Store( slots[i], roots[i].texels);
+    }
+    return true;
+}
+
+
+void PlanetTerrain::Remove( unsigned int seed)
+{
+    for ( int face = 0; face < 6; ++face) {
+        auto found = tiles.find( MakeKey( seed, face, 0, 0, 0));
+        if ( found == tiles.end())
+            continue;
+        if ( found->second.slot >= 0) {
+            freeSlots.push_back( found->second.slot);
+            starved.clear();
+        }
+        tiles.erase( found);
+    }
+}
+
+
+void PlanetTerrain::Update()
+{
+    if ( !generated || inFlight == 0)
+        return;
+
+    std::vector<Heights> ready;
+    {
+        std::unique_lock<std::mutex> lock( generated->mutex);
+        size_t count = std::min( generated->ready.size(), (size_t)UPLOADS_PER_FRAME);
+        ready.assign( std::make_move_iterator( generated->ready.begin()), std::make_move_iterator( generated->ready.begin() + count));
+        generated->ready.erase( generated->ready.begin(), generated->ready.begin() + count);
+    }
+    inFlight -= (int)ready.size();
+    for ( auto& heights: ready)
+        Upload( heights);
+}
+
+
+void PlanetTerrain::Upload( const Heights& heights)
+{
+    auto found = tiles.find( heights.key);
+    if ( found == tiles.end())
+        return;
+    int slot = FreeSlot();
+    if ( slot < 0) {
+        // everything is in use, try again when it isn't. A root only once Remove() frees one.
+        if ( found->second.pinned)
+            starved.insert( (unsigned int)( heights.key >> 31));
+        tiles.erase( found);
+        return;
+    }
+    found->second.slot = slot;
+    found->second.lastUsed = frame;
+    Store( slot, heights.texels);
+}
+
+
+void PlanetTerrain::Store( int slot, const std::vector<float>& texels)
+{
+    glState.BindTexture( 0, GL_TEXTURE_2D, atlas);
+    glTexSubImage2D( GL_TEXTURE_2D, 0, ( slot % ATLAS_COLUMNS) * TILE_SIZE, ( slot / ATLAS_COLUMNS) * TILE_SIZE,
+                     TILE_SIZE, TILE_SIZE, GL_RG, GL_FLOAT, texels.data());
+}
+
+
+// A free slot, or the one of the least recently used patch not drawn this frame
+int PlanetTerrain::FreeSlot()
+{
+    if ( !freeSlots.empty()) {
+        int slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+
+    auto oldest = tiles.end();
+    for ( auto it = tiles.begin(); it != tiles.end(); ++it) {
+        const Tile& tile = it->second;
+        if ( tile.slot >= 0 && !tile.pinned && tile.lastUsed < frame && ( oldest == tiles.end() || tile.lastUsed < oldest->second.lastUsed))
+            oldest = it;
+    }
+    if ( oldest == tiles.end())
+        return -1;
+    int slot = oldest->second.slot;
+    tiles.erase( oldest);
+    return slot;
+}
+
+
+bool PlanetTerrain::Resident( uint64_t key)
+{
+    auto found = tiles.find( key);
+    if ( found == tiles.end() || found->second.slot < 0)
+        return false;
+    found->second.lastUsed = frame;
+    return true;
+}
+
+
+void PlanetTerrain::Request( uint64_t key, bool root)
+{
+    if ( tiles.find( key) != tiles.end() || ( !root && inFlight + (int)requests.size() >= MAX_IN_FLIGHT))
+        return;
+    tiles[key].pinned = root;
+    requests.push_back( key);
+}
+
+
+void PlanetTerrain::Dispatch()
+{
+    if ( requests.empty())
+        return;
+
+    if ( synchronous) {
+        std::vector<Heights> done( requests.size());
+        threadPool.ParallelFor( (unsigned int)requests.size(), [&]( unsigned int i) {
+            done[i].key = requests[i];
+            Generate( done[i].key, done[i].texels);
+        });
+        for ( auto& heights: done)
+            Upload( heights);
+        requests.clear();
+        return;
+    }
+
+    for ( uint64_t key: requests) {
+        std::shared_ptr<Generated> state = generated;
+        threadPool.Enqueue( [state, key]() {
+            {
+                std::unique_lock<std::mutex> lock( state->mutex);
+                if ( state->stopping)
+                    return;
+            }
+            Heights heights;
+            heights.key = key;
+            Generate( key, heights.texels);
+
+            std::unique_lock<std::mutex> lock( state->mutex);
+            state->ready.push_back( std::move( heights));
+        });
+    }
+    inFlight += (int)requests.size();
+    requests.clear();
+}
+
+
+void PlanetTerrain::Begin( const glm::mat4& View, const glm::mat4& Projection, float ViewportHeight, int maxLevel)
+{
+    view = View;
+    projection = Projection;
+    levelLimit = std::min( maxLevel, (int)MAX_LEVEL);
+    planets.clear();
+    patches.clear();
+    frame++;
+
+    // A patch splits when its grid spacing gets bigger than maxPixelError pixels. Never later than
+    // four patch sizes away though, the morph needs the neighbours to be at most one level apart.
+    float pixelsPerUnit = ViewportHeight * Projection[1][1] * 0.5f;
+    for ( int level = 0; level <= MAX_LEVEL; ++level) {
+        float size = 2.0f / ( 1 << level);
+        splitDistance[level] = std::max( size / ( GRID_SIZE - 1) * pixelsPerUnit / maxPixelError, 4.0f * size);
+    }
+}
+
+
+void PlanetTerrain::Add( const glm::mat4& model, unsigned int seed, float fade)
+{
+    Planet planet;
+    planet.model = model;
+    planet.seed = seed;
+    planet.fade = fade;
+    planet.cameraLocal = glm::vec3( glm::inverse( view * model) * glm::vec4( 0.0f, 0.0f, 0.0f, 1.0f));
+
+    // Gribb/Hartmann, the planes of the frustum in model space
+    glm::mat4 m = projection * view * model;
+    for ( int i = 0; i < 3; ++i) {
+        for ( int side = 0; side < 2; ++side) {
+            glm::vec4 plane;
+            for ( int c = 0; c < 4; ++c)
+                plane[c] = m[c][3] + ( side == 0 ? m[c][i] : -m[c][i]);
+            planet.planes[i * 2 + side] = plane / glm::length( glm::vec3( plane));
+        }
+    }
+    for ( auto& plane: planet.planes)
+        if ( glm::dot( glm::vec3( plane), glm::vec3( 0.0f)) + plane.w < -( 1.0f + amplitude))
+            return;
+
+    // the roots come from the workers like any patch, the planet waits for all six
+    if ( starved.count( seed & 0xffff))
+        return;
+    bool rooted = true;
+    for ( int face = 0; face < 6; ++face) {
+        uint64_t key = MakeKey( seed, face, 0, 0, 0);
+        if ( !Resident( key)) {
+            Request( key, true);
+            rooted = false;
+        }
+    }
+    if ( !rooted)
+        return;
+
+    planets.push_back( planet);
+    for ( int face = 0; face < 6; ++face)
+        Select( planets.back(), face, 0, 0, 0);
+}
+
+
+void PlanetTerrain::Select( Planet& planet, int face, int level, int x, int y)
+{
+    float size = 2.0f / ( 1 << level);
+    float u0 = -1.0f + x * size;
+    float v0 = -1.0f + y * size;
+    const glm::vec3& n = FACE_N[face];
+    const glm::vec3& u = FACE_U[face];
+    const glm::vec3& v = FACE_V[face];
+
+    // Bounds: the patch from the sea floor to the highest mountain
+    glm::vec3 center = glm::normalize( n + ( u0 + size * 0.5f) * u + ( v0 + size * 0.5f) * v);
+    glm::vec3 corners[4] = {
+        glm::normalize( n + u0 * u + v0 * v),
+        glm::normalize( n + ( u0 + size) * u + v0 * v),
+        glm::normalize( n + u0 * u + ( v0 + size) * v),
+        glm::normalize( n + ( u0 + size) * u + ( v0 + size) * v) };
+    float cosAngle = 1.0f;
+    for ( auto& corner: corners)
+        cosAngle = std::min( cosAngle, glm::dot( center, corner));
+    glm::vec3 boundsCenter = center * ( ( cosAngle + 1.0f + amplitude) * 0.5f);
+    float radius = glm::length( center * ( 1.0f + amplitude) - boundsCenter);
+    for ( auto& corner: corners)
+        radius = std::max( radius, std::max( glm::length( corner - boundsCenter), glm::length( corner * ( 1.0f + amplitude) - boundsCenter)));
+
+    for ( auto& plane: planet.planes)
+        if ( glm::dot( glm::vec3( plane), boundsCenter) + plane.w < -radius)
+            return;
+
+    // behind the horizon, mountains included
+    float cameraDistance = glm::length( planet.cameraLocal);
+    if ( cameraDistance > 1.0f + amplitude) {
+        float toCamera = std::acos( glm::clamp( glm::dot( center, planet.cameraLocal / cameraDistance), -1.0f, 1.0f));
+        float horizon = std::acos( 1.0f / cameraDistance) + std::acos( 1.0f / ( 1.0f + amplitude)) + std::acos( glm::clamp( cosAngle, -1.0f, 1.0f));
+        if ( toCamera > horizon)
+            return;
+    }
+
+    float distance = std::max( 0.0f, glm::length( planet.cameraLocal - boundsCenter) - radius);
+    if ( level < levelLimit && distance < splitDistance[level]) {
+        bool ready = true;
+        for ( int child = 0; child < 4; ++child) {
+            uint64_t key = MakeKey( planet.seed, face, level + 1, x * 2 + ( child & 1), y * 2 + ( child >> 1));
+            if ( !Resident( key)) {
+                Request( key);
+                ready = false;
+            }
+        }
+        if ( ready) {
+            for ( int child = 0; child < 4; ++child)
+                Select( planet, face, level + 1, x * 2 + ( child & 1), y * 2 + ( child >> 1));
+            return;
+        }
+    }
+
+    int slot = tiles[MakeKey( planet.seed, face, level, x, y)].slot;
+    if ( slot < 0)
+        return;
+    Patch patch;
+    float step = size / ( GRID_SIZE - 1);
+    patch.origin = n + u0 * u + v0 * v;
+    patch.stepU = u * step;
+    patch.stepV = v * step;
+    patch.tileOrigin = glm::ivec2( ( slot % ATLAS_COLUMNS) * TILE_SIZE, ( slot / ATLAS_COLUMNS) * TILE_SIZE);
+    // fully morphed where the parent would be drawn instead
+    if ( level == 0)
+        patch.morphRange = glm::vec2( FLT_MAX, 0.0f);
+    else {
+        float end = splitDistance[level - 1];
+        patch.morphRange = glm::vec2( end * 0.7f, 1.0f / ( end * 0.3f));
+    }
+    patch.skirtDepth = size * 0.02f;
+    patch.planet = (int)planets.size() - 1;
+    patches.push_back( patch);
+}
+
+
+void PlanetTerrain::Draw( Shader& shader, bool wireframe)
+{
+    Dispatch();
+    if ( patches.empty())
+        return;
+
+    shader.Use();
+    if ( locationsProgram != shader.Program) {
+        locationsProgram = shader.Program;
+        uModel = glGetUniformLocation( shader.Program, "model");
+        uView = glGetUniformLocation( shader.Program, "view");
+        uProjection = glGetUniformLocation( shader.Program, "projection");
+        uCameraLocal = glGetUniformLocation( shader.Program, "cameraLocal");
+        uPatchOrigin = glGetUniformLocation( shader.Program, "patchOrigin");
+        uPatchStepU = glGetUniformLocation( shader.Program, "patchStepU");
+        uPatchStepV = glGetUniformLocation( shader.Program, "patchStepV");
+        uTileOrigin = glGetUniformLocation( shader.Program, "tileOrigin");
+        uMorphRange = glGetUniformLocation( shader.Program, "morphRange");
+        uSkirtDepth = glGetUniformLocation( shader.Program, "skirtDepth");
+        uAmplitude = glGetUniformLocation( shader.Program, "amplitude");
+        uSunDirection = glGetUniformLocation( shader.Program, "sunDirection");
+        uHeights = glGetUniformLocation( shader.Program, "heights");
+        uWireframe = glGetUniformLocation( shader.Program, "wireframe_enable");
+        uWireframeColor = glGetUniformLocation( shader.Program, "wireframeColor");
+        uFade = glGetUniformLocation( shader.Program, "fade");
+    }
+
+    glUniformMatrix4fv( uView, 1, GL_FALSE, glm::value_ptr( view));
+    glUniformMatrix4fv( uProjection, 1, GL_FALSE, glm::value_ptr( projection));
+    glUniform1f( uAmplitude, amplitude);
+    glUniform3fv( uSunDirection, 1, glm::value_ptr( glm::normalize( sunDirection)));
+    glUniform1i( uHeights, 0);
+    glUniform1i( uWireframe, wireframe ? 1 : 0);
+    glUniform3f( uWireframeColor, 0.0f, 0.8f, 0.3f);
+    glState.BindTexture( 0, GL_TEXTURE_2D, atlas);
+    glState.BindVertexArray( vao);
+
+    int current = -1;
+    for ( const Patch& patch: patches) {
+        if ( patch.planet != current) {
+            current = patch.planet;
+            glUniformMatrix4fv( uModel, 1, GL_FALSE, glm::value_ptr( planets[current].model));
+            glUniform3fv( uCameraLocal, 1, glm::value_ptr( planets[current].cameraLocal));
+            glUniform1f( uFade, planets[current].fade);
+        }
+        glUniform3fv( uPatchOrigin, 1, glm::value_ptr( patch.origin));
+        glUniform3fv( uPatchStepU, 1, glm::value_ptr( patch.stepU));
+        glUniform3fv( uPatchStepV, 1, glm::value_ptr( patch.stepV));
+        glUniform2i( uTileOrigin, patch.tileOrigin.x, patch.tileOrigin.y);
+        glUniform2f( uMorphRange, patch.morphRange.x, patch.morphRange.y);
+        glUniform1f( uSkirtDepth, patch.skirtDepth);
+        glDrawElements( GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, (void*)0);
+    }
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+#include "ResourceArchive.hpp"
+#include "LZ4.hpp"
+
+ResourceArchive resourceArchive;
+
+static const char ARCHIVE_MAGIC[4] = { 'P', 'D', 'A', 'R' };
+static const uint32_t ARCHIVE_VERSION = 2;
+static const size_t ARCHIVE_ALIGNMENT = 16;
+
+struct ArchiveHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t entrySize;         // sizeof( ArchiveEntry)
+    uint32_t entryCount;
+    uint64_t directoryOffset;
+    uint64_t namesOffset;
+    uint64_t namesSize;
+};
+
+static uint64_t HashName( const std::string& name)
+{
+    return HashBytes( name.data(), name.size());
+}
+
+
+bool ResourceArchive::Open( const std::string& path)
+{
+    Close();
+    if ( !file.Open( path))
+        return false;
+
+    const unsigned char* data = file.GetData();
+    size_t size = file.GetSize();
+    ArchiveHeader header;
+    if ( size < sizeof( header)) {
+        Close();
+        return false;
+    }
+    memcpy( &header, data, sizeof( header));
+    // the directory and the names must lie inside the file, then Find() needs no more checks
+    if ( memcmp( header.magic, ARCHIVE_MAGIC, sizeof( ARCHIVE_MAGIC)) != 0 || header.version != ARCHIVE_VERSION
+         || header.entrySize != sizeof( ArchiveEntry) || header.directoryOffset % alignof( ArchiveEntry) != 0
+         || header.directoryOffset > size || header.entryCount > ( size - header.directoryOffset) / sizeof( ArchiveEntry)
+         || header.namesOffset > size || header.namesSize > size - header.namesOffset) {
+        std::cout << "Not a resource archive: " << path << std::endl;
+        Close();
+        return false;
+    }
+
+    entries = (const ArchiveEntry*)( data + header.directoryOffset);
+    entryCount = header.entryCount;
+    names = (const char*)( data + header.namesOffset);
+    for ( size_t i = 0; i < entryCount; ++i) {
+        const ArchiveEntry& entry = entries[i];
+        if ( entry.offset > size || entry.storedSize > size - entry.offset
+             || (uint64_t)entry.nameOffset + entry.nameLength > header.namesSize) {
+            std::cout << "Broken resource archive: " << path << std::endl;
+            Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void ResourceArchive::Close()
+{
+    file.Close();
+    entries = nullptr;
+    entryCount = 0;
+    names = nullptr;
+}
+
+
+const ArchiveEntry* ResourceArchive::Find( const std::string& path) const
+{
+    if ( entries == nullptr)
+        return nullptr;
+
+    std::string name = CanonicalPath( path);
+    uint64_t hash = HashName( name);
+    const ArchiveEntry* end = entries + entryCount;
+    const ArchiveEntry* entry = std::lower_bound( entries, end, hash,
+        []( const ArchiveEntry& e, uint64_t h) { return e.hash < h; });
+    // two names with the same hash are next to each other
+    for ( ; entry != end && entry->hash == hash; ++entry) {
+        if ( entry->nameLength != name.size() || memcmp( names + entry->nameOffset, name.data(), name.size()) != 0)
+            continue;
+        // edited since the cook, the loose file is newer
+        uint64_t size, time;
+        if ( GetFileStamp( name, size, time) && ( size != entry->sourceSize || time != entry->sourceTime))
+            return nullptr;
+        return entry;
+    }
+    return nullptr;
+}
+
+
+const unsigned char* ResourceArchive::GetData( const ArchiveEntry& entry) const
+{
+    if ( entry.flags & ARCHIVE_LZ4)
+        return nullptr;
+    return file.GetData() + entry.offset;
+}
+
+
+bool ResourceArchive::Read( const ArchiveEntry& entry, std::vector<unsigned char>& data) const
+{
+    const unsigned char* stored = file.GetData() + entry.offset;
+    if ( !( entry.flags & ARCHIVE_LZ4)) {
+        data.assign( stored, stored + entry.storedSize);
+        return true;
+    }
+    data.resize( entry.size);
+    return LZ4Decompress( stored, entry.storedSize, data.data(), data.size());
+}
+
+
+bool ResourceArchive::Read( const std::string& path, std::vector<unsigned char>& data) const
+{
+    const ArchiveEntry* entry = Find( path);
+    return entry != nullptr && Read( *entry, data);
+}
+
+
+const unsigned char* ResourceArchive::Get( const ArchiveEntry& entry, std::vector<unsigned char>& buffer) const
+{
+    if ( const unsigned char* data = GetData( entry))
+        return data;
+    return Read( entry, buffer) ? buffer.data() : nullptr;
+}
+
+
+void ArchiveWriter::Add( const std::string& path, const std::vector<unsigned char>& data, ArchiveEntryType type)
+{
+    Item item;
+    item.name = CanonicalPath( path);
+    item.entry = ArchiveEntry();
+    item.entry.hash = HashName( item.name);
+    item.entry.size = data.size();
+    item.entry.type = type;
+    GetFileStamp( item.name, item.entry.sourceSize, item.entry.sourceTime);
+
+    LZ4Compress( data.data(), data.size(), item.stored);
+    if ( item.stored.size() < data.size())
+        item.entry.flags = ARCHIVE_LZ4;
+    else
+        item.stored = data;
+    item.entry.storedSize = item.stored.size();
+
+    size += data.size();
+    storedSize += item.stored.size();
+    items.push_back( std::move( item));
+}
+
+
+// The whole file is put together in memory and written in one go, see WriteFileAtomic()
+bool ArchiveWriter::Write( const std::string& path)
+{
+    std::sort( items.begin(), items.end(), []( const Item& a, const Item& b) {
+        return a.entry.hash != b.entry.hash ? a.entry.hash < b.entry.hash : a.name < b.name; });
+
+    std::vector<unsigned char> file( sizeof( ArchiveHeader));
+    std::string nameTable;
+    std::vector<ArchiveEntry> directory;
+    for ( auto& item: items) {
+        file.resize( ( file.size() + ARCHIVE_ALIGNMENT - 1) / ARCHIVE_ALIGNMENT * ARCHIVE_ALIGNMENT);
+        item.entry.offset = file.size();
+        item.entry.nameOffset = (uint32_t)nameTable.size();
+        item.entry.nameLength = (uint32_t)item.name.size();
+        file.insert( file.end(), item.stored.begin(), item.stored.end());
+        nameTable += item.name;
+        directory.push_back( item.entry);
+    }
+
+    ArchiveHeader header;
+    memcpy( header.magic, ARCHIVE_MAGIC, sizeof( ARCHIVE_MAGIC));
+    header.version = ARCHIVE_VERSION;
+    header.entrySize = sizeof( ArchiveEntry);
+    header.entryCount = (uint32_t)directory.size();
+    file.resize( ( file.size() + ARCHIVE_ALIGNMENT - 1) / ARCHIVE_ALIGNMENT * ARCHIVE_ALIGNMENT);
+    header.directoryOffset = file.size();
+    file.insert( file.end(), (const unsigned char*)directory.data(), (const unsigned char*)( directory.data() + directory.size()));
+    header.namesOffset = file.size();
+    header.namesSize = nameTable.size();
+    file.insert( file.end(), nameTable.begin(), nameTable.end());
+    memcpy( file.data(), &header, sizeof( header));
+
+    return WriteFileAtomic( path, file.data(), file.size());
+}
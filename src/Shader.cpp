@@ -15,67 +15,114 @@
  */
 
 #include "Shader.hpp"
+#include "GLState.hpp"
+#include "ShaderCache.hpp"
+#include "ResourceArchive.hpp"
+
+extern GLStateCache glState;
+extern ShaderCache shaderCache;
+extern ResourceArchive resourceArchive;
 
 
 // constructor generates the shader on the fly
 // ------------------------------------------------------------------------
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
+Shader::Shader(const char* vertexPath, const char* fragmentPath, VertexFormat format) : vertexFormat(format)
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
         std::string fragmentCode;
         std::ifstream vShaderFile;
         std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try
+        // 1a. from the resource archive when there is one
+        std::vector<unsigned char> vertexData, fragmentData;
+        if (resourceArchive.Read(vertexPath, vertexData) && resourceArchive.Read(fragmentPath, fragmentData))
         {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
+            vertexCode.assign(vertexData.begin(), vertexData.end());
+            fragmentCode.assign(fragmentData.begin(), fragmentData.end());
         }
-        catch (std::ifstream::failure& e)
+        else
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+            // ensure ifstream objects can throw exceptions:
+            vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+            fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+            try
+            {
+                // open files
+                vShaderFile.open(vertexPath);
+                fShaderFile.open(fragmentPath);
+                std::stringstream vShaderStream, fShaderStream;
+                // read file's buffer contents into streams
+                vShaderStream << vShaderFile.rdbuf();
+                fShaderStream << fShaderFile.rdbuf();
+                // close file handlers
+                vShaderFile.close();
+                fShaderFile.close();
+                // convert stream into string
+                vertexCode = vShaderStream.str();
+                fragmentCode = fShaderStream.str();
+            }
+            catch (std::ifstream::failure& e)
+            {
+                std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+            }
         }
+        // 2. the linked program from the last run, if the driver and the sources are the same
+        Program = glCreateProgram();
+        cacheKey = ShaderCache::Key(vertexCode, fragmentCode);
+        if (shaderCache.Load(Program, cacheKey))
+            return;
+
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
+        // 3. compile shaders, no status queries here, those would wait for the compiler
         // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
+        vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vShaderCode, NULL);
+        glCompileShader(vertexShader);
         // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &fShaderCode, NULL);
+        glCompileShader(fragmentShader);
         // shader Program
-        Program = glCreateProgram();
-        glAttachShader(Program, vertex);
-        glAttachShader(Program, fragment);
+        glAttachShader(Program, vertexShader);
+        glAttachShader(Program, fragmentShader);
+        if (ShaderCache::IsSupported())
+            glProgramParameteri(Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(Program);
-        checkCompileErrors(Program, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-
+        pending = true;
     }
 
+void Shader::FinishLink( )
+{
+    if ( !pending )
+        return;
+    pending = false;
+
+    checkCompileErrors(vertexShader, "VERTEX");
+    checkCompileErrors(fragmentShader, "FRAGMENT");
+    checkCompileErrors(Program, "PROGRAM");
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(Program, GL_LINK_STATUS, &linked);
+    if (linked)
+        shaderCache.Save(Program, cacheKey);
+
+    // delete the shaders as they're linked into our program now and no longer necessery
+    glDetachShader(Program, vertexShader);
+    glDetachShader(Program, fragmentShader);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    vertexShader = fragmentShader = 0;
+}
+
 // Delete the shader program when destroyed
+void Shader::Use( )
+{
+    if ( pending )
+        FinishLink( );
+    glState.UseProgram( Program );
+}
+
 Shader::~Shader()
 {
 //    glDeleteProgram( Program);
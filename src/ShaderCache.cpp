@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+#include "ShaderCache.hpp"
+#include "FileUtils.hpp"
+
+ShaderCache shaderCache;
+
+// In front of every binary
+struct ShaderBinaryHeader
+{
+    uint32_t magic;
+    uint32_t format;    // from glGetProgramBinary
+    uint32_t length;
+};
+
+static const uint32_t SHADER_BINARY_MAGIC = 0x42534450;  // "PDSB"
+
+
+ShaderCache::ShaderCache( const std::string& Directory) : directory( Directory)
+{
+}
+
+
+bool ShaderCache::IsSupported()
+{
+    if ( !GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+        return false;
+    GLint formats = 0;
+    glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+
+bool ShaderCache::EnableParallelCompile()
+{
+    if ( GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR( 0xffffffffu);     // as many as the driver likes
+        return true;
+    }
+    if ( GLEW_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB( 0xffffffffu);
+        return true;
+    }
+    return false;
+}
+
+
+uint64_t ShaderCache::Key( const std::string& vertexCode, const std::string& fragmentCode)
+{
+    uint64_t hash = HashBytes( nullptr, 0);
+    const GLenum driver[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+    for ( GLenum name: driver) {
+        const char* value = (const char*)glGetString( name);
+        if ( value != nullptr)
+            hash = HashBytes( value, strlen( value) + 1, hash);
+    }
+    hash = HashBytes( vertexCode.c_str(), vertexCode.size() + 1, hash);
+    return HashBytes( fragmentCode.c_str(), fragmentCode.size() + 1, hash);
+}
+
+
+std::string ShaderCache::PathOf( uint64_t key)
+{
+    char name[32];
+    snprintf( name, sizeof( name), "%016llx.bin", (unsigned long long)key);
+    return directory + "/" + name;
+}
+
+
+bool ShaderCache::Load( GLuint program, uint64_t key)
+{
+    if ( !IsSupported())
+        return false;
+
+    std::vector<unsigned char> file;
+    ShaderBinaryHeader header;
+    if ( !ReadFile( PathOf( key), file) || file.size() < sizeof( header)) {
+        misses++;
+        return false;
+    }
+    memcpy( &header, file.data(), sizeof( header));
+    if ( header.magic != SHADER_BINARY_MAGIC || header.length != file.size() - sizeof( header)) {
+        misses++;
+        return false;
+    }
+
+    // a driver may still refuse it, the program is then unlinked and can be built from source
+    glProgramBinary( program, header.format, file.data() + sizeof( header), header.length);
+    GLint linked = GL_FALSE;
+    glGetProgramiv( program, GL_LINK_STATUS, &linked);
+    if ( !linked) {
+        misses++;
+        return false;
+    }
+    hits++;
+    return true;
+}
+
+
+void ShaderCache::Save( GLuint program, uint64_t key)
+{
+    if ( !IsSupported())
+        return;
+
+    GLint length = 0;
+    glGetProgramiv( program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if ( length <= 0)
+        return;
+
+    ShaderBinaryHeader header;
+    std::vector<unsigned char> file( sizeof( header) + length);
+    GLenum format = 0;
+    glGetProgramBinary( program, length, nullptr, &format, file.data() + sizeof( header));
+    header.magic = SHADER_BINARY_MAGIC;
+    header.format = format;
+    header.length = (uint32_t)length;
+    memcpy( file.data(), &header, sizeof( header));
+
+    MakeDirectories( directory);
+    if ( !WriteFileAtomic( PathOf( key), file.data(), file.size()))
+        std::cout << "\n  Could not write the shader cache " << PathOf( key);
+}
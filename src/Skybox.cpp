@@ -15,8 +15,16 @@
  */
 
 #include <iostream>
+#include <string>
+#include <algorithm>
 
 #include "Skybox.hpp"
+#include "GLState.hpp"
+#include "TextureStreamer.hpp"
+
+extern GLStateCache glState;
+extern TextureCache textureCache;
+extern TextureStreamer textureStreamer;
 
 
 GLfloat skyboxVertices[] = {
@@ -60,48 +68,78 @@ GLfloat skyboxVertices[] = {
 
 
 
-void SkyBox::LoadCubemap(std::vector<const GLchar * > faces, GLuint InternalFormat) {
-    internalFormat = InternalFormat;
+void SkyBox::LoadCubemap(std::vector<const GLchar * > faces) {
+    // space is black until the stars have streamed in
+    static const unsigned char black[4] = { 0, 0, 0, 255 };
 
     GLuint textureID;
     glGenTextures( 1, &textureID );
-    int imageWidth, imageHeight, nrComponents;
-    unsigned char *image;
-    glBindTexture( GL_TEXTURE_CUBE_MAP, textureID );
-
-    for ( GLuint i = 0; i < faces.size( ); i++ )  {
-        image = stbi_load( faces[i], &imageWidth, &imageHeight, &nrComponents, 0);
-        glTexImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, internalFormat, imageWidth, imageHeight, 0, internalFormat, GL_UNSIGNED_BYTE, image );
-        stbi_image_free( image);
+    glState.BindTexture( 0, GL_TEXTURE_CUBE_MAP, textureID );
+
+    // all the faces must have the same size and format, the first one decides
+    if ( faces.empty() || !TextureCache::Probe( faces[0], faceWidth, faceHeight, internalFormat)) {
+        std::cout << "Cubemap texture failed to load at path: " << ( faces.empty() ? "" : faces[0]) << std::endl;
+        faceWidth = faceHeight = 1;
+        internalFormat = GL_RGBA8;
+    }
+    int levels = 1;
+    for ( GLuint i = 0; i < 6; i++ )
+        levels = TextureStreamer::AllocateLevels( GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, internalFormat, faceWidth, faceHeight, 1, black);
+    baseLevel = levels - 1;
+    faceLevels.assign( 6, levels - 1);
+    glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, baseLevel );
+
+    for ( GLuint i = 0; i < faces.size( ) && i < 6; i++ )  {
+        StreamRequest request;
+        request.name = faces[i];
+        request.texture = textureID;
+        request.target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
+        request.internalFormat = internalFormat;
+        request.width = faceWidth;
+        request.height = faceHeight;
+        std::string path = faces[i];
+        GLenum format = internalFormat;
+        request.decode = [path, format]( CookedTexture& texture) { return textureCache.Load( path, format, texture); };
+        request.levelDone = [this, i]( int level) { FaceLevelDone( i, level); };
+        textureStreamer.Request( request);
     }
     glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
     glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
     glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
     glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
     glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE );
-    glBindTexture( GL_TEXTURE_CUBE_MAP, 0);
+    glState.BindTexture( 0, GL_TEXTURE_CUBE_MAP, 0);
 
     cubemapTexture = textureID;
 
     glGenVertexArrays( 1, &skyboxVAO );
     glGenBuffers( 1, &skyboxVBO );
-    glBindVertexArray( skyboxVAO );
+    glState.BindVertexArray( skyboxVAO );
     glBindBuffer( GL_ARRAY_BUFFER, skyboxVBO );
     glBufferData( GL_ARRAY_BUFFER, sizeof( skyboxVertices ), &skyboxVertices, GL_STATIC_DRAW );
     glEnableVertexAttribArray( 0 );
     glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof( GLfloat ), ( GLvoid * ) 0 );
-    glBindVertexArray(0);
+    glState.BindVertexArray( 0 );
 
 }
 
+// the whole cube gets the finer level once all six faces have it
+void SkyBox::FaceLevelDone( GLuint face, int level) {
+    faceLevels[face] = level;
+    int base = *std::max_element( faceLevels.begin( ), faceLevels.end( ) );
+    if ( base < baseLevel ) {
+        baseLevel = base;
+        glState.BindTexture( 0, GL_TEXTURE_CUBE_MAP, cubemapTexture );
+        glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, baseLevel );
+    }
+}
+
 void SkyBox::RenderSkyBox() {
     // Draw skybox as last
-    glDepthFunc( GL_LEQUAL );  // Change depth function so depth test passes when values are equal to depth buffer's content
+    glState.DepthFunc( GL_LEQUAL );  // depth test passes when values are equal to depth buffer's content, it is the default for everything so this is free
     // skybox cube
-    glBindVertexArray( skyboxVAO );
-    glBindTexture( GL_TEXTURE_CUBE_MAP, cubemapTexture );
+    glState.BindVertexArray( skyboxVAO );
+    glState.BindTexture( 0, GL_TEXTURE_CUBE_MAP, cubemapTexture );
     glDrawArrays( GL_TRIANGLES, 0, 36 );
-    glBindVertexArray( 0 );
-    glDepthFunc( GL_LESS ); // Set depth function back to default
 
 }
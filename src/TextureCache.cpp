@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include <stb_image.h>
+
+#include "TextureCache.hpp"
+#include "FileUtils.hpp"
+#include "ResourceArchive.hpp"
+
+TextureCache textureCache;
+extern ResourceArchive resourceArchive;
+
+// Bump when the cooker output changes, the old cache files are then just never found again
+const uint64_t COOK_VERSION = 2;
+
+static const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// The KTX 1.1 header after the identifier, all little endian
+struct KTXHeader
+{
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+
+size_t CookedTexture::GetBytes() const
+{
+    size_t bytes = 0;
+    for ( auto& level: levels)
+        bytes += level.size();
+    return bytes;
+}
+
+
+TextureCache::TextureCache( const std::string& Directory) : directory( Directory)
+{
+}
+
+
+bool TextureCache::IsSupported()
+{
+    return GLEW_EXT_texture_compression_s3tc != 0;
+}
+
+
+bool TextureCache::Probe( const std::string& path, int& width, int& height, GLenum& internalFormat)
+{
+    // the archive only has the compressed ones
+    const ArchiveEntry* entry = resourceArchive.Find( path);
+    if ( entry != nullptr && entry->type == ARCHIVE_KTX && IsSupported()) {
+        std::vector<unsigned char> unpacked;
+        const unsigned char* data = resourceArchive.Get( *entry, unpacked);
+        if ( data != nullptr && ProbeKTX( data, entry->size, width, height, internalFormat))
+            return true;
+    }
+
+    int channels;
+    if ( !stbi_info( path.c_str(), &width, &height, &channels))
+        return false;
+
+    if ( !IsSupported() || channels < 3)
+        internalFormat = GL_RGBA8;
+    else
+        internalFormat = channels == 4 ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    return true;
+}
+
+
+bool TextureCache::Load( const std::string& path, GLenum internalFormat, CookedTexture& texture)
+{
+    const ArchiveEntry* entry = resourceArchive.Find( path);
+    if ( entry != nullptr && entry->type == ARCHIVE_KTX) {
+        std::vector<unsigned char> unpacked;
+        const unsigned char* data = resourceArchive.Get( *entry, unpacked);
+        if ( data != nullptr && DecodeKTX( data, entry->size, texture) && texture.internalFormat == internalFormat)
+            return true;
+    }
+
+    switch ( internalFormat) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        return Cook( path, BLOCK_FORMAT_BC1, texture);
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        return Cook( path, BLOCK_FORMAT_BC3, texture);
+    default:
+        return LoadUncompressed( path, texture);
+    }
+}
+
+
+bool TextureCache::LoadUncompressed( const std::string& path, CookedTexture& texture)
+{
+    int width, height, channels;
+    unsigned char* pixels = stbi_load( path.c_str(), &width, &height, &channels, 4);
+    if ( pixels == nullptr)
+        return false;
+
+    ImageRGBA8 image;
+    image.width = width;
+    image.height = height;
+    image.pixels.assign( pixels, pixels + (size_t)width * height * 4);
+    stbi_image_free( pixels);
+
+    texture.internalFormat = GL_RGBA8;
+    texture.width = width;
+    texture.height = height;
+    texture.levels.clear();
+    for ( ;;) {
+        texture.levels.push_back( image.pixels);
+        if ( image.width == 1 && image.height == 1)
+            break;
+        image = DownsampleImage( image);
+    }
+    return true;
+}
+
+
+bool TextureCache::Cook( const std::string& sourcePath, BlockFormat format, CookedTexture& texture)
+{
+    std::vector<unsigned char> source;
+    if ( !ReadFile( sourcePath, source))
+        return false;
+
+    // the format is part of the key, the same image may be wanted with and without alpha
+    char name[32];
+    snprintf( name, sizeof( name), "%016llx.ktx", (unsigned long long)HashBytes( source.data(), source.size(), ( COOK_VERSION * 2 + format) * 1099511628211ull));
+    std::string cachePath = directory + "/" + name;
+    if ( ReadKTX( cachePath, texture))
+        return true;
+
+    int width, height, channels;
+    unsigned char* pixels = stbi_load_from_memory( source.data(), (int)source.size(), &width, &height, &channels, 4);
+    if ( pixels == nullptr)
+        return false;
+
+    ImageRGBA8 image;
+    image.width = width;
+    image.height = height;
+    image.pixels.assign( pixels, pixels + (size_t)width * height * 4);
+    stbi_image_free( pixels);
+
+    texture.internalFormat = format == BLOCK_FORMAT_BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    texture.width = width;
+    texture.height = height;
+    texture.levels.clear();
+    for ( ;;) {
+        texture.levels.push_back( CompressImage( image, format));
+        if ( image.width == 1 && image.height == 1)
+            break;
+        image = DownsampleImage( image);
+    }
+
+    MakeDirectories( directory);
+    if ( !WriteKTX( cachePath, texture))
+        std::cout << "\n  Could not write the texture cache " << cachePath;
+    return true;
+}
+
+
+bool TextureCache::ReadKTX( const std::string& path, CookedTexture& texture)
+{
+    MappedFile file;
+    return file.Open( path) && DecodeKTX( file.GetData(), file.GetSize(), texture);
+}
+
+
+bool TextureCache::WriteKTX( const std::string& path, const CookedTexture& texture)
+{
+    std::vector<unsigned char> file;
+    EncodeKTX( texture, file);
+    return WriteFileAtomic( path, file.data(), file.size());
+}
+
+
+bool TextureCache::DecodeKTX( const unsigned char* data, size_t size, CookedTexture& texture)
+{
+    KTXHeader header;
+    if ( size < sizeof( KTX_IDENTIFIER) + sizeof( header) || memcmp( data, KTX_IDENTIFIER, sizeof( KTX_IDENTIFIER)) != 0)
+        return false;
+    memcpy( &header, data + sizeof( KTX_IDENTIFIER), sizeof( header));
+    if ( header.endianness != 0x04030201)
+        return false;
+    if ( header.glInternalFormat != GL_COMPRESSED_RGB_S3TC_DXT1_EXT && header.glInternalFormat != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+        return false;
+    if ( header.numberOfFaces != 1 || header.numberOfMipmapLevels == 0 || header.numberOfMipmapLevels > 32)
+        return false;
+    size_t offset = sizeof( KTX_IDENTIFIER) + sizeof( header) + (size_t)header.bytesOfKeyValueData;
+
+    BlockFormat format = header.glInternalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? BLOCK_FORMAT_BC1 : BLOCK_FORMAT_BC3;
+    texture.internalFormat = header.glInternalFormat;
+    texture.width = header.pixelWidth;
+    texture.height = header.pixelHeight;
+    texture.levels.resize( header.numberOfMipmapLevels);
+
+    int width = texture.width;
+    int height = texture.height;
+    for ( auto& level: texture.levels) {
+        uint32_t imageSize = 0;
+        if ( offset + sizeof( imageSize) > size)
+            return false;
+        memcpy( &imageSize, data + offset, sizeof( imageSize));
+        offset += sizeof( imageSize);
+        // a truncated or foreign file, cook it again
+        if ( imageSize != CompressedImageSize( width, height, format) || offset + imageSize > size)
+            return false;
+        level.assign( data + offset, data + offset + imageSize);
+        offset += imageSize;
+        width = std::max( 1, width / 2);
+        height = std::max( 1, height / 2);
+    }
+    return true;
+}
+
+
+bool TextureCache::ProbeKTX( const unsigned char* data, size_t size, int& width, int& height, GLenum& internalFormat)
+{
+    KTXHeader header;
+    if ( size < sizeof( KTX_IDENTIFIER) + sizeof( header) || memcmp( data, KTX_IDENTIFIER, sizeof( KTX_IDENTIFIER)) != 0)
+        return false;
+    memcpy( &header, data + sizeof( KTX_IDENTIFIER), sizeof( header));
+    if ( header.endianness != 0x04030201)
+        return false;
+    width = header.pixelWidth;
+    height = header.pixelHeight;
+    internalFormat = header.glInternalFormat;
+    return true;
+}
+
+
+// The whole file is put together in memory and written in one go, see WriteFileAtomic()
+void TextureCache::EncodeKTX( const CookedTexture& texture, std::vector<unsigned char>& file)
+{
+    KTXHeader header = {};
+    header.endianness = 0x04030201;
+    header.glTypeSize = 1;
+    header.glInternalFormat = texture.internalFormat;
+    header.glBaseInternalFormat = texture.internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? GL_RGB : GL_RGBA;
+    header.pixelWidth = texture.width;
+    header.pixelHeight = texture.height;
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = (uint32_t)texture.levels.size();
+
+    file.assign( KTX_IDENTIFIER, KTX_IDENTIFIER + sizeof( KTX_IDENTIFIER));
+    file.insert( file.end(), (const unsigned char*)&header, (const unsigned char*)&header + sizeof( header));
+
+    // the block sizes are multiples of 4, so no mip padding
+    for ( auto& level: texture.levels) {
+        uint32_t imageSize = (uint32_t)level.size();
+        file.insert( file.end(), (const unsigned char*)&imageSize, (const unsigned char*)&imageSize + sizeof( imageSize));
+        file.insert( file.end(), level.begin(), level.end());
+    }
+}
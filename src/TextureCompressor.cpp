@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "TextureCompressor.hpp"
+#include "ThreadPool.hpp"
+
+extern ThreadPool threadPool;
+
+
+bool ImageHasAlpha( const ImageRGBA8& image)
+{
+    for ( size_t i = 3; i < image.pixels.size(); i += 4)
+        if ( image.pixels[i] != 255)
+            return true;
+    return false;
+}
+
+
+ImageRGBA8 DownsampleImage( const ImageRGBA8& image)
+{
+    ImageRGBA8 half;
+    half.width = std::max( 1, image.width / 2);
+    half.height = std::max( 1, image.height / 2);
+    half.pixels.resize( (size_t)half.width * half.height * 4);
+
+    for ( int y = 0; y < half.height; ++y) {
+        int y0 = std::min( y * 2, image.height - 1);
+        int y1 = std::min( y * 2 + 1, image.height - 1);
+        for ( int x = 0; x < half.width; ++x) {
+            int x0 = std::min( x * 2, image.width - 1);
+            int x1 = std::min( x * 2 + 1, image.width - 1);
+            const unsigned char* p00 = &image.pixels[( (size_t)y0 * image.width + x0) * 4];
+            const unsigned char* p01 = &image.pixels[( (size_t)y0 * image.width + x1) * 4];
+            const unsigned char* p10 = &image.pixels[( (size_t)y1 * image.width + x0) * 4];
+            const unsigned char* p11 = &image.pixels[( (size_t)y1 * image.width + x1) * 4];
+            unsigned char* out = &half.pixels[( (size_t)y * half.width + x) * 4];
+            for ( int c = 0; c < 4; ++c)
+                out[c] = (unsigned char)( ( p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4);
+        }
+    }
+    return half;
+}
+
+
+size_t CompressedImageSize( int width, int height, BlockFormat format)
+{
+    size_t blocks = (size_t)( ( width + 3) / 4) * ( ( height + 3) / 4);
+    return blocks * ( format == BLOCK_FORMAT_BC1 ? 8 : 16);
+}
+
+
+std::vector<unsigned char> CompressImage( const ImageRGBA8& image, BlockFormat format)
+{
+    int blocksX = ( image.width + 3) / 4;
+    int blocksY = ( image.height + 3) / 4;
+    size_t blockBytes = format == BLOCK_FORMAT_BC1 ? 8 : 16;
+    std::vector<unsigned char> out( (size_t)blocksX * blocksY * blockBytes);
+
+    threadPool.ParallelFor( blocksY, [&]( unsigned int by) {
+        unsigned char block[16 * 4];
+        for ( int bx = 0; bx < blocksX; ++bx) {
+            for ( int py = 0; py < 4; ++py) {
+                int y = std::min( (int)by * 4 + py, image.height - 1);
+                for ( int px = 0; px < 4; ++px) {
+                    int x = std::min( bx * 4 + px, image.width - 1);
+                    memcpy( &block[( py * 4 + px) * 4], &image.pixels[( (size_t)y * image.width + x) * 4], 4);
+                }
+            }
+            unsigned char* dst = &out[( (size_t)by * blocksX + bx) * blockBytes];
+            if ( format == BLOCK_FORMAT_BC1)
+                EncodeBC1Block( block, dst);
+            else
+                EncodeBC3Block( block, dst);
+        }
+    });
+    return out;
+}
+
+
+static uint16_t To565( const float* c)
+{
+    int r = std::min( 31, std::max( 0, (int)( c[0] * 31.0f / 255.0f + 0.5f)));
+    int g = std::min( 63, std::max( 0, (int)( c[1] * 63.0f / 255.0f + 0.5f)));
+    int b = std::min( 31, std::max( 0, (int)( c[2] * 31.0f / 255.0f + 0.5f)));
+    return (uint16_t)( ( r << 11) | ( g << 5) | b);
+}
+
+static void From565( uint16_t c, int* rgb)
+{
+    int r = ( c >> 11) & 31, g = ( c >> 5) & 63, b = c & 31;
+    rgb[0] = ( r << 3) | ( r >> 2);
+    rgb[1] = ( g << 2) | ( g >> 4);
+    rgb[2] = ( b << 3) | ( b >> 2);
+}
+
+// Pick the nearest of the four palette colors for every pixel, returns the squared error
+static int SelectIndices( const unsigned char* rgba, uint16_t c0, uint16_t c1, uint32_t& indices)
+{
+    int palette[4][3];
+    From565( c0, palette[0]);
+    From565( c1, palette[1]);
+    for ( int i = 0; i < 3; ++i) {
+        palette[2][i] = ( 2 * palette[0][i] + palette[1][i]) / 3;
+        palette[3][i] = ( palette[0][i] + 2 * palette[1][i]) / 3;
+    }
+
+    int error = 0;
+    indices = 0;
+    for ( int p = 0; p < 16; ++p) {
+        const unsigned char* c = &rgba[p * 4];
+        int best = 0, bestError = 1 << 30;
+        for ( int i = 0; i < 4; ++i) {
+            int dr = c[0] - palette[i][0], dg = c[1] - palette[i][1], db = c[2] - palette[i][2];
+            int e = dr * dr + dg * dg + db * db;
+            if ( e < bestError) {
+                bestError = e;
+                best = i;
+            }
+        }
+        error += bestError;
+        indices |= (uint32_t)best << ( p * 2);
+    }
+    return error;
+}
+
+
+// Endpoints on the principal axis of the colors, then one least squares refit with the
+// chosen indices (the "range fit" of libsquish with a cheap refinement step)
+void EncodeBC1Block( const unsigned char* rgba, unsigned char* out)
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for ( int p = 0; p < 16; ++p)
+        for ( int i = 0; i < 3; ++i)
+            mean[i] += rgba[p * 4 + i];
+    for ( int i = 0; i < 3; ++i)
+        mean[i] /= 16.0f;
+
+    float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };   // xx xy xz yy yz zz
+    for ( int p = 0; p < 16; ++p) {
+        float d[3] = { rgba[p * 4] - mean[0], rgba[p * 4 + 1] - mean[1], rgba[p * 4 + 2] - mean[2] };
+        cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+    }
+
+    // power iteration for the largest eigenvector
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for ( int iteration = 0; iteration < 8; ++iteration) {
+        float v[3] = {
+            cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+            cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+            cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2] };
+        float length = std::max( std::fabs( v[0]), std::max( std::fabs( v[1]), std::fabs( v[2])));
+        if ( length < 1e-6f)
+            break;
+        for ( int i = 0; i < 3; ++i)
+            axis[i] = v[i] / length;
+    }
+
+    float minT = 1e30f, maxT = -1e30f;
+    for ( int p = 0; p < 16; ++p) {
+        float t = ( rgba[p * 4] - mean[0]) * axis[0] + ( rgba[p * 4 + 1] - mean[1]) * axis[1] + ( rgba[p * 4 + 2] - mean[2]) * axis[2];
+        minT = std::min( minT, t);
+        maxT = std::max( maxT, t);
+    }
+    float axisLength2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    if ( axisLength2 > 0.0f) {
+        minT /= axisLength2;
+        maxT /= axisLength2;
+    }
+    float end0[3], end1[3];
+    for ( int i = 0; i < 3; ++i) {
+        end0[i] = mean[i] + axis[i] * maxT;
+        end1[i] = mean[i] + axis[i] * minT;
+    }
+
+    uint16_t c0 = To565( end0);
+    uint16_t c1 = To565( end1);
+    uint32_t indices;
+    int error = SelectIndices( rgba, c0, c1, indices);
+
+    // Least squares: every pixel is a*end0 + b*end1 with a,b given by its index
+    static const float weight0[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+    if ( error > 0 && c0 != c1) {
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+        for ( int p = 0; p < 16; ++p) {
+            float a = weight0[( indices >> ( p * 2)) & 3];
+            float b = 1.0f - a;
+            aa += a * a; ab += a * b; bb += b * b;
+            for ( int i = 0; i < 3; ++i) {
+                ax[i] += a * rgba[p * 4 + i];
+                bx[i] += b * rgba[p * 4 + i];
+            }
+        }
+        float det = aa * bb - ab * ab;
+        if ( std::fabs( det) > 1e-6f) {
+            for ( int i = 0; i < 3; ++i) {
+                end0[i] = ( ax[i] * bb - bx[i] * ab) / det;
+                end1[i] = ( bx[i] * aa - ax[i] * ab) / det;
+            }
+            uint16_t r0 = To565( end0);
+            uint16_t r1 = To565( end1);
+            uint32_t refitIndices;
+            int refitError = SelectIndices( rgba, r0, r1, refitIndices);
+            if ( refitError < error) {
+                c0 = r0;
+                c1 = r1;
+                indices = refitIndices;
+            }
+        }
+    }
+
+    // c0 > c1 is the four color mode, swap the endpoints and the indices to get it
+    if ( c0 < c1) {
+        std::swap( c0, c1);
+        indices ^= 0x55555555u;     // 0<->1, 2<->3
+    } else if ( c0 == c1) {
+        indices = 0;
+    }
+
+    out[0] = (unsigned char)( c0 & 0xff);
+    out[1] = (unsigned char)( c0 >> 8);
+    out[2] = (unsigned char)( c1 & 0xff);
+    out[3] = (unsigned char)( c1 >> 8);
+    for ( int i = 0; i < 4; ++i)
+        out[4 + i] = (unsigned char)( indices >> ( i * 8));
+}
+
+
+// Alpha block with a0 > a1, the 8 value mode: a0, a1 and six steps in between
+void EncodeBC3Block( const unsigned char* rgba, unsigned char* out)
+{
+    int a0 = 0, a1 = 255;
+    for ( int p = 0; p < 16; ++p) {
+        a0 = std::max( a0, (int)rgba[p * 4 + 3]);
+        a1 = std::min( a1, (int)rgba[p * 4 + 3]);
+    }
+
+    uint64_t indices = 0;
+    if ( a0 != a1) {
+        int palette[8] = { a0, a1 };
+        for ( int i = 1; i < 7; ++i)
+            palette[i + 1] = ( ( 7 - i) * a0 + i * a1) / 7;
+        for ( int p = 0; p < 16; ++p) {
+            int alpha = rgba[p * 4 + 3];
+            int best = 0, bestError = 1 << 30;
+            for ( int i = 0; i < 8; ++i) {
+                int e = std::abs( alpha - palette[i]);
+                if ( e < bestError) {
+                    bestError = e;
+                    best = i;
+                }
+            }
+            indices |= (uint64_t)best << ( p * 3);
+        }
+    }
+
+    out[0] = (unsigned char)a0;
+    out[1] = (unsigned char)a1;
+    for ( int i = 0; i < 6; ++i)
+        out[2 + i] = (unsigned char)( indices >> ( i * 8));
+
+    EncodeBC1Block( rgba, out + 8);
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <algorithm>
+
+#include "TexturePacker.hpp"
+#include "TextureStreamer.hpp"
+#include "GLState.hpp"
+#include "Material.hpp"
+
+TexturePacker texturePacker;
+extern TextureCache textureCache;
+extern TextureStreamer textureStreamer;
+extern GLStateCache glState;
+extern MaterialTable materialTable;
+
+
+TextureSlot TexturePacker::Add( TextureId id)
+{
+    TextureSlot slot;
+    const std::string& path = materialTable.GetTexturePath( id);
+    int width, height;
+    GLenum internalFormat;
+    if ( !TextureCache::Probe( path, width, height, internalFormat)) {
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+        return slot;
+    }
+
+    // the last group of the same kind, unless it is full
+    for ( int i = (int)groups.size() - 1; i >= 0; --i) {
+        Group& group = groups[i];
+        if ( group.internalFormat == internalFormat && group.width == width && group.height == height
+             && group.texture == 0 && group.layerCount < MAX_LAYERS) {
+            slot.group = i;
+            break;
+        }
+    }
+    if ( slot.group < 0) {
+        Group group;
+        group.internalFormat = internalFormat;
+        group.width = width;
+        group.height = height;
+        groups.push_back( group);
+        slot.group = (int)groups.size() - 1;
+    }
+
+    Group& group = groups[slot.group];
+    slot.layer = group.layerCount++;
+    group.textures.push_back( id);
+    return slot;
+}
+
+
+void TexturePacker::Build()
+{
+    static const unsigned char grey[4] = { 128, 128, 128, 255 };
+
+    size_t bytes = 0;
+    GLuint layers = 0;
+    for ( size_t g = 0; g < groups.size(); ++g) {
+        Group& group = groups[g];
+        layers += group.layerCount;
+        if ( group.texture != 0)
+            continue;
+
+        glGenTextures( 1, &group.texture);
+        glState.BindTexture( 0, GL_TEXTURE_2D_ARRAY, group.texture);
+        int levels = TextureStreamer::AllocateLevels( GL_TEXTURE_2D_ARRAY, group.internalFormat, group.width, group.height, group.layerCount, grey);
+        group.baseLevel = levels - 1;
+        group.layerLevels.assign( group.layerCount, levels - 1);
+
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, group.baseLevel);
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        for ( GLuint layer = 0; layer < group.layerCount; ++layer) {
+            std::string path = materialTable.GetTexturePath( group.textures[layer]);
+            StreamRequest request;
+            request.name = path;
+            request.texture = group.texture;
+            request.target = GL_TEXTURE_2D_ARRAY;
+            request.layer = layer;
+            request.internalFormat = group.internalFormat;
+            request.width = group.width;
+            request.height = group.height;
+            GLenum internalFormat = group.internalFormat;
+            request.decode = [path, internalFormat]( CookedTexture& texture) { return textureCache.Load( path, internalFormat, texture); };
+            int index = (int)g;
+            request.levelDone = [this, index, layer]( int level) { LevelDone( index, layer, level); };
+            textureStreamer.Request( request);
+        }
+
+        for ( int level = 0; level < levels; ++level) {
+            int w = std::max( 1, group.width >> level);
+            int h = std::max( 1, group.height >> level);
+            bytes += ( group.internalFormat == GL_RGBA8 ? (size_t)w * h * 4
+                : CompressedImageSize( w, h, group.internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? BLOCK_FORMAT_BC1 : BLOCK_FORMAT_BC3)) * group.layerCount;
+        }
+    }
+
+    std::cout << "  Texture arrays: " << groups.size() << " arrays, " << layers << " layers, " << bytes / 1024 << " KB\n";
+}
+
+
+void TexturePacker::LevelDone( int group, GLuint layer, int level)
+{
+    Group& g = groups[group];
+    g.layerLevels[layer] = level;
+    int base = *std::max_element( g.layerLevels.begin(), g.layerLevels.end());
+    if ( base < g.baseLevel) {
+        g.baseLevel = base;
+        glState.BindTexture( 0, GL_TEXTURE_2D_ARRAY, g.texture);
+        glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, base);
+    }
+}
+
+
+void TexturePacker::CleanUp()
+{
+    for ( auto& group: groups) {
+        if ( group.texture != 0) {
+            glDeleteTextures( 1, &group.texture);
+            glState.ForgetTexture( group.texture);
+        }
+    }
+    groups.clear();
+}
@@ -0,0 +1,353 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+
+#include "TextureStreamer.hpp"
+#include "TextureCompressor.hpp"
+#include "ThreadPool.hpp"
+#include "GLState.hpp"
+
+TextureStreamer textureStreamer;
+extern ThreadPool threadPool;
+extern GLStateCache glState;
+
+
+// What to bind for a target, the cube map faces go through the cube map
+static GLenum BindingTarget( GLenum target)
+{
+    if ( target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z)
+        return GL_TEXTURE_CUBE_MAP;
+    return target;
+}
+
+// A level is uploaded in rows, rows of pixels for RGBA8 and rows of 4x4 blocks when compressed
+static size_t RowBytes( GLenum internalFormat, int width)
+{
+    switch ( internalFormat) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        return (size_t)( ( width + 3) / 4) * 8;
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        return (size_t)( ( width + 3) / 4) * 16;
+    default:
+        return (size_t)width * 4;
+    }
+}
+
+static int RowCount( GLenum internalFormat, int height)
+{
+    return internalFormat == GL_RGBA8 ? height : ( height + 3) / 4;
+}
+
+
+// What a broken image gets instead: magenta, the whole mip chain. It streams in like any other
+// image so its layer or face still reports its levels and the rest of the texture can get sharp.
+// Made on the worker, a 1024x1024 chain is a few MB.
+static std::shared_ptr<CookedTexture> MakeFill( const StreamRequest& request)
+{
+    static const unsigned char magenta[4] = { 255, 0, 255, 255 };
+    ImageRGBA8 pixel;
+    pixel.width = 1;
+    pixel.height = 1;
+    pixel.pixels.assign( magenta, magenta + 4);
+    // one pixel, or one block when compressed
+    std::vector<unsigned char> unit = pixel.pixels;
+    if ( request.internalFormat != GL_RGBA8)
+        unit = CompressImage( pixel, request.internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? BLOCK_FORMAT_BC1 : BLOCK_FORMAT_BC3);
+
+    std::shared_ptr<CookedTexture> texture = std::make_shared<CookedTexture>();
+    texture->internalFormat = request.internalFormat;
+    texture->width = request.width;
+    texture->height = request.height;
+    texture->levels.resize( TextureStreamer::LevelCount( request.width, request.height));
+    for ( size_t level = 0; level < texture->levels.size(); ++level) {
+        int w = std::max( 1, request.width >> level);
+        int h = std::max( 1, request.height >> level);
+        std::vector<unsigned char>& data = texture->levels[level];
+        data.resize( RowBytes( request.internalFormat, w) * RowCount( request.internalFormat, h));
+        for ( size_t offset = 0; offset + unit.size() <= data.size(); offset += unit.size())
+            memcpy( data.data() + offset, unit.data(), unit.size());
+    }
+    return texture;
+}
+
+
+int TextureStreamer::LevelCount( int width, int height)
+{
+    int levels = 1;
+    while ( width > 1 || height > 1) {
+        width = std::max( 1, width / 2);
+        height = std::max( 1, height / 2);
+        levels++;
+    }
+    return levels;
+}
+
+
+int TextureStreamer::AllocateLevels( GLenum target, GLenum internalFormat, int width, int height, GLsizei layers, const unsigned char placeholder[4])
+{
+    int levels = LevelCount( width, height);
+    bool compressed = internalFormat != GL_RGBA8;
+
+    // the smallest level is 1x1, one block when compressed
+    ImageRGBA8 pixel;
+    pixel.width = 1;
+    pixel.height = 1;
+    pixel.pixels.assign( placeholder, placeholder + 4);
+    std::vector<unsigned char> smallest = pixel.pixels;
+    if ( compressed)
+        smallest = CompressImage( pixel, internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? BLOCK_FORMAT_BC1 : BLOCK_FORMAT_BC3);
+
+    for ( int level = 0; level < levels; ++level) {
+        int w = std::max( 1, width >> level);
+        int h = std::max( 1, height >> level);
+        GLsizei bytes = (GLsizei)( RowBytes( internalFormat, w) * RowCount( internalFormat, h));
+
+        // only the placeholder has data, the rest is just allocated
+        std::vector<unsigned char> data;
+        if ( level == levels - 1)
+            for ( GLsizei layer = 0; layer < layers; ++layer)
+                data.insert( data.end(), smallest.begin(), smallest.end());
+        const void* pixels = data.empty() ? nullptr : data.data();
+
+        if ( target == GL_TEXTURE_2D_ARRAY) {
+            if ( compressed)
+                glCompressedTexImage3D( target, level, internalFormat, w, h, layers, 0, bytes * layers, pixels);
+            else
+                glTexImage3D( target, level, GL_RGBA8, w, h, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        } else {
+            if ( compressed)
+                glCompressedTexImage2D( target, level, internalFormat, w, h, 0, bytes, pixels);
+            else
+                glTexImage2D( target, level, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        }
+    }
+    return levels;
+}
+
+
+bool TextureStreamer::Init( size_t SegmentBytes)
+{
+    segmentBytes = SegmentBytes;
+    decoded = std::make_shared<Decoded>();
+
+    GLsizeiptr size = (GLsizeiptr)( segmentBytes * SEGMENT_COUNT);
+    glGenBuffers( 1, &pbo);
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, pbo);
+    if ( GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage( GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+        mapped = (unsigned char*)glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+    } else {
+        glBufferData( GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0);
+
+    std::cout << "  Texture streaming: " << SEGMENT_COUNT << " x " << segmentBytes / 1024 << " KB pixel buffer, "
+              << ( mapped ? "persistently mapped" : "mapped per frame") << "\n";
+    return pbo != 0;
+}
+
+
+void TextureStreamer::Request( const StreamRequest& request)
+{
+    if ( pending++ == 0)
+        firstRequest = std::chrono::system_clock::now();
+    requested++;
+
+    std::shared_ptr<Decoded> state = decoded;
+    threadPool.Enqueue( [state, request]() {
+        {
+            std::unique_lock<std::mutex> lock( state->mutex);
+            if ( state->stopping)
+                return;
+        }
+        std::shared_ptr<CookedTexture> texture = std::make_shared<CookedTexture>();
+        if ( !request.decode( *texture)) {
+            std::cout << "Texture failed to load at path: " << request.name << std::endl;
+            texture = MakeFill( request);
+        } else if ( texture->internalFormat != request.internalFormat || texture->width != request.width || texture->height != request.height
+                    || (int)texture->levels.size() != LevelCount( request.width, request.height)) {
+            std::cout << "Texture " << request.name << " changed its size or format since it was allocated" << std::endl;
+            texture = MakeFill( request);
+        }
+
+        std::unique_lock<std::mutex> lock( state->mutex);
+        state->ready.emplace_back( request, texture);
+    });
+}
+
+
+void TextureStreamer::Update()
+{
+    if ( pending == 0)
+        return;
+
+    // pick up what the workers have decoded
+    {
+        std::unique_lock<std::mutex> lock( decoded->mutex);
+        // the workers checked them, a broken one is already its fill
+        for ( auto& item: decoded->ready)
+            uploads.push_back( { item.first, item.second, (int)item.second->levels.size() - 1, 0 });
+        decoded->ready.clear();
+    }
+    if ( uploads.empty())
+        return;
+
+    // the GPU may still be reading this segment from three frames ago, then it waits for the next frame
+    Segment& segment = segments[currentSegment];
+    if ( segment.fence != 0) {
+        if ( glClientWaitSync( segment.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+            return;
+        glDeleteSync( segment.fence);
+        segment.fence = 0;
+    }
+
+    size_t segmentOffset = currentSegment * segmentBytes;
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, pbo);
+    unsigned char* destination = mapped != nullptr ? mapped + segmentOffset
+        : (unsigned char*)glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, segmentOffset, segmentBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if ( destination == nullptr) {
+        glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0);
+        return;
+    }
+
+    // fill the segment, as many rows as fit. The GL calls come after the unmap.
+    struct Copy {
+        size_t upload;
+        int level;
+        int row;
+        int rows;
+        size_t offset;
+    };
+    std::vector<Copy> copies;
+    size_t used = 0;
+    size_t finished = 0;
+    while ( finished < uploads.size()) {
+        Upload& upload = uploads[finished];
+        GLenum format = upload.request.internalFormat;
+        int width = std::max( 1, upload.request.width >> upload.level);
+        int height = std::max( 1, upload.request.height >> upload.level);
+        size_t rowBytes = RowBytes( format, width);
+        int rows = RowCount( format, height);
+
+        int fit = (int)std::min( (size_t)( rows - upload.row), ( segmentBytes - used) / rowBytes);
+        if ( fit == 0)
+            break;
+        memcpy( destination + used, upload.texture->levels[upload.level].data() + upload.row * rowBytes, fit * rowBytes);
+        copies.push_back( { finished, upload.level, upload.row, fit, segmentOffset + used });
+        used += fit * rowBytes;
+
+        upload.row += fit;
+        if ( upload.row == rows) {
+            upload.row = 0;
+            if ( --upload.level < 0)
+                finished++;
+        }
+    }
+    if ( mapped == nullptr)
+        glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER);
+
+    for ( auto& copy: copies) {
+        const StreamRequest& request = uploads[copy.upload].request;
+        GLenum format = request.internalFormat;
+        bool compressed = format != GL_RGBA8;
+        int width = std::max( 1, request.width >> copy.level);
+        int height = std::max( 1, request.height >> copy.level);
+        int rowHeight = compressed ? 4 : 1;
+        int y = copy.row * rowHeight;
+        int rows = std::min( copy.rows * rowHeight, height - y);
+        GLsizei bytes = (GLsizei)( RowBytes( format, width) * copy.rows);
+        const void* offset = (const void*)copy.offset;
+
+        glState.BindTexture( 0, BindingTarget( request.target), request.texture);
+        if ( request.target == GL_TEXTURE_2D_ARRAY) {
+            if ( compressed)
+                glCompressedTexSubImage3D( request.target, copy.level, 0, y, request.layer, width, rows, 1, format, bytes, offset);
+            else
+                glTexSubImage3D( request.target, copy.level, 0, y, request.layer, width, rows, 1, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+        } else {
+            if ( compressed)
+                glCompressedTexSubImage2D( request.target, copy.level, 0, y, width, rows, format, bytes, offset);
+            else
+                glTexSubImage2D( request.target, copy.level, 0, y, width, rows, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+        }
+
+        // the whole level is in, commands run in order so the next draw already sees it
+        if ( copy.row + copy.rows == RowCount( format, height) && request.levelDone)
+            request.levelDone( copy.level);
+    }
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0);
+
+    segment.fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    currentSegment = ( currentSegment + 1) % SEGMENT_COUNT;
+    uploadedBytes += used;
+
+    uploads.erase( uploads.begin(), uploads.begin() + finished);
+    pending -= finished;
+    if ( pending == 0) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::system_clock::now() - firstRequest);
+        std::cout << "Textures streamed in: " << requested << " images, " << uploadedBytes / 1024 << " KB in " << elapsed.count() << "ms" << std::endl;
+        requested = 0;
+        uploadedBytes = 0;
+    }
+}
+
+
+void TextureStreamer::Finish()
+{
+    while ( pending > 0) {
+        Update();
+        if ( pending > 0)
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1));
+    }
+}
+
+
+void TextureStreamer::CleanUp()
+{
+    // the decodes still queued skip their work, the running ones are waited for
+    if ( decoded) {
+        {
+            std::unique_lock<std::mutex> lock( decoded->mutex);
+            decoded->stopping = true;
+            decoded->ready.clear();
+        }
+        threadPool.Wait();
+        decoded.reset();
+    }
+    uploads.clear();
+    pending = 0;
+
+    for ( auto& segment: segments) {
+        if ( segment.fence != 0)
+            glDeleteSync( segment.fence);
+        segment.fence = 0;
+    }
+    if ( pbo != 0) {
+        if ( mapped != nullptr) {
+            glBindBuffer( GL_PIXEL_UNPACK_BUFFER, pbo);
+            glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        glDeleteBuffers( 1, &pbo);
+    }
+    pbo = 0;
+    mapped = nullptr;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+#include "ThreadPool.hpp"
+
+ThreadPool threadPool;
+
+
+ThreadPool::ThreadPool( unsigned int numThreads)
+{
+    if ( numThreads == 0) {
+        unsigned int cores = std::thread::hardware_concurrency();
+        numThreads = cores > 1 ? cores - 1 : 1;
+    }
+
+    for ( unsigned int i = 0; i < numThreads; ++i)
+        workers.emplace_back( &ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock( jobsMutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    for ( auto& w: workers)
+        w.join();
+}
+
+
+void ThreadPool::Enqueue( std::function<void()> job)
+{
+    {
+        std::unique_lock<std::mutex> lock( jobsMutex);
+        jobs.push( std::move( job));
+    }
+    jobAvailable.notify_one();
+}
+
+
+void ThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> lock( jobsMutex);
+    jobsDone.wait( lock, [this] { return jobs.empty() && jobsRunning == 0; });
+}
+
+
+void ThreadPool::ParallelFor( unsigned int count, const std::function<void(unsigned int)>& job)
+{
+    if ( count == 0)
+        return;
+
+    // every participant grabs the next free index until they are all taken.
+    // The state is shared so a helper that gets scheduled late finds nothing left and leaves.
+    struct State {
+        std::function<void(unsigned int)> job;
+        unsigned int count;
+        std::atomic<unsigned int> next{0};
+        std::atomic<unsigned int> finished{0};
+        std::mutex doneMutex;
+        std::condition_variable done;
+    };
+    std::shared_ptr<State> state = std::make_shared<State>();
+    state->job = job;
+    state->count = count;
+
+    auto worker = [state]() {
+        unsigned int i;
+        while ( ( i = state->next++) < state->count) {
+            state->job( i);
+            if ( ++state->finished == state->count) {
+                std::unique_lock<std::mutex> lock( state->doneMutex);
+                state->done.notify_all();
+            }
+        }
+    };
+
+    unsigned int helpers = std::min( count - 1, GetThreadCount());
+    for ( unsigned int i = 0; i < helpers; ++i)
+        Enqueue( worker);
+
+    // the calling thread helps out as well
+    worker();
+
+    std::unique_lock<std::mutex> lock( state->doneMutex);
+    state->done.wait( lock, [&] { return state->finished == state->count; });
+}
+
+
+void ThreadPool::WorkerLoop()
+{
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock( jobsMutex);
+            jobAvailable.wait( lock, [this] { return stopping || !jobs.empty(); });
+            if ( stopping && jobs.empty())
+                return;
+            job = std::move( jobs.front());
+            jobs.pop();
+            jobsRunning++;
+        }
+
+        job();
+
+        {
+            std::unique_lock<std::mutex> lock( jobsMutex);
+            jobsRunning--;
+            if ( jobs.empty() && jobsRunning == 0)
+                jobsDone.notify_all();
+        }
+    }
+}
@@ -15,22 +15,102 @@
  */
 
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include "Game.hpp"
 #include "Globals.hpp"
+#include "ResourceArchive.hpp"
 
 Globals globals;
+extern ResourceArchive resourceArchive;
 
 // This is to undefine SDL2's main definition to SDL_main
 #ifdef _WIN32
    #undef main
 #endif
 
-int main() {
+static void PrintUsage( const char* exe)
+{
+    std::cout << "Usage: " << exe << " [options]\n"
+              << "  --headless          render offscreen without a window (EGL, works without a GPU)\n"
+              << "  --frames N          run N frames, then print the frame times and exit\n"
+              << "  --dump-frames DIR   write every frame to DIR/frame_00000.png\n"
+              << "  --size WxH          window or framebuffer size, default 1024x600\n"
+              << "  --seed N            fixed random seed so runs are repeatable\n"
+              << "  --render-scale S    render the scene at S (0.5 - 1) of the window size, 0 adapts it\n"
+              << "                      to the GPU time (default, headless runs default to 1)\n"
+              << "  --fps N             frame limit, default 0 = none, vsync still limits\n"
+              << "  --idle-fps N        frame limit while the window is unfocused or minimized, default 15\n"
+              << "  --vsync MODE        off, on or adaptive (default, falls back to on)\n"
+              << "  --archive FILE      the cooked resources, default res.pak (make cook), res/ if missing\n";
+}
+
+int main( int argc, char* argv[]) {
+    int width = 1024;
+    int height = 600;
+    bool renderScaleGiven = false;
+
+    for ( int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if ( strcmp( argv[i], "--headless") == 0) {
+            globals.headless = true;
+        } else if ( strcmp( argv[i], "--frames") == 0 && hasValue) {
+            globals.benchmarkFrames = atoi( argv[++i]);
+        } else if ( strcmp( argv[i], "--dump-frames") == 0 && hasValue) {
+            globals.dumpFramesDir = argv[++i];
+        } else if ( strcmp( argv[i], "--size") == 0 && hasValue) {
+            if ( sscanf( argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                PrintUsage( argv[0]);
+                return 1;
+            }
+        } else if ( strcmp( argv[i], "--seed") == 0 && hasValue) {
+            globals.randomSeed = (unsigned int)strtoul( argv[++i], nullptr, 10);
+        } else if ( strcmp( argv[i], "--render-scale") == 0 && hasValue) {
+            globals.renderScale = (float)atof( argv[++i]);
+            renderScaleGiven = true;
+        } else if ( strcmp( argv[i], "--fps") == 0 && hasValue) {
+            globals.targetFps = (float)atof( argv[++i]);
+        } else if ( strcmp( argv[i], "--idle-fps") == 0 && hasValue) {
+            globals.idleFps = (float)atof( argv[++i]);
+        } else if ( strcmp( argv[i], "--vsync") == 0 && hasValue) {
+            ++i;
+            if ( strcmp( argv[i], "off") == 0)
+                globals.vsync = 0;
+            else if ( strcmp( argv[i], "on") == 0)
+                globals.vsync = 1;
+            else if ( strcmp( argv[i], "adaptive") == 0)
+                globals.vsync = -1;
+            else {
+                PrintUsage( argv[0]);
+                return 1;
+            }
+        } else if ( strcmp( argv[i], "--archive") == 0 && hasValue) {
+            globals.archivePath = argv[++i];
+        } else {
+            PrintUsage( argv[0]);
+            return 1;
+        }
+    }
+
+    // Headless runs without a keyboard, so they need an end
+    if ( globals.headless && globals.benchmarkFrames == 0)
+        globals.benchmarkFrames = 300;
+    // and their frames should not depend on how fast the machine is
+    if ( globals.headless && !renderScaleGiven)
+        globals.renderScale = 1.0f;
+
     std::cout << "Loading Game Engine\n";
+    if ( resourceArchive.Open( globals.archivePath))
+        std::cout << "Resource archive " << globals.archivePath << ": " << resourceArchive.GetEntryCount() << " entries\n";
     Game game;
-    std::cout << "Initializing SDL...";
-    if (game.InitSDL("SDL2/OpenGL Engine by Dragoneye", 1024, 600))
+    std::cout << (globals.headless ? "Initializing headless context..." : "Initializing SDL...");
+    if (game.InitSDL("SDL2/OpenGL Engine by Dragoneye", width, height)) {
         std::cout << "ok\n";
+    } else if ( globals.headless) {
+        std::cout << "Failed!\n";
+        return 1;
+    }
 
     std::cout << "Initializing OpenGL...\n";
     if (game.InitGL()) {
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2020 Dragoneye
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// The offline cooker behind make cook: everything the game loads from res/ goes into one archive
+//   shaders   the source with the comments and blank lines stripped
+//   models    imported and optimized, stored the way the mesh cache keeps them
+//   textures  BC1/BC3 with the whole mip chain, as KTX
+// The game maps the archive at start and only falls back to the loose files for what isn't in it.
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cctype>
+
+#include <stb_image.h>
+
+#include "Globals.hpp"
+#include "Model.hpp"
+#include "MeshCache.hpp"
+#include "TextureCache.hpp"
+#include "ResourceArchive.hpp"
+#include "FileUtils.hpp"
+
+// The engine objects link in, they want these
+Globals globals;
+extern TextureCache textureCache;
+
+
+static bool HasExtension( const std::string& path, const char* extension)
+{
+    size_t length = strlen( extension);
+    if ( path.size() < length)
+        return false;
+    for ( size_t i = 0; i < length; ++i)
+        if ( tolower( path[path.size() - length + i]) != extension[i])
+            return false;
+    return true;
+}
+
+
+// Comments out, the lines with nothing left on them dropped, the rest trimmed
+static std::vector<unsigned char> StripShader( const std::vector<unsigned char>& source)
+{
+    std::string text( source.begin(), source.end());
+    std::string out, line;
+    auto endLine = [&]() {
+        size_t first = line.find_first_not_of( " \t");
+        if ( first != std::string::npos)
+            out += line.substr( first, line.find_last_not_of( " \t") - first + 1) + '\n';
+        line.clear();
+    };
+
+    bool blockComment = false;
+    for ( size_t i = 0; i <= text.size(); ++i) {
+        char c = i < text.size() ? text[i] : '\n';
+        char next = i + 1 < text.size() ? text[i + 1] : 0;
+        if ( blockComment) {
+            if ( c == '*' && next == '/') {
+                blockComment = false;
+                ++i;
+            } else if ( c == '\n') {
+                endLine();
+            }
+        } else if ( c == '/' && next == '/') {
+            while ( i + 1 < text.size() && text[i + 1] != '\n')
+                ++i;
+        } else if ( c == '/' && next == '*') {
+            blockComment = true;
+            line += ' ';
+            ++i;
+        } else if ( c == '\n') {
+            endLine();
+        } else if ( c != '\r') {
+            line += c;
+        }
+    }
+    return std::vector<unsigned char>( out.begin(), out.end());
+}
+
+
+int main( int argc, char* argv[])
+{
+    std::string resources = argc > 1 ? argv[1] : "res";
+    std::string archivePath = argc > 2 ? argv[2] : "res.pak";
+    if ( argc > 3) {
+        std::cout << "Usage: " << argv[0] << " [resource directory (res)] [archive (res.pak)]\n";
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> files;
+    ListFiles( resources, files);
+    if ( files.empty()) {
+        std::cout << "Nothing to cook in " << resources << std::endl;
+        return 1;
+    }
+
+    ArchiveWriter writer;
+    int shaders = 0, models = 0, textures = 0, failed = 0;
+    for ( auto& path: files) {
+        std::vector<unsigned char> data;
+        if ( HasExtension( path, ".vert") || HasExtension( path, ".frag") || HasExtension( path, ".geom") || HasExtension( path, ".glsl")) {
+            if ( !ReadFile( path, data)) {
+                std::cout << "  Can't read " << path << "\n";
+                ++failed;
+                continue;
+            }
+            writer.Add( path, StripShader( data), ARCHIVE_RAW);
+            ++shaders;
+        } else if ( HasExtension( path, ".obj")) {
+            CookedModel model;
+            if ( !Model::Import( path, model)) {
+                std::cout << "  " << path << model.log << "\n";
+                ++failed;
+                continue;
+            }
+            MeshCache::Encode( model, data);
+            writer.Add( path, data, ARCHIVE_MESH);
+            ++models;
+        } else if ( HasExtension( path, ".png") || HasExtension( path, ".jpg") || HasExtension( path, ".jpeg") || HasExtension( path, ".tga")) {
+            // the ones without color stay RGBA8 in the game, they are read from res/ as before
+            int width, height, channels;
+            if ( !stbi_info( path.c_str(), &width, &height, &channels) || channels < 3)
+                continue;
+            CookedTexture texture;
+            if ( !textureCache.Cook( path, channels == 4 ? BLOCK_FORMAT_BC3 : BLOCK_FORMAT_BC1, texture)) {
+                std::cout << "  Can't read " << path << "\n";
+                ++failed;
+                continue;
+            }
+            TextureCache::EncodeKTX( texture, data);
+            writer.Add( path, data, ARCHIVE_KTX);
+            ++textures;
+        }
+    }
+
+    if ( !writer.Write( archivePath)) {
+        std::cout << "Could not write " << archivePath << std::endl;
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start).count();
+    std::cout << archivePath << ": " << shaders << " shaders, " << models << " models, " << textures << " textures, "
+              << writer.GetSize() / 1024 << " KB packed to " << writer.GetStoredSize() / 1024 << " KB in "
+              << seconds << " s" << std::endl;
+    return failed > 0 ? 1 : 0;
+}